@@ -0,0 +1,13 @@
+# record_build_flags( target ): compile target with BUILD_FLAGS set to the flags it is really built
+# with, so results.h can report them -- call it after the target's own target_compile_options( ).
+
+function(record_build_flags target)
+    string(TOUPPER "${CMAKE_BUILD_TYPE}" config)
+    string(STRIP "${CMAKE_CXX_FLAGS} ${CMAKE_CXX_FLAGS_${config}}" flags)
+    if(flags)
+        string(APPEND flags " ")
+    endif()
+    # the target's own options and the ones it picks up from what it links, like -fopenmp:
+    string(APPEND flags "$<JOIN:$<TARGET_PROPERTY:${target},COMPILE_OPTIONS>, >")
+    target_compile_definitions(${target} PRIVATE "BUILD_FLAGS=\"${flags}\"")
+endfunction()
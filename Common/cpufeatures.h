@@ -0,0 +1,110 @@
+/*
+ *
+ * Runtime CPU feature detection (x86 cpuid + xgetbv) for picking SIMD kernels at startup.
+ *
+ * A feature only counts if the CPU has it *and* the OS saves the matching register state on a
+ * context switch (XCR0), so an AVX-512 CPU under an OS or VM that doesn't enable the ZMM state
+ * reports no AVX-512:
+ *
+ *		const CpuFeatures &cpu = GetCpuFeatures( );
+ *		if( cpu.avx2 && cpu.fma )
+ *			...
+ *
+ * On other architectures everything reads false.
+ *
+ */
+
+#ifndef COMMON_CPUFEATURES_H
+#define COMMON_CPUFEATURES_H
+
+#include <stdio.h>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#include <cpuid.h>
+#define HAVE_CPUID	1
+#else
+#define HAVE_CPUID	0
+#endif
+
+struct CpuFeatures
+{
+	bool	sse2;
+	bool	avx;
+	bool	avx2;
+	bool	fma;
+	bool	avx512f;
+	bool	avx512dq;		// 64-bit integer multiplies and conversions -- not on every AVX-512 CPU
+};
+
+
+#if HAVE_CPUID
+
+// which register state the OS has enabled:
+inline unsigned long long
+ReadXcr0( )
+{
+	unsigned int eax, edx;
+	__asm__ __volatile__( "xgetbv" : "=a"( eax ), "=d"( edx ) : "c"( 0 ) );
+	return ( (unsigned long long)edx << 32 ) | eax;
+}
+
+inline CpuFeatures
+DetectCpuFeatures( )
+{
+	CpuFeatures f = { false, false, false, false, false, false };
+	unsigned int eax, ebx, ecx, edx;
+	if( ! __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+		return f;
+
+	f.sse2 = ( edx & bit_SSE2 ) != 0;
+	bool osxsave = ( ecx & bit_OSXSAVE ) != 0;
+	if( ! osxsave )
+		return f;
+
+	unsigned long long xcr0 = ReadXcr0( );
+	bool ymmState = ( xcr0 & 0x06 ) == 0x06;		// XMM and YMM
+	bool zmmState = ( xcr0 & 0xe6 ) == 0xe6;		// ... plus opmask, ZMM_Hi256, Hi16_ZMM
+	if( ! ymmState )
+		return f;
+
+	f.avx = ( ecx & bit_AVX ) != 0;
+	f.fma = f.avx && ( ecx & bit_FMA ) != 0;
+
+	if( __get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) )
+	{
+		f.avx2    = f.avx && ( ebx & bit_AVX2 ) != 0;
+		f.avx512f  = zmmState && ( ebx & bit_AVX512F ) != 0;
+		f.avx512dq = f.avx512f && ( ebx & bit_AVX512DQ ) != 0;		// CPUID.7:EBX bit 17
+	}
+	return f;
+}
+
+#else
+
+inline CpuFeatures
+DetectCpuFeatures( )
+{
+	CpuFeatures f = { false, false, false, false, false, false };
+	return f;
+}
+
+#endif		// HAVE_CPUID
+
+// detected once, on first use:
+inline const CpuFeatures &
+GetCpuFeatures( )
+{
+	static CpuFeatures features = DetectCpuFeatures( );
+	return features;
+}
+
+inline void
+PrintCpuFeatures( FILE *fp )
+{
+	const CpuFeatures &f = GetCpuFeatures( );
+	fprintf( fp, "CPU features:%s%s%s%s%s%s\n",
+		f.sse2 ? " sse2" : "", f.avx ? " avx" : "", f.avx2 ? " avx2" : "", f.fma ? " fma" : "", f.avx512f ? " avx512f" : "",
+		f.avx512dq ? " avx512dq" : "" );
+}
+
+#endif		// COMMON_CPUFEATURES_H
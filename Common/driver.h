@@ -0,0 +1,116 @@
+/*
+ *
+ * Common benchmark driver helpers shared by the project binaries.
+ *
+ * Instead of recompiling for every -DNUMT / -DSIZE / -DARRAYSIZE combination, a binary reads its
+ * thread counts and problem sizes from the command line and runs the whole sweep in one process:
+ *
+ *		./Project0 --threads 1,2,4,8 --sizes 1000,20000,1e6
+ *
+ * The compile-time macros are still honored, they just become the defaults.
+ *
+ */
+
+#ifndef COMMON_DRIVER_H
+#define COMMON_DRIVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+
+// return the text following "--name" on the command line, or NULL if the flag is not there:
+inline const char *
+ArgValue( int argc, char *argv[ ], const char *name )
+{
+	for( int i = 1; i < argc-1; i++ )
+	{
+		if( strcmp( argv[i], name ) == 0 )
+			return argv[i+1];
+	}
+	return NULL;
+}
+
+// true if "--name" appears on the command line:
+inline bool
+ArgFlag( int argc, char *argv[ ], const char *name )
+{
+	for( int i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], name ) == 0 )
+			return true;
+	}
+	return false;
+}
+
+// parse one number -- accepts 1000, 8e6, 1e10, ...:
+inline double
+ArgNumber( const char *text, const char *name )
+{
+	char *end;
+	double value = strtod( text, &end );
+	if( end == text || ( *end != '\0' && *end != ',' ) )
+	{
+		fprintf( stderr, "Bad value '%s' for %s\n", text, name );
+		exit( 1 );
+	}
+	return value;
+}
+
+inline long long
+ArgInt( int argc, char *argv[ ], const char *name, long long defaultValue )
+{
+	const char *text = ArgValue( argc, argv, name );
+	if( text == NULL )
+		return defaultValue;
+	return (long long) ArgNumber( text, name );
+}
+
+inline double
+ArgDouble( int argc, char *argv[ ], const char *name, double defaultValue )
+{
+	const char *text = ArgValue( argc, argv, name );
+	if( text == NULL )
+		return defaultValue;
+	return ArgNumber( text, name );
+}
+
+inline const char *
+ArgString( int argc, char *argv[ ], const char *name, const char *defaultValue )
+{
+	const char *text = ArgValue( argc, argv, name );
+	if( text == NULL )
+		return defaultValue;
+	return text;
+}
+
+// parse a comma-separated list such as "1,2,4,8" into numbers:
+inline std::vector<long long>
+ArgList( int argc, char *argv[ ], const char *name, std::vector<long long> defaultValues )
+{
+	const char *text = ArgValue( argc, argv, name );
+	if( text == NULL )
+		return defaultValues;
+
+	std::vector<long long> values;
+	const char *p = text;
+	while( *p != '\0' )
+	{
+		double value = ArgNumber( p, name );
+		if( value < 1. )
+		{
+			fprintf( stderr, "Values for %s must be positive, got '%s'\n", name, text );
+			exit( 1 );
+		}
+		values.push_back( (long long) value );
+
+		const char *comma = strchr( p, ',' );
+		if( comma == NULL )
+			break;
+		p = comma + 1;
+	}
+	return values;
+}
+
+#endif		// COMMON_DRIVER_H
@@ -0,0 +1,251 @@
+/*
+ *
+ * NUMA-aware array placement and thread pinning for the array benchmarks.
+ *
+ * Linux puts a page on the node of the thread that first writes it. If the main thread
+ * initializes the arrays, every page ends up on its socket and the other socket's threads
+ * stream everything across the interconnect, so the speedups flatten out. Here the arrays are
+ * first touched in parallel with the same static partitioning the compute loops use, so each
+ * thread's chunk lives on its own node:
+ *
+ *		float *A = FirstTouchFloats( n, numt, [ ]( long long i ) { return 1.f; } );
+ *		...
+ *		#pragma omp parallel for schedule(static)		(same numt)
+ *
+ * Kernels that split the arrays their own way pass where each thread's part starts (a SplitStart)
+ * to FirstTouchFloats( ) and PrintPlacement( ) instead.
+ *
+ * Threads only stay near their pages if they don't migrate, so --pin binds each OpenMP thread to
+ * one CPU (unless OMP_PROC_BIND / OMP_PLACES already did), and --placement reports which node the
+ * pages of an array ended up on and how many of them are local to the thread that uses them.
+ *
+ * Page placement is read with the move_pages( ) system call in query mode, so no libnuma is
+ * needed; where it isn't available (no NUMA support, not Linux) the report just says so.
+ *
+ */
+
+#ifndef COMMON_NUMA_H
+#define COMMON_NUMA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <omp.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#define NUMA_ALIGNMENT			64			// cache-line aligned, enough for AVX-512 too
+#define NUMA_PLACEMENT_SAMPLES	4096		// most pages looked at per array for --placement
+
+
+// where thread t of numThreads starts under schedule(static) with no chunk size (libgomp and
+// libomp both give the first n % numThreads threads one extra element), and thread numThreads
+// "starts" at n:
+inline long long
+StaticStart( int t, long long n, int numThreads )
+{
+	long long q = n / numThreads;
+	long long r = n % numThreads;
+	return t*q + std::min( (long long)t, r );
+}
+
+typedef long long (*SplitStart)( int t, long long n, int numThreads );
+
+// which of numThreads threads gets element i, when thread t's part starts at start( t, n, numThreads ):
+inline int
+SplitOwner( long long i, long long n, int numThreads, SplitStart start = StaticStart )
+{
+	int lo = 0, hi = numThreads - 1;
+	while( lo < hi )
+	{
+		int mid = ( lo + hi + 1 ) / 2;
+		if( start( mid, n, numThreads ) <= i )
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+// allocate n floats and have the numThreads threads that will use them write init( i ) into
+// their own part first -- the static split, unless the kernels split the array some other way:
+template< class INIT >
+float *
+FirstTouchFloats( long long n, int numThreads, INIT init, SplitStart start = StaticStart )
+{
+	size_t bytes = ( ( n*sizeof(float) + NUMA_ALIGNMENT-1 ) / NUMA_ALIGNMENT ) * NUMA_ALIGNMENT;
+	if( bytes == 0 )
+		bytes = NUMA_ALIGNMENT;
+	float *p = (float *) aligned_alloc( NUMA_ALIGNMENT, bytes );
+	if( p == NULL )
+	{
+		fprintf( stderr, "Cannot allocate %lld floats\n", n );
+		exit( 1 );
+	}
+
+	#pragma omp parallel num_threads( numThreads )
+	{
+		int me = omp_get_thread_num( );
+		long long last = start( me+1, n, numThreads );
+		for( long long i = start( me, n, numThreads ); i < last; i++ )
+			p[i] = init( i );
+	}
+
+	return p;
+}
+
+
+#ifdef __linux__
+
+// the CPU and node the calling thread is on right now:
+inline void
+WhereAmI( int &cpu, int &node )
+{
+	unsigned int c = 0, nd = 0;
+	if( syscall( SYS_getcpu, &c, &nd, NULL ) != 0 )
+	{
+		c  = 0;
+		nd = 0;
+	}
+	cpu  = (int)c;
+	node = (int)nd;
+}
+
+// is the OpenMP runtime already binding threads (OMP_PROC_BIND / OMP_PLACES)?
+inline bool
+RuntimeBinds( )
+{
+	return omp_get_proc_bind( ) != omp_proc_bind_false;
+}
+
+// bind OpenMP thread t of numThreads to the t-th CPU this process may run on, spreading over
+// all of them if there are more threads than CPUs; prints where each thread ended up:
+inline void
+PinThreads( int numThreads, FILE *fp )
+{
+	if( RuntimeBinds( ) )
+	{
+		if( fp != NULL )
+			fprintf( fp, "Threads are bound by the OpenMP runtime (OMP_PROC_BIND=%s)\n",
+				getenv( "OMP_PROC_BIND" ) != NULL ? getenv( "OMP_PROC_BIND" ) : "?" );
+		return;
+	}
+
+	cpu_set_t allowed;
+	CPU_ZERO( &allowed );
+	sched_getaffinity( 0, sizeof(allowed), &allowed );
+	std::vector<int> cpus;
+	for( int c = 0; c < CPU_SETSIZE; c++ )
+	{
+		if( CPU_ISSET( c, &allowed ) )
+			cpus.push_back( c );
+	}
+	if( cpus.empty( ) )
+		return;
+
+	std::vector<int> where( 2*numThreads, -1 );
+	#pragma omp parallel num_threads( numThreads )
+	{
+		int me = omp_get_thread_num( );
+		cpu_set_t one;
+		CPU_ZERO( &one );
+		CPU_SET( cpus[ me % (int)cpus.size( ) ], &one );
+		sched_setaffinity( 0, sizeof(one), &one );
+		WhereAmI( where[2*me], where[2*me+1] );
+	}
+
+	if( fp != NULL )
+	{
+		fprintf( fp, "Pinned %d threads:", numThreads );
+		for( int t = 0; t < numThreads; t++ )
+			fprintf( fp, "  %d->cpu%d/node%d", t, where[2*t], where[2*t+1] );
+		fprintf( fp, "\n" );
+	}
+}
+
+// report which nodes the pages of an array are on, and what fraction of them are on the node of
+// the thread whose part they hold:
+inline void
+PrintPlacement( FILE *fp, const char *label, const float *p, long long n, int numThreads, SplitStart start = StaticStart )
+{
+	long pageSize = sysconf( _SC_PAGESIZE );
+	char *first = (char *)( (uintptr_t)p & ~(uintptr_t)( pageSize-1 ) );
+	char *last  = (char *)&p[ n > 0 ? n-1 : 0 ];
+	long long numPages = ( last - first ) / pageSize + 1;
+	long long stride = ( numPages + NUMA_PLACEMENT_SAMPLES-1 ) / NUMA_PLACEMENT_SAMPLES;
+
+	std::vector<void *> pages;
+	for( long long pg = 0; pg < numPages; pg += stride )
+		pages.push_back( first + pg*pageSize );
+	std::vector<int> status( pages.size( ), -1 );
+
+	// nodes == NULL: just ask where the pages are
+	if( syscall( SYS_move_pages, 0, (unsigned long)pages.size( ), pages.data( ), NULL, status.data( ), 0 ) != 0 )
+	{
+		fprintf( fp, "%-24s page placement is not available here: %s\n", label, strerror( errno ) );
+		return;
+	}
+
+	// which node does each thread of this team run on?
+	std::vector<int> threadNode( numThreads, 0 );
+	#pragma omp parallel num_threads( numThreads )
+	{
+		int cpu;
+		WhereAmI( cpu, threadNode[ omp_get_thread_num( ) ] );
+	}
+
+	std::map<int,long long> perNode;
+	long long placed = 0, local = 0;
+	for( size_t k = 0; k < pages.size( ); k++ )
+	{
+		perNode[ status[k] ]++;
+		if( status[k] < 0 )
+			continue;		// not faulted in yet (or an error for that page)
+		placed++;
+
+		// the owner of the first element on this page:
+		long long i = ( (char *)pages[k] - (char *)p ) / (long long)sizeof(float);
+		if( i < 0 )
+			i = 0;
+		if( status[k] == threadNode[ SplitOwner( i, n, numThreads, start ) ] )
+			local++;
+	}
+
+	fprintf( fp, "%-24s %lld pages (%zu sampled):", label, numPages, pages.size( ) );
+	for( auto &pn : perNode )
+	{
+		if( pn.first >= 0 )
+			fprintf( fp, "  node%d %5.1lf%%", pn.first, 100.*(double)pn.second/(double)pages.size( ) );
+		else
+			fprintf( fp, "  unplaced %5.1lf%%", 100.*(double)pn.second/(double)pages.size( ) );
+	}
+	fprintf( fp, "   local to their thread %5.1lf%%\n", placed > 0 ? 100.*(double)local/(double)placed : 0. );
+}
+
+#else		// not linux -- first touch still works, the rest is a no-op
+
+inline void
+PinThreads( int numThreads, FILE *fp )
+{
+	if( fp != NULL )
+		fprintf( fp, "Thread pinning needs Linux sched_setaffinity -- use OMP_PROC_BIND=close instead\n" );
+}
+
+inline void
+PrintPlacement( FILE *fp, const char *label, const float *p, long long n, int numThreads, SplitStart start = StaticStart )
+{
+	fprintf( fp, "%-24s page placement needs Linux move_pages\n", label );
+}
+
+#endif		// __linux__
+
+#endif		// COMMON_NUMA_H
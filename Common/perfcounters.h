@@ -0,0 +1,211 @@
+/*
+ *
+ * Optional hardware performance counters (Linux perf_event_open) for the timed kernels.
+ *
+ * Each OpenMP thread opens its own group of counters (cycles, instructions, last-level-cache misses
+ * and branch misses), the main thread enables and disables all groups around a kernel, and the
+ * counts are summed over the threads. From those we get IPC and bytes per cycle, which tell a
+ * compute-bound run apart from a memory-bound one:
+ *
+ *		PerfCounters pc;
+ *		if( PerfOpen( pc, numt ) )
+ *		{
+ *			PerfCounts c = PerfMeasure( pc, [&]( ) { NonSimdMul( A, B, C, n ); }, 100 );
+ *			fprintf( stderr, "IPC = %5.2lf\n", c.Ipc( ) );
+ *		}
+ *		PerfClose( pc );
+ *
+ * The counters follow OS threads, so this relies on the OpenMP runtime reusing the same threads
+ * for every parallel region of the same size (libgomp and libomp both do). Turn it on with --perf.
+ * On machines without a PMU (most VMs) or with perf_event_paranoid > 2, PerfOpen( ) just says so
+ * and returns false.
+ *
+ */
+
+#ifndef COMMON_PERFCOUNTERS_H
+#define COMMON_PERFCOUNTERS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <omp.h>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define PERF_NUM_EVENTS		4		// cycles, instructions, LLC misses, branch misses
+
+struct PerfCounts
+{
+	double	cycles;			// all of these are per kernel call, summed over the threads
+	double	instructions;
+	double	llcMisses;
+	double	branchMisses;
+
+	double	Ipc( ) const						{ return cycles > 0. ? instructions / cycles : 0.; }
+	double	BytesPerCycle( double bytes ) const	{ return cycles > 0. ? bytes / cycles : 0.; }
+};
+
+struct PerfCounters
+{
+	std::vector<int>	fds;		// PERF_NUM_EVENTS per thread, the first of each group is the leader
+	int					numThreads;
+	bool				open;
+
+	PerfCounters( ) : numThreads( 0 ), open( false ) { }
+};
+
+
+#ifdef __linux__
+
+inline int
+PerfEventOpen( unsigned long long config, int groupFd )
+{
+	struct perf_event_attr attr;
+	memset( &attr, 0, sizeof(attr) );
+	attr.size           = sizeof(attr);
+	attr.type           = PERF_TYPE_HARDWARE;
+	attr.config         = config;
+	attr.disabled       = groupFd == -1;		// only the leader starts disabled
+	attr.exclude_kernel = 1;
+	attr.exclude_hv     = 1;
+	attr.read_format    = PERF_FORMAT_GROUP;
+
+	// pid = 0, cpu = -1: this thread, wherever it runs
+	return (int) syscall( __NR_perf_event_open, &attr, 0, -1, groupFd, 0 );
+}
+
+// open one counter group in each of numThreads OpenMP threads:
+inline bool
+PerfOpen( PerfCounters &pc, int numThreads )
+{
+	const unsigned long long events[PERF_NUM_EVENTS] =
+	{
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	pc.numThreads = numThreads;
+	pc.fds.assign( numThreads*PERF_NUM_EVENTS, -1 );
+	int firstErrno = 0;
+
+	#pragma omp parallel num_threads( numThreads )
+	{
+		int me = omp_get_thread_num( );
+		int *fds = &pc.fds[me*PERF_NUM_EVENTS];
+		for( int e = 0; e < PERF_NUM_EVENTS; e++ )
+		{
+			fds[e] = PerfEventOpen( events[e], e == 0 ? -1 : fds[0] );
+			if( fds[e] < 0 )
+			{
+				#pragma omp critical
+				if( firstErrno == 0 )
+					firstErrno = errno;
+				break;
+			}
+		}
+	}
+
+	pc.open = firstErrno == 0;
+	if( ! pc.open )
+	{
+		fprintf( stderr, "Hardware performance counters are not available here: %s\n", strerror( firstErrno ) );
+		for( int fd : pc.fds )
+		{
+			if( fd >= 0 )
+				close( fd );
+		}
+		pc.fds.clear( );
+	}
+	return pc.open;
+}
+
+inline void
+PerfClose( PerfCounters &pc )
+{
+	for( int fd : pc.fds )
+	{
+		if( fd >= 0 )
+			close( fd );
+	}
+	pc.fds.clear( );
+	pc.open = false;
+}
+
+// run the kernel numCalls times with the counters on, and return the per-call counts:
+template< class KERNEL >
+PerfCounts
+PerfMeasure( PerfCounters &pc, KERNEL kernel, int numCalls )
+{
+	PerfCounts c = { 0., 0., 0., 0. };
+	if( ! pc.open || numCalls < 1 )
+		return c;
+
+	for( int t = 0; t < pc.numThreads; t++ )
+	{
+		int leader = pc.fds[t*PERF_NUM_EVENTS];
+		ioctl( leader, PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP );
+		ioctl( leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+	}
+
+	for( int i = 0; i < numCalls; i++ )
+		kernel( );
+
+	for( int t = 0; t < pc.numThreads; t++ )
+		ioctl( pc.fds[t*PERF_NUM_EVENTS], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+
+	double sums[PERF_NUM_EVENTS] = { 0., 0., 0., 0. };
+	for( int t = 0; t < pc.numThreads; t++ )
+	{
+		// PERF_FORMAT_GROUP: the number of events, then one value per event
+		unsigned long long values[1+PERF_NUM_EVENTS];
+		if( read( pc.fds[t*PERF_NUM_EVENTS], values, sizeof(values) ) != (ssize_t)sizeof(values) )
+			continue;
+		for( int e = 0; e < PERF_NUM_EVENTS; e++ )
+			sums[e] += (double)values[1+e];
+	}
+
+	c.cycles       = sums[0] / (double)numCalls;
+	c.instructions = sums[1] / (double)numCalls;
+	c.llcMisses    = sums[2] / (double)numCalls;
+	c.branchMisses = sums[3] / (double)numCalls;
+	return c;
+}
+
+#else		// not linux -- no counters
+
+inline bool
+PerfOpen( PerfCounters &pc, int numThreads )
+{
+	fprintf( stderr, "Hardware performance counters need Linux perf_event_open\n" );
+	return false;
+}
+
+inline void
+PerfClose( PerfCounters &pc )
+{
+}
+
+template< class KERNEL >
+PerfCounts
+PerfMeasure( PerfCounters &pc, KERNEL kernel, int numCalls )
+{
+	PerfCounts c = { 0., 0., 0., 0. };
+	return c;
+}
+
+#endif		// __linux__
+
+// print the counts for one kernel, with bytes moved and "work" units done per call:
+inline void
+PrintPerfCounts( FILE *fp, const char *label, const PerfCounts &c, double bytes, double work )
+{
+	fprintf( fp, "%-24s IPC %5.2lf   %7.3lf bytes/cycle   %8.3lf cycles/elem   %8.4lf LLC misses/elem   %8.4lf branch misses/elem\n",
+		label, c.Ipc( ), c.BytesPerCycle( bytes ), c.cycles / work, c.llcMisses / work, c.branchMisses / work );
+}
+
+#endif		// COMMON_PERFCOUNTERS_H
@@ -0,0 +1,302 @@
+/*
+ *
+ * Common machine-readable result emitter shared by the project binaries.
+ *
+ * Each measurement becomes one record with the same fields no matter which project produced it,
+ * so runs can be diffed automatically instead of hand-copying stderr lines into result.csv:
+ *
+ *		./Project0 --threads 1,4 --results runs.jsonl				(JSON, one object per line)
+ *		./proj04 --sizes 1000,1e6 --results - --format csv		(CSV on stdout)
+ *
+ * The human-readable stderr output is unchanged.
+ *
+ * Fields: schema, benchmark, kernel, host, compiler, flags, timestamp, threads, size, unit, rate,
+ * rate_unit, samples, reps_per_sample, min, median, mean, p95, p99, stddev, below_resolution,
+ * times (seconds per call for every sample), check_passed, check, plus any extra name=value pairs.
+ *
+ */
+
+#ifndef COMMON_RESULTS_H
+#define COMMON_RESULTS_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "driver.h"
+#include "timing.h"
+
+#define RESULTS_SCHEMA		"cs575-result/1"
+
+// the build flags are handed in with -DBUILD_FLAGS="\"-O3 -fopenmp\"" (the CMake builds do it with
+// record_build_flags( ) from BuildFlags.cmake), otherwise we report what the compiler tells us:
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS			""
+#endif
+
+struct Result
+{
+	std::string		benchmark;		// which binary, e.g. "Project0"
+	std::string		kernel;			// which measurement, e.g. "SimdMulSum"
+	int				threads;
+	long long		size;			// problem size ...
+	std::string		unit;			// ... and what it counts, e.g. "elements" or "trials"
+	double			rate;			// headline rate in rateUnit
+	std::string		rateUnit;		// e.g. "MegaMults/Sec"
+	TimingStats		timing;
+	bool			checked;		// was a correctness check done for this record?
+	bool			passed;
+	std::string		check;			// what was checked and what came out
+	std::vector< std::pair<std::string,double> >	extra;
+
+	Result( ) : threads( 1 ), size( 0 ), rate( 0. ), checked( false ), passed( false ) { }
+};
+
+enum ResultsFormat { RESULTS_JSON, RESULTS_CSV };
+
+static FILE *			ResultsFile   = NULL;	// NULL means "not asked for"
+static ResultsFormat	ResultsFmt    = RESULTS_JSON;
+static bool				ResultsHeader = false;	// has the CSV header been written?
+
+
+// look for --results FILE (or - for stdout) and --format json|csv:
+inline void
+OpenResults( int argc, char *argv[ ] )
+{
+	const char *path   = ArgValue( argc, argv, "--results" );
+	const char *format = ArgString( argc, argv, "--format", "json" );
+	if( path == NULL )
+		return;
+
+	if( strcmp( format, "csv" ) == 0 )
+		ResultsFmt = RESULTS_CSV;
+	else if( strcmp( format, "json" ) == 0 )
+		ResultsFmt = RESULTS_JSON;
+	else
+	{
+		fprintf( stderr, "Unknown --format '%s' (use json or csv)\n", format );
+		exit( 1 );
+	}
+
+	if( strcmp( path, "-" ) == 0 )
+		ResultsFile = stdout;
+	else
+	{
+		ResultsFile = fopen( path, "a" );
+		if( ResultsFile == NULL )
+		{
+			fprintf( stderr, "Cannot open results file '%s'\n", path );
+			exit( 1 );
+		}
+
+		// appending csv to a file that already has a header?
+		fseek( ResultsFile, 0, SEEK_END );
+		ResultsHeader = ftell( ResultsFile ) > 0;
+	}
+}
+
+inline void
+CloseResults( )
+{
+	if( ResultsFile != NULL && ResultsFile != stdout )
+		fclose( ResultsFile );
+	ResultsFile = NULL;
+}
+
+inline std::string
+HostName( )
+{
+	char name[256];
+	if( gethostname( name, sizeof(name) ) != 0 )
+		return "unknown";
+	name[sizeof(name)-1] = '\0';
+	return name;
+}
+
+inline std::string
+CompilerName( )
+{
+#if defined(__clang__)
+	return std::string( "clang " ) + __clang_version__;
+#elif defined(__GNUC__)
+	return std::string( "g++ " ) + __VERSION__;
+#else
+	return "unknown";
+#endif
+}
+
+inline std::string
+CompilerFlags( )
+{
+	std::string flags = BUILD_FLAGS;
+	if( ! flags.empty( ) )
+		return flags;
+
+#ifdef __OPTIMIZE__
+	flags += "optimized";
+#else
+	flags += "-O0";
+#endif
+#ifdef _OPENMP
+	flags += " openmp=" + std::to_string( _OPENMP );
+#endif
+#if defined(__AVX512F__)
+	flags += " avx512f";
+#elif defined(__AVX2__)
+	flags += " avx2";
+#elif defined(__SSE2__)
+	flags += " sse2";
+#endif
+#ifdef __FMA__
+	flags += " fma";
+#endif
+	return flags;
+}
+
+inline std::string
+TimeStamp( )
+{
+	char text[64];
+	time_t now = time( NULL );
+	strftime( text, sizeof(text), "%Y-%m-%dT%H:%M:%S", localtime( &now ) );
+	return text;
+}
+
+// quote a string for JSON (control characters become \u00XX):
+inline std::string
+Quoted( const std::string &s )
+{
+	std::string q = "\"";
+	for( char c : s )
+	{
+		if( (unsigned char)c < 0x20 )
+		{
+			char escaped[8];
+			snprintf( escaped, sizeof(escaped), "\\u%04x", (unsigned int)(unsigned char)c );
+			q += escaped;
+			continue;
+		}
+		if( c == '"' || c == '\\' )
+			q += '\\';
+		q += c;
+	}
+	return q + "\"";
+}
+
+// a number for JSON, which has no inf or nan -- those become null:
+inline std::string
+JsonNumber( double x, const char *format = "%.6g" )
+{
+	if( ! isfinite( x ) )
+		return "null";
+	char text[32];
+	snprintf( text, sizeof(text), format, x );
+	return text;
+}
+
+// quote a string for CSV (embedded quotes are doubled):
+inline std::string
+CsvQuoted( const std::string &s )
+{
+	std::string q = "\"";
+	for( char c : s )
+	{
+		if( c == '"' )
+			q += '"';
+		if( c == '\n' )
+			c = ' ';
+		q += c;
+	}
+	return q + "\"";
+}
+
+inline void
+EmitJson( const Result &r )
+{
+	FILE *fp = ResultsFile;
+	const TimingStats &st = r.timing;
+
+	fprintf( fp, "{\"schema\":%s,\"benchmark\":%s,\"kernel\":%s,\"host\":%s,\"compiler\":%s,\"flags\":%s,\"timestamp\":%s,",
+		Quoted( RESULTS_SCHEMA ).c_str( ), Quoted( r.benchmark ).c_str( ), Quoted( r.kernel ).c_str( ),
+		Quoted( HostName( ) ).c_str( ), Quoted( CompilerName( ) ).c_str( ), Quoted( CompilerFlags( ) ).c_str( ),
+		Quoted( TimeStamp( ) ).c_str( ) );
+	fprintf( fp, "\"threads\":%d,\"size\":%lld,\"unit\":%s,\"rate\":%s,\"rate_unit\":%s,",
+		r.threads, r.size, Quoted( r.unit ).c_str( ), JsonNumber( r.rate ).c_str( ), Quoted( r.rateUnit ).c_str( ) );
+	fprintf( fp, "\"samples\":%d,\"reps_per_sample\":%d,\"min\":%s,\"median\":%s,\"mean\":%s,\"p95\":%s,\"p99\":%s,\"stddev\":%s,\"below_resolution\":%s,",
+		st.samples, st.repsPerSample, JsonNumber( st.min, "%.6e" ).c_str( ), JsonNumber( st.median, "%.6e" ).c_str( ),
+		JsonNumber( st.mean, "%.6e" ).c_str( ), JsonNumber( st.p95, "%.6e" ).c_str( ), JsonNumber( st.p99, "%.6e" ).c_str( ),
+		JsonNumber( st.stddev, "%.6e" ).c_str( ), st.belowResolution ? "true" : "false" );
+
+	fprintf( fp, "\"times\":[" );
+	for( size_t i = 0; i < st.times.size( ); i++ )
+		fprintf( fp, "%s%s", i == 0 ? "" : ",", JsonNumber( st.times[i], "%.6e" ).c_str( ) );
+	fprintf( fp, "]," );
+
+	if( r.checked )
+		fprintf( fp, "\"check_passed\":%s,\"check\":%s", r.passed ? "true" : "false", Quoted( r.check ).c_str( ) );
+	else
+		fprintf( fp, "\"check_passed\":null,\"check\":null" );
+
+	for( auto &e : r.extra )
+		fprintf( fp, ",%s:%s", Quoted( e.first ).c_str( ), JsonNumber( e.second ).c_str( ) );
+	fprintf( fp, "}\n" );
+}
+
+inline void
+EmitCsv( const Result &r )
+{
+	FILE *fp = ResultsFile;
+	const TimingStats &st = r.timing;
+
+	if( ! ResultsHeader )
+	{
+		fprintf( fp, "schema,benchmark,kernel,host,compiler,flags,timestamp,threads,size,unit,rate,rate_unit,"
+			"samples,reps_per_sample,min,median,mean,p95,p99,stddev,below_resolution,times,check_passed,check,extra\n" );
+		ResultsHeader = true;
+	}
+
+	fprintf( fp, "%s,%s,%s,%s,%s,%s,%s,%d,%lld,%s,%.6g,%s,",
+		RESULTS_SCHEMA, CsvQuoted( r.benchmark ).c_str( ), CsvQuoted( r.kernel ).c_str( ), CsvQuoted( HostName( ) ).c_str( ),
+		CsvQuoted( CompilerName( ) ).c_str( ), CsvQuoted( CompilerFlags( ) ).c_str( ), TimeStamp( ).c_str( ),
+		r.threads, r.size, CsvQuoted( r.unit ).c_str( ), r.rate, CsvQuoted( r.rateUnit ).c_str( ) );
+	fprintf( fp, "%d,%d,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%s,",
+		st.samples, st.repsPerSample, st.min, st.median, st.mean, st.p95, st.p99, st.stddev,
+		st.belowResolution ? "true" : "false" );
+
+	// the per-sample times and the extras are packed into one column each:
+	fprintf( fp, "\"" );
+	for( size_t i = 0; i < st.times.size( ); i++ )
+		fprintf( fp, "%s%.6e", i == 0 ? "" : ";", st.times[i] );
+	fprintf( fp, "\"," );
+
+	if( r.checked )
+		fprintf( fp, "%s,%s,", r.passed ? "true" : "false", CsvQuoted( r.check ).c_str( ) );
+	else
+		fprintf( fp, ",," );
+
+	fprintf( fp, "\"" );
+	for( size_t i = 0; i < r.extra.size( ); i++ )
+		fprintf( fp, "%s%s=%.6g", i == 0 ? "" : ";", r.extra[i].first.c_str( ), r.extra[i].second );
+	fprintf( fp, "\"\n" );
+}
+
+// write one record (does nothing unless --results was given):
+inline void
+EmitResult( const Result &r )
+{
+	if( ResultsFile == NULL )
+		return;
+
+	if( ResultsFmt == RESULTS_CSV )
+		EmitCsv( r );
+	else
+		EmitJson( r );
+	fflush( ResultsFile );
+}
+
+#endif		// COMMON_RESULTS_H
@@ -0,0 +1,158 @@
+/*
+ *
+ * Counter-based random numbers (Philox4x32-10, Salmon et al., SC'11) for the Monte Carlo code.
+ *
+ * rand( ) keeps one hidden state, so it can't be called from several threads, and the results
+ * depend on the order the calls happen in. A counter-based generator has no state at all: the
+ * random numbers are a fixed, bijective scramble of ( counter, key ), so trial n simply uses
+ * counter n under the run's seed:
+ *
+ *		float u[PHILOX_OUTPUTS];
+ *		PhiloxUniforms( seed, n, 0, u );		// 4 uniform floats in [0,1) for trial n, block 0
+ *
+ * Any thread can compute any trial's numbers, in any order, so a run gives bit-identical results
+ * for a given seed whatever the thread count or schedule. The generator passes BigCrush and is
+ * checked here against the Random123 known-answer vectors by PhiloxSelfTest( ).
+ *
+ */
+
+#ifndef COMMON_RNG_H
+#define COMMON_RNG_H
+
+#include <stdint.h>
+
+#define PHILOX_OUTPUTS		4			// 32-bit outputs per call
+#define PHILOX_ROUNDS		10
+
+#define PHILOX_M0			0xD2511F53u
+#define PHILOX_M1			0xCD9E8D57u
+#define PHILOX_W0			0x9E3779B9u	// golden ratio
+#define PHILOX_W1			0xBB67AE85u	// sqrt(3) - 1
+
+
+#if defined(__GNUC__)
+#define RNG_INLINE	__attribute__(( always_inline )) inline
+#else
+#define RNG_INLINE	inline
+#endif
+
+
+RNG_INLINE void
+MulHiLo( uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo )
+{
+	uint64_t product = (uint64_t)a * (uint64_t)b;
+	hi = (uint32_t)( product >> 32 );
+	lo = (uint32_t)product;
+}
+
+// the ten rounds on plain 32-bit values -- no arrays, so an "omp simd" loop that calls this can
+// keep every word of every lane in a vector register:
+RNG_INLINE void
+PhiloxRounds( uint32_t &c0, uint32_t &c1, uint32_t &c2, uint32_t &c3, uint32_t k0, uint32_t k1 )
+{
+	for( int r = 0; r < PHILOX_ROUNDS; r++ )
+	{
+		uint32_t hi0, lo0, hi1, lo1;
+		MulHiLo( PHILOX_M0, c0, hi0, lo0 );
+		MulHiLo( PHILOX_M1, c2, hi1, lo1 );
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+}
+
+// the raw generator: 4 x 32 random bits for one 128-bit counter under a 64-bit key:
+inline void
+Philox4x32( const uint32_t counter[4], const uint32_t key[2], uint32_t out[4] )
+{
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	PhiloxRounds( c0, c1, c2, c3, key[0], key[1] );
+
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+// 24 random bits -> a float in [0,1), every value exactly representable:
+RNG_INLINE float
+UniformFloat( uint32_t bits )
+{
+	return (float)(int32_t)( bits >> 8 ) * ( 1.f / 16777216.f );		// (signed: SSE/AVX2 have no unsigned convert)
+}
+
+// PHILOX_OUTPUTS uniform floats for item "index" (a trial number, say) and block "block" of it,
+// if one item needs more than PHILOX_OUTPUTS numbers:
+inline void
+PhiloxUniforms( uint64_t seed, uint64_t index, uint32_t block, float u[PHILOX_OUTPUTS] )
+{
+	uint32_t counter[4] = { (uint32_t)index, (uint32_t)( index >> 32 ), block, 0 };
+	uint32_t key[2]     = { (uint32_t)seed,  (uint32_t)( seed >> 32 ) };
+	uint32_t bits[4];
+	Philox4x32( counter, key, bits );
+	for( int j = 0; j < PHILOX_OUTPUTS; j++ )
+		u[j] = UniformFloat( bits[j] );
+}
+
+// five uniform floats from one call: the top 24 bits of each word give four of them, and the
+// low bytes of the four words (32 more bits, 24 of them used) give the fifth:
+inline void
+PhiloxFiveUniforms( uint64_t seed, uint64_t index, float u[5] )
+{
+	uint32_t counter[4] = { (uint32_t)index, (uint32_t)( index >> 32 ), 0, 0 };
+	uint32_t key[2]     = { (uint32_t)seed,  (uint32_t)( seed >> 32 ) };
+	uint32_t bits[4];
+	Philox4x32( counter, key, bits );
+	for( int j = 0; j < PHILOX_OUTPUTS; j++ )
+		u[j] = UniformFloat( bits[j] );
+	u[4] = UniformFloat( ( bits[0] & 0xff ) << 24 | ( bits[1] & 0xff ) << 16 | ( bits[2] & 0xff ) << 8 );
+}
+
+// scale a uniform [0,1) number to [low,high):
+RNG_INLINE float
+Scale( float u, float low, float high )
+{
+	return low + u * ( high - low );
+}
+
+// the Random123 known-answer tests for philox4x32-10:
+inline bool
+PhiloxSelfTest( )
+{
+	const uint32_t counters[3][4] =
+	{
+		{ 0, 0, 0, 0 },
+		{ 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu },
+		{ 0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u },
+	};
+	const uint32_t keys[3][2] =
+	{
+		{ 0, 0 },
+		{ 0xffffffffu, 0xffffffffu },
+		{ 0xa4093822u, 0x299f31d0u },
+	};
+	const uint32_t answers[3][4] =
+	{
+		{ 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u },
+		{ 0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu },
+		{ 0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u },
+	};
+
+	for( int k = 0; k < 3; k++ )
+	{
+		uint32_t out[4];
+		Philox4x32( counters[k], keys[k], out );
+		for( int j = 0; j < 4; j++ )
+		{
+			if( out[j] != answers[k][j] )
+				return false;
+		}
+	}
+	return true;
+}
+
+#endif		// COMMON_RNG_H
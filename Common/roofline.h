@@ -0,0 +1,300 @@
+/*
+ *
+ * Roofline report for the streaming kernels.
+ *
+ * A STREAM-like triad probe ( a[i] = b[i] + s*c[i] ) measures the sustained bandwidth with the
+ * working set sized to sit in L1, L2, L3 and main memory, and a register-only multiply-add loop
+ * measures the compute ceiling -- built, like Project #4's kernels, as an SSE mul + add and as
+ * AVX2 and AVX-512 fused multiply-adds, of which the fastest one the CPU can run is the peak. A kernel's measured point is then placed against
+ *
+ *		attainable GFLOP/s = min( peak GFLOP/s, arithmetic intensity * bandwidth of the level its data lives in )
+ *
+ * Comparing the point with the roofline for the largest thread count in the sweep says whether more
+ * threads can still help at that size or whether the level's bandwidth is already saturated.
+ *
+ * The two probes are always compiled optimized (with g++), so the roofline belongs to the machine
+ * and not to the build: an unoptimized kernel shows up as sitting well below it.
+ *
+ */
+
+#ifndef COMMON_ROOFLINE_H
+#define COMMON_ROOFLINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <omp.h>
+#include <math.h>
+#include <vector>
+
+#include "timing.h"
+#include "cpufeatures.h"
+
+// the FMA variants of the compute probe need per-function target attributes:
+#if defined(__GNUC__) && HAVE_CPUID
+#define ROOFLINE_AVX_VARIANTS	1
+#else
+#define ROOFLINE_AVX_VARIANTS	0
+#endif
+
+#define ROOFLINE_NUMLEVELS		4		// L1, L2, L3, DRAM
+#define ROOFLINE_SATURATED		0.80	// a point this close to the roofline counts as saturated
+
+struct Roofline
+{
+	int			threads;
+	double		peakGflops;							// compute ceiling for this many threads
+	const char *peakSimd;							// ... from this probe variant
+	long long	cacheBytes[ROOFLINE_NUMLEVELS-1];	// L1, L2 (per core) and L3 (shared) sizes
+	double		gbPerSec[ROOFLINE_NUMLEVELS];		// sustained triad bandwidth per level
+};
+
+static const char *RooflineLevelNames[ROOFLINE_NUMLEVELS] = { "L1", "L2", "L3", "DRAM" };
+
+
+// ask the OS for the data cache sizes, with typical defaults if it won't tell:
+inline void
+CacheSizes( long long bytes[ROOFLINE_NUMLEVELS-1] )
+{
+	long long defaults[ROOFLINE_NUMLEVELS-1] = { 32*1024, 1024*1024, 32*1024*1024 };
+	long long sizes[ROOFLINE_NUMLEVELS-1] = { 0, 0, 0 };
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+	sizes[0] = sysconf( _SC_LEVEL1_DCACHE_SIZE );
+	sizes[1] = sysconf( _SC_LEVEL2_CACHE_SIZE );
+	sizes[2] = sysconf( _SC_LEVEL3_CACHE_SIZE );
+#endif
+	for( int l = 0; l < ROOFLINE_NUMLEVELS-1; l++ )
+		bytes[l] = sizes[l] > 0 ? sizes[l] : defaults[l];
+}
+
+// which level does a working set of this many bytes live in, with numThreads cores sharing it?
+inline int
+RooflineLevel( const Roofline &roof, double workingSet )
+{
+	if( workingSet <= (double)roof.threads * roof.cacheBytes[0] )
+		return 0;
+	if( workingSet <= (double)roof.threads * roof.cacheBytes[1] )
+		return 1;
+	if( workingSet <= (double)roof.cacheBytes[2] )
+		return 2;
+	return 3;
+}
+
+#if defined(__GNUC__) && ! defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize( "O3" )
+#endif
+
+// the triad probe -- returns GB/s for arrays of n floats:
+inline double
+TriadBandwidth( long long n, const TimingConfig &timing )
+{
+	float *a = new float [n];
+	float *b = new float [n];
+	float *c = new float [n];
+
+	// first touch with the same partitioning the probe uses:
+	#pragma omp parallel for schedule(static)
+	for( long long i = 0; i < n; i++ )
+	{
+		a[i] = 0.;
+		b[i] = 1.;
+		c[i] = 2.;
+	}
+
+	// small (in-cache) sets are swept several times per parallel region so that
+	// the fork/join overhead doesn't hide the bandwidth:
+	const float s = 3.f;
+	long long reps = std::max( 1LL, ( 1LL << 20 ) / n );
+	TimingStats st = TimeKernel( [&]( )
+	{
+		#pragma omp parallel
+		for( long long r = 0; r < reps; r++ )
+		{
+			#pragma omp for schedule(static) nowait
+			for( long long i = 0; i < n; i++ )
+				a[i] = b[i] + s*c[i];
+		}
+	}, timing );
+
+	delete [ ] a;
+	delete [ ] b;
+	delete [ ] c;
+
+	// STREAM counts two loads and one store per element:
+	return 12. * (double)n * (double)reps / st.min / 1.e9;
+}
+
+// the compute probe: independent multiply-adds that never leave the registers, ROOFLINE_CHAINS
+// vectors' worth of them so the adds' latency is hidden on every width:
+#define ROOFLINE_CHAINS		10
+#define ROOFLINE_ITERS		4096
+
+template< int LANES >
+__attribute__(( always_inline )) inline float
+PeakMulAdd( int thread )
+{
+	float acc[LANES];
+	for( int j = 0; j < LANES; j++ )
+		acc[j] = (float)( j + thread );
+	for( int it = 0; it < ROOFLINE_ITERS; it++ )
+	{
+		#pragma omp simd
+		for( int j = 0; j < LANES; j++ )
+			acc[j] = acc[j] * 0.999f + 0.001f;
+	}
+	float sum = 0.;
+	for( int j = 0; j < LANES; j++ )
+		sum += acc[j];
+	return sum;
+}
+
+// the same with a fused multiply-add (still 2 flops each) -- only for callers built with FMA:
+template< int LANES >
+__attribute__(( always_inline )) inline float
+PeakFma( int thread )
+{
+	float acc[LANES];
+	for( int j = 0; j < LANES; j++ )
+		acc[j] = (float)( j + thread );
+	for( int it = 0; it < ROOFLINE_ITERS; it++ )
+	{
+		#pragma omp simd
+		for( int j = 0; j < LANES; j++ )
+			acc[j] = fmaf( acc[j], 0.999f, 0.001f );
+	}
+	float sum = 0.;
+	for( int j = 0; j < LANES; j++ )
+		sum += acc[j];
+	return sum;
+}
+
+struct PeakProbe
+{
+	const char *	name;
+	int				lanes;
+	float			(*run)( int thread );		// one thread's ROOFLINE_ITERS sweeps
+};
+
+inline float	PeakSse( int thread )		{ return PeakMulAdd< 4*ROOFLINE_CHAINS >( thread ); }
+#if ROOFLINE_AVX_VARIANTS
+__attribute__(( target( "avx2,fma" ) )) inline float	PeakAvx2( int thread )		{ return PeakFma< 8*ROOFLINE_CHAINS >( thread ); }
+__attribute__(( target( "avx512f" ) ))  inline float	PeakAvx512( int thread )	{ return PeakFma< 16*ROOFLINE_CHAINS >( thread ); }
+#endif
+
+// the probe variants this CPU can run, narrowest first:
+inline std::vector<PeakProbe>
+PeakProbes( )
+{
+	std::vector<PeakProbe> probes;
+	probes.push_back( { "sse", 4*ROOFLINE_CHAINS, PeakSse } );
+#if ROOFLINE_AVX_VARIANTS
+	const CpuFeatures &cpu = GetCpuFeatures( );
+	if( cpu.avx2 && cpu.fma )
+		probes.push_back( { "avx2 fma", 8*ROOFLINE_CHAINS, PeakAvx2 } );
+	if( cpu.avx512f )
+		probes.push_back( { "avx512 fma", 16*ROOFLINE_CHAINS, PeakAvx512 } );
+#endif
+	return probes;
+}
+
+// GFLOP/s of one probe variant on the current thread count:
+inline double
+PeakGflops( const PeakProbe &probe, const TimingConfig &timing )
+{
+	float sink = 0.;
+	TimingStats st = TimeKernel( [&]( )
+	{
+		#pragma omp parallel reduction(+:sink)
+		sink += probe.run( omp_get_thread_num( ) );
+	}, timing );
+
+	if( sink == -1.f )			// keep the work from being optimized away
+		fprintf( stderr, "?" );
+
+	int numThreads = omp_get_max_threads( );
+	return 2. * probe.lanes * ROOFLINE_ITERS * (double)numThreads / st.min / 1.e9;
+}
+
+// the compute ceiling: the best of the variants this CPU can run:
+inline double
+PeakGflops( const TimingConfig &timing, const char **which )
+{
+	double best = 0.;
+	for( const PeakProbe &probe : PeakProbes( ) )
+	{
+		double gflops = PeakGflops( probe, timing );
+		if( gflops > best )
+		{
+			best = gflops;
+			*which = probe.name;
+		}
+	}
+	return best;
+}
+
+#if defined(__GNUC__) && ! defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+// measure both ceilings for the current omp_set_num_threads( ) setting:
+inline Roofline
+MeasureRoofline( const TimingConfig &timing )
+{
+	Roofline roof;
+	roof.threads = omp_get_max_threads( );
+	CacheSizes( roof.cacheBytes );
+	roof.peakGflops = PeakGflops( timing, &roof.peakSimd );
+
+	// three arrays filling half of each level (private levels scale with the thread count),
+	// and main memory at 4x the L3:
+	double sets[ROOFLINE_NUMLEVELS] =
+	{
+		0.5 * roof.threads * roof.cacheBytes[0],
+		0.5 * roof.threads * roof.cacheBytes[1],
+		0.5 * roof.cacheBytes[2],
+		std::max( 4. * roof.cacheBytes[2], 64.*1024.*1024. )
+	};
+	for( int l = 0; l < ROOFLINE_NUMLEVELS; l++ )
+		roof.gbPerSec[l] = TriadBandwidth( (long long)( sets[l] / 12. ), timing );
+
+	return roof;
+}
+
+inline void
+PrintRoofline( FILE *fp, const Roofline &roof )
+{
+	fprintf( fp, "Roofline for %2d threads: peak %8.2lf GFLOP/s (%s)", roof.threads, roof.peakGflops, roof.peakSimd );
+	for( int l = 0; l < ROOFLINE_NUMLEVELS; l++ )
+		fprintf( fp, "   %-4s %8.2lf GB/s", RooflineLevelNames[l], roof.gbPerSec[l] );
+	fprintf( fp, "\n" );
+}
+
+// place one measured kernel against the roofline for its thread count ("here") and for the
+// largest thread count in the sweep ("widest"):
+inline void
+PrintRooflinePoint( FILE *fp, const char *label, double flopsPerCall, double bytesPerCall, double workingSet,
+					double secondsPerCall, const Roofline &here, const Roofline &widest )
+{
+	double intensity  = flopsPerCall / bytesPerCall;
+	double measured   = flopsPerCall / secondsPerCall / 1.e9;
+	int level         = RooflineLevel( here, workingSet );
+	double memRoof    = intensity * here.gbPerSec[level];
+	double attainable = std::min( here.peakGflops, memRoof );
+	double widestRoof = std::min( widest.peakGflops, intensity * widest.gbPerSec[RooflineLevel( widest, workingSet )] );
+
+	const char *bound = memRoof < here.peakGflops ? "memory-bound" : "compute-bound";
+	const char *verdict;
+	if( measured >= ROOFLINE_SATURATED * widestRoof )
+		verdict = "saturated -- more threads won't help";
+	else if( widest.threads > here.threads )
+		verdict = "headroom -- more threads can help";
+	else
+		verdict = "below the roofline -- look at the kernel";
+
+	fprintf( fp, "%-24s AI %6.3lf flop/B  data in %-4s  %8.3lf GFLOP/s of %8.3lf attainable (%5.1lf%%, %s)  %5.1lf%% of the %d-thread roof: %s\n",
+		label, intensity, RooflineLevelNames[level], measured, attainable, 100.*measured/attainable, bound,
+		100.*measured/widestRoof, widest.threads, verdict );
+}
+
+#endif		// COMMON_ROOFLINE_H
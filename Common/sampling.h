@@ -0,0 +1,338 @@
+/*
+ *
+ * Sampling strategies for the Monte Carlo code: where trial n's uniform inputs come from.
+ *
+ * Plain random sampling converges as 1/sqrt(N). The other strategies spread the points more
+ * evenly over the input box, so the same number of trials gives a smaller variance:
+ *
+ *		random		independent Philox uniforms (rng.h), the reference
+ *		antithetic	trials 2m and 2m+1 use u and 1-u: paired errors cancel when the result is
+ *					monotone-ish in the inputs
+ *		stratified	the box is cut into k^DIMS equal cells (k = floor(N^(1/DIMS))) and every cell gets
+ *					one jittered point per k^DIMS trials; trials past the last full set are random
+ *		sobol		the Sobol' sequence, Owen-scrambled per dimension (hash-based nested uniform
+ *					scramble, Burley 2020), so each point is uniform and runs with different
+ *					seeds are independent
+ *		halton		the Halton sequence (bases 2,3,5,7,11) with a random shift of every digit
+ *
+ * Every strategy computes trial n's point from ( seed, n ) alone, the same way rng.h does, so
+ * they are safe to call from any thread in any order, and every one is unbiased -- the variance
+ * across seeds is the honest error bar (there is no within-run variance for the QMC ones).
+ *
+ * Sobol' points are indexed with 32 bits, so a sobol run takes at most SOBOL_MAX_TRIALS trials
+ * (MaxSamplingTrials( )); the caller has to refuse more.
+ *
+ *		Sampler s = MakeSampler( SAMPLING_SOBOL, seed, numTrials );
+ *		float u[SAMPLING_DIMS];
+ *		SampleUniforms( s, n, u );
+ *
+ */
+
+#ifndef COMMON_SAMPLING_H
+#define COMMON_SAMPLING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "rng.h"
+
+#define SAMPLING_DIMS		5			// uniforms per trial
+#define SOBOL_BITS			32
+#define SOBOL_MAX_TRIALS	( 1LL << SOBOL_BITS )		// the points of a 32-bit index -- past that they repeat
+#define HALTON_DIGITS		25			// base 2 needs 25 digits to get below float resolution
+
+#define ONE_MINUS_ULP		0.99999994f	// the largest float below 1
+
+enum SamplingMode { SAMPLING_RANDOM, SAMPLING_ANTITHETIC, SAMPLING_STRATIFIED, SAMPLING_SOBOL, SAMPLING_HALTON };
+#define NUM_SAMPLING_MODES	5
+
+struct Sampler
+{
+	SamplingMode	mode;
+	uint64_t		seed;
+	int				strata;						// stratified: cells per dimension ...
+	long long		cells;						// ... strata^DIMS of them ...
+	long long		stratified;					// ... covering trials 0 .. stratified-1
+	uint32_t		scramble[SAMPLING_DIMS];	// sobol: per-dimension scramble seeds
+	uint8_t			shift[SAMPLING_DIMS][HALTON_DIGITS];	// halton: per-digit shifts
+	const struct SobolTable *	sobol;
+};
+
+
+inline const char *
+SamplingName( SamplingMode m )
+{
+	static const char *names[NUM_SAMPLING_MODES] = { "random", "antithetic", "stratified", "sobol", "halton" };
+	return names[m];
+}
+
+inline bool
+SetSampling( const char *name, SamplingMode &m )
+{
+	for( int k = 0; k < NUM_SAMPLING_MODES; k++ )
+	{
+		if( strcmp( name, SamplingName( (SamplingMode)k ) ) == 0 )
+		{
+			m = (SamplingMode)k;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// ---- Sobol' ----
+
+// new-joe-kuo-6.21201 parameters for dimensions 2..5 (dimension 1 is van der Corput):
+const int		SOBOL_S[SAMPLING_DIMS]    = { 0, 1, 2, 3, 3 };
+const int		SOBOL_A[SAMPLING_DIMS]    = { 0, 0, 1, 1, 2 };
+const uint32_t	SOBOL_M[SAMPLING_DIMS][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 }, { 1, 1, 1 } };
+
+struct SobolTable
+{
+	uint32_t	v[SAMPLING_DIMS][SOBOL_BITS];	// direction numbers
+};
+
+inline SobolTable
+BuildSobolTable( )
+{
+	SobolTable table;
+	for( int d = 0; d < SAMPLING_DIMS; d++ )
+	{
+		uint32_t *v = table.v[d];
+		if( d == 0 )
+		{
+			for( int i = 0; i < SOBOL_BITS; i++ )
+				v[i] = 1u << ( 31-i );
+			continue;
+		}
+		int s = SOBOL_S[d];
+		for( int i = 0; i < s; i++ )
+			v[i] = SOBOL_M[d][i] << ( 31-i );
+		for( int i = s; i < SOBOL_BITS; i++ )
+		{
+			v[i] = v[i-s] ^ ( v[i-s] >> s );
+			for( int k = 1; k < s; k++ )
+				v[i] ^= ( ( SOBOL_A[d] >> ( s-1-k ) ) & 1 ) * v[i-k];
+		}
+	}
+	return table;
+}
+
+inline const SobolTable &
+GetSobolTable( )
+{
+	static const SobolTable table = BuildSobolTable( );
+	return table;
+}
+
+// the unscrambled 32-bit Sobol' coordinate d of point n:
+inline uint32_t
+SobolBits( const SobolTable &t, uint32_t n, int d )
+{
+	uint32_t x = 0;
+	for( int i = 0; n != 0; i++, n >>= 1 )
+		x ^= t.v[d][i] & ( 0u - ( n & 1 ) );		// (no branch on the bits of n)
+	return x;
+}
+
+// all SAMPLING_DIMS coordinates of point n in one pass over its bits:
+inline void
+SobolPoint( const SobolTable &t, uint32_t n, uint32_t x[SAMPLING_DIMS] )
+{
+	for( int d = 0; d < SAMPLING_DIMS; d++ )
+		x[d] = 0;
+	for( int i = 0; n != 0; i++, n >>= 1 )
+	{
+		uint32_t mask = 0u - ( n & 1 );
+		for( int d = 0; d < SAMPLING_DIMS; d++ )
+			x[d] ^= t.v[d][i] & mask;
+	}
+}
+
+inline uint32_t
+ReverseBits( uint32_t x )
+{
+	x = ( ( x >> 1 ) & 0x55555555u ) | ( ( x & 0x55555555u ) << 1 );
+	x = ( ( x >> 2 ) & 0x33333333u ) | ( ( x & 0x33333333u ) << 2 );
+	x = ( ( x >> 4 ) & 0x0f0f0f0fu ) | ( ( x & 0x0f0f0f0fu ) << 4 );
+	x = ( ( x >> 8 ) & 0x00ff00ffu ) | ( ( x & 0x00ff00ffu ) << 8 );
+	return ( x >> 16 ) | ( x << 16 );
+}
+
+// Owen scrambling: every bit is flipped by a hash of the bits above it (Laine-Karras hash on the
+// bit-reversed value), which keeps the sequence's stratification:
+inline uint32_t
+OwenScramble( uint32_t x, uint32_t seed )
+{
+	x = ReverseBits( x );
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return ReverseBits( x );
+}
+
+
+// ---- Halton ----
+
+const uint32_t	HALTON_BASES[SAMPLING_DIMS] = { 2, 3, 5, 7, 11 };
+
+inline uint32_t
+HashWord( uint32_t x )
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// the radical inverse of n in base B, with digit k shifted by shift[k] mod B -- the shift also
+// applies to the leading zeros, down to below float resolution (B is a template argument so the
+// divisions become multiplies):
+template< uint32_t B >
+inline float
+ScrambledRadicalInverse( uint64_t n, const uint8_t shift[HALTON_DIGITS] )
+{
+	double inverse = 0.;
+	double place = 1. / (double)B;
+	for( int k = 0; n != 0 || ( k < HALTON_DIGITS && place > 1./33554432. ); k++ )
+	{
+		uint32_t digit = (uint32_t)( n % B );
+		n /= B;
+		if( k < HALTON_DIGITS )
+			digit = ( digit + shift[k] ) % B;
+		inverse += digit * place;
+		place /= (double)B;
+	}
+	return std::min( (float)inverse, ONE_MINUS_ULP );
+}
+
+// ---- the sampler ----
+
+inline Sampler
+MakeSampler( SamplingMode mode, uint64_t seed, long long numTrials )
+{
+	Sampler s;
+	s.mode   = mode;
+	s.seed   = seed;
+	s.strata = 1;
+	s.cells  = 1;
+	s.stratified = 0;
+	if( mode == SAMPLING_STRATIFIED && numTrials > 0 )
+	{
+		s.strata = std::max( 1, (int) floor( pow( (double)numTrials, 1. / SAMPLING_DIMS ) + 1.e-9 ) );
+		for( int d = 0; d < SAMPLING_DIMS; d++ )
+			s.cells *= s.strata;
+		s.stratified = ( numTrials / s.cells ) * s.cells;
+	}
+
+	// per-dimension scramble seeds from the run's seed (counter block 1, so they don't repeat
+	// trial 0's random numbers):
+	uint32_t counter[4] = { 0, 0, 1, 0 };
+	uint32_t key[2]     = { (uint32_t)seed, (uint32_t)( seed >> 32 ) };
+	for( int d = 0; d < SAMPLING_DIMS; d++ )
+	{
+		uint32_t bits[4];
+		counter[0] = (uint32_t)d;
+		Philox4x32( counter, key, bits );
+		s.scramble[d] = bits[0];
+		for( int k = 0; k < HALTON_DIGITS; k++ )
+			s.shift[d][k] = (uint8_t)( HashWord( bits[1] + k * PHILOX_W0 ) % HALTON_BASES[d] );
+	}
+	s.sobol = &GetSobolTable( );
+	return s;
+}
+
+// the most trials a run in this mode can take before its points repeat (-1: no limit):
+inline long long
+MaxSamplingTrials( SamplingMode mode )
+{
+	return mode == SAMPLING_SOBOL ? SOBOL_MAX_TRIALS : -1;
+}
+
+// the SAMPLING_DIMS uniforms in [0,1) for trial n:
+inline void
+SampleUniforms( const Sampler &s, long long n, float u[SAMPLING_DIMS] )
+{
+	switch( s.mode )
+	{
+		default:
+		case SAMPLING_RANDOM:
+			PhiloxFiveUniforms( s.seed, (uint64_t)n, u );
+			break;
+
+		case SAMPLING_ANTITHETIC:
+			PhiloxFiveUniforms( s.seed, (uint64_t)( n/2 ), u );
+			if( n & 1 )
+			{
+				for( int d = 0; d < SAMPLING_DIMS; d++ )
+					u[d] = ( ONE_MINUS_ULP - u[d] ) + 0.f;		// exact: u is a multiple of 2^-24
+			}
+			break;
+
+		case SAMPLING_STRATIFIED:
+			PhiloxFiveUniforms( s.seed, (uint64_t)n, u );
+			if( n < s.stratified )
+			{
+				long long cell = n % s.cells;
+				for( int d = 0; d < SAMPLING_DIMS; d++ )
+				{
+					int stratum = (int)( cell % s.strata );
+					cell /= s.strata;
+					u[d] = std::min( (float)( ( stratum + (double)u[d] ) / s.strata ), ONE_MINUS_ULP );
+				}
+			}
+			break;
+
+		case SAMPLING_SOBOL:
+		{
+			uint32_t x[SAMPLING_DIMS];
+			SobolPoint( *s.sobol, (uint32_t)n, x );
+			for( int d = 0; d < SAMPLING_DIMS; d++ )
+				u[d] = UniformFloat( OwenScramble( x[d], s.scramble[d] ) );
+			break;
+		}
+
+		case SAMPLING_HALTON:
+			u[0] = ScrambledRadicalInverse<2>( (uint64_t)n, s.shift[0] );
+			u[1] = ScrambledRadicalInverse<3>( (uint64_t)n, s.shift[1] );
+			u[2] = ScrambledRadicalInverse<5>( (uint64_t)n, s.shift[2] );
+			u[3] = ScrambledRadicalInverse<7>( (uint64_t)n, s.shift[3] );
+			u[4] = ScrambledRadicalInverse<11>( (uint64_t)n, s.shift[4] );
+			break;
+	}
+}
+
+// every 1-D projection of the first 2^10 Sobol' points has one point per 1/1024 interval, and
+// the first few points of dimension 2 are 0, 1/2, 3/4, 1/4, 5/8 (natural order, not Gray code):
+inline bool
+SobolSelfTest( )
+{
+	const SobolTable &t = GetSobolTable( );
+	const uint32_t first[5] = { 0u, 0x80000000u, 0xc0000000u, 0x40000000u, 0xa0000000u };
+	for( int n = 0; n < 5; n++ )
+	{
+		if( SobolBits( t, n, 1 ) != first[n] )
+			return false;
+	}
+	for( int d = 0; d < SAMPLING_DIMS; d++ )
+	{
+		bool seen[1024] = { false };
+		for( uint32_t n = 0; n < 1024; n++ )
+		{
+			uint32_t bin = SobolBits( t, n, d ) >> 22;
+			if( seen[bin] )
+				return false;
+			seen[bin] = true;
+		}
+	}
+	return true;
+}
+
+#endif		// COMMON_SAMPLING_H
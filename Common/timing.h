@@ -0,0 +1,227 @@
+/*
+ *
+ * Common timing harness shared by the project binaries.
+ *
+ * Replaces the "keep the max of NUMTRIES runs" loops: a kernel is called a few times untimed to
+ * warm up, then sampled until the 95% confidence interval of the mean is within a target fraction
+ * of the mean (or a sample cap is hit). When one call is too short for omp_get_wtime( ) to
+ * resolve, several calls are batched into each sample and the result is flagged.
+ *
+ *		TimingStats st = TimeKernel( [&]( ) { NonSimdMul( A, B, C, n ); }, TimingFromArgs( argc, argv, NUMTRIES ) );
+ *		double peak = (double)n / st.min;		// same figure the old loops reported
+ *
+ * Command-line knobs (all optional):
+ *		--warmup N		untimed calls before sampling			(default 2)
+ *		--ci F			target relative 95% CI half-width		(default 0.01)
+ *		--max-samples N	stop sampling here even if the CI is wider	(default 20 x tries)
+ *		--stats			print the full distribution for every measurement
+ *
+ */
+
+#ifndef COMMON_TIMING_H
+#define COMMON_TIMING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include <vector>
+#include <algorithm>
+
+#include "driver.h"
+
+
+// a sample shorter than this many timer ticks is considered dominated by the timer resolution:
+#define TIMER_TICKS_PER_SAMPLE		100
+
+struct TimingConfig
+{
+	int		warmups;		// untimed calls before sampling starts
+	int		minSamples;		// always take at least this many samples
+	int		maxSamples;		// give up on the CI target after this many
+	double	targetCI;		// wanted 95% CI half-width as a fraction of the mean
+	bool	printStats;		// print the full distribution?
+};
+
+struct TimingStats
+{
+	int		samples;		// number of timed samples
+	int		repsPerSample;	// kernel calls batched into each sample
+	double	resolution;		// timer resolution in seconds
+	bool	belowResolution;// a single call is too short to time on its own
+	bool	converged;		// the CI target was reached
+	double	min;			// all of these are seconds per kernel call
+	double	max;
+	double	mean;
+	double	median;
+	double	p95;
+	double	p99;
+	double	stddev;
+	double	ciHalfWidth;	// 95% confidence half-width of the mean
+	std::vector<double>	times;	// seconds per call, one entry per sample
+};
+
+
+inline TimingConfig
+TimingFromArgs( int argc, char *argv[ ], int numTries )
+{
+	if( numTries < 1 )
+	{
+		fprintf( stderr, "Need at least one try, got %d\n", numTries );
+		exit( 1 );
+	}
+
+	TimingConfig config;
+	config.warmups    = (int) ArgInt( argc, argv, "--warmup", 2 );
+	config.minSamples = numTries;
+	config.maxSamples = (int) ArgInt( argc, argv, "--max-samples", 20*numTries );
+	config.targetCI   = ArgDouble( argc, argv, "--ci", 0.01 );
+	config.printStats = ArgFlag( argc, argv, "--stats" );
+	if( config.maxSamples < config.minSamples )
+		config.maxSamples = config.minSamples;
+	return config;
+}
+
+// the smallest non-zero step omp_get_wtime( ) actually takes on this machine:
+inline double
+TimerResolution( )
+{
+	static double resolution = 0.;
+	if( resolution > 0. )
+		return resolution;
+
+	double smallest = 1.;
+	for( int i = 0; i < 100; i++ )
+	{
+		double t0 = omp_get_wtime( );
+		double t1;
+		do
+		{
+			t1 = omp_get_wtime( );
+		} while( t1 == t0 );
+		if( t1 - t0 < smallest )
+			smallest = t1 - t0;
+	}
+
+	resolution = std::max( smallest, omp_get_wtick( ) );
+	return resolution;
+}
+
+// nearest-rank percentile of an already sorted list:
+inline double
+Percentile( const std::vector<double> &sorted, double p )
+{
+	int k = (int) ceil( p * (double)sorted.size( ) ) - 1;
+	if( k < 0 )
+		k = 0;
+	if( k >= (int)sorted.size( ) )
+		k = (int)sorted.size( ) - 1;
+	return sorted[k];
+}
+
+// fill in the statistics for a list of per-call times (all zeros if there are none):
+inline TimingStats
+Summarize( const std::vector<double> &times, int repsPerSample )
+{
+	TimingStats st;
+	st.times = times;
+	st.samples = (int)times.size( );
+	st.repsPerSample = repsPerSample;
+	st.resolution = TimerResolution( );
+	st.belowResolution = false;
+	st.converged = false;
+	if( times.empty( ) )
+	{
+		st.min = st.max = st.mean = st.median = st.p95 = st.p99 = st.stddev = st.ciHalfWidth = 0.;
+		return st;
+	}
+
+	std::vector<double> sorted = times;
+	std::sort( sorted.begin( ), sorted.end( ) );
+
+	double sum = 0.;
+	for( double t : times )
+		sum += t;
+	st.mean = sum / (double)st.samples;
+
+	double sumsq = 0.;
+	for( double t : times )
+		sumsq += ( t - st.mean ) * ( t - st.mean );
+	st.stddev = st.samples > 1 ? sqrt( sumsq / (double)( st.samples - 1 ) ) : 0.;
+
+	st.min    = sorted.front( );
+	st.max    = sorted.back( );
+	st.median = Percentile( sorted, 0.50 );
+	st.p95    = Percentile( sorted, 0.95 );
+	st.p99    = Percentile( sorted, 0.99 );
+	st.ciHalfWidth = 1.96 * st.stddev / sqrt( (double)st.samples );
+	return st;
+}
+
+// time a kernel -- call it as kernel( ):
+template< class KERNEL >
+TimingStats
+TimeKernel( KERNEL kernel, const TimingConfig &config )
+{
+	for( int i = 0; i < config.warmups; i++ )
+		kernel( );
+
+	// how long does one call take compared with the timer resolution?
+	double resolution = TimerResolution( );
+	double t0 = omp_get_wtime( );
+	kernel( );
+	double single = omp_get_wtime( ) - t0;
+
+	int reps = 1;
+	bool belowResolution = single < TIMER_TICKS_PER_SAMPLE * resolution;
+	if( belowResolution )
+	{
+		// batch calls so that one sample spans enough ticks:
+		while( reps < ( 1 << 24 ) && reps * std::max( single, resolution ) < TIMER_TICKS_PER_SAMPLE * resolution )
+			reps *= 2;
+	}
+
+	// a probe that needed no batching is a sample like any other (for very long kernels,
+	// e.g. a single-pass run of 10^10 trials, it may be the only one):
+	std::vector<double> times;
+	if( ! belowResolution )
+		times.push_back( single );
+	int wanted = config.minSamples;
+	TimingStats st;
+	while( true )
+	{
+		while( (int)times.size( ) < wanted )
+		{
+			double time0 = omp_get_wtime( );
+			for( int r = 0; r < reps; r++ )
+				kernel( );
+			double time1 = omp_get_wtime( );
+			times.push_back( ( time1 - time0 ) / (double)reps );
+		}
+
+		st = Summarize( times, reps );
+		st.converged = st.ciHalfWidth <= config.targetCI * st.mean;
+		if( st.converged || wanted >= config.maxSamples )
+			break;
+
+		// not tight enough yet -- take twice as many samples:
+		wanted = std::min( 2*wanted, config.maxSamples );
+	}
+
+	st.belowResolution = belowResolution;
+	return st;
+}
+
+// print one measurement's distribution, with "work" units done per call (e.g. the array size):
+inline void
+PrintTimingStats( FILE *fp, const char *label, const TimingStats &st, double work )
+{
+	fprintf( fp, "%-24s %5d samples x %-6d min %10.3lf us  median %10.3lf us  p95 %10.3lf us  p99 %10.3lf us  "
+		"stddev %8.3lf us  (+/- %5.2lf%% @95%%)  peak %10.2lf M/s  median %10.2lf M/s%s%s\n",
+		label, st.samples, st.repsPerSample, 1.e6*st.min, 1.e6*st.median, 1.e6*st.p95, 1.e6*st.p99,
+		1.e6*st.stddev, 100.*st.ciHalfWidth/st.mean, work/st.min/1000000., work/st.median/1000000.,
+		st.converged       ? "" : "  [CI target not reached]",
+		st.belowResolution ? "  [below timer resolution, calls batched]" : "" );
+}
+
+#endif		// COMMON_TIMING_H
@@ -1,10 +1,7 @@
 #!/bin/bash
 
-#number of threads:
-for t in 1 4
-do
-    echo NUMT = $t
-    g++ -DNUMT=$t Project0.cpp -o Project0  -lm -fopenmp 
-    ./Project0
-    rm ./Project0
-done
+# the thread counts (and array sizes, with --sizes) are runtime arguments,
+# so the whole sweep runs from one build:
+g++ -DBUILD_FLAGS="\"-fopenmp\"" Project0.cpp -o Project0  -lm -fopenmp
+./Project0 --threads 1,4
+rm ./Project0
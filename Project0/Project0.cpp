@@ -3,6 +3,13 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include "../Common/driver.h"
+#include "../Common/timing.h"
+#include "../Common/results.h"
+#include "../Common/perfcounters.h"
+#include "../Common/roofline.h"
+#include "../Common/numa.h"
+
 #ifndef NUMT
 #define NUMT	         1	  // number of threads to use -- do once for 1 and once for 4
 #endif
@@ -11,13 +18,12 @@
 #define SIZE       	    20000 // array size -- you get to decide
 #endif
 
-#define NUMTRIES        20	  // how many times to run the timing to get reliable timing data
+#define NUMTRIES        20	  // minimum number of timing samples (more are taken until the timing is stable)
 
-float A[SIZE];
-float B[SIZE];
-float C[SIZE];
+// run with --threads 1,4 --sizes 20000,1000000 to sweep in one process
+// (NUMT and SIZE above are only the defaults)
 
-int main( )
+int main( int argc, char *argv[ ] )
 {
 
 #ifdef   _OPENMP
@@ -27,33 +33,124 @@ int main( )
     exit( 0 );
 #endif
 
-    // initialize the arrays:
-    for( int i = 0; i < SIZE; i++ )
+    std::vector<long long> threads = ArgList( argc, argv, "--threads", { NUMT } );
+    std::vector<long long> sizes   = ArgList( argc, argv, "--sizes",   { SIZE } );
+    for( long long size : sizes )
     {
-        A[i] = 1.;
-        B[i] = 2.;
+        if( size > 0x7fffffff )
+        {
+            fprintf( stderr, "At most %d elements, got %lld\n", 0x7fffffff, size );
+            return 1;
+        }
     }
+    int numTries = (int) ArgInt( argc, argv, "--tries", NUMTRIES );
+    TimingConfig timing = TimingFromArgs( argc, argv, numTries );
+    OpenResults( argc, argv );
+    bool usePerf = ArgFlag( argc, argv, "--perf" );     // hardware counters too?
+    bool placement = ArgFlag( argc, argv, "--placement" );  // report which NUMA node the pages are on?
 
-    omp_set_num_threads( NUMT );
-    double maxMegaMults = 0.;
+    // bind each OpenMP thread to its own cpu (thread t stays on the same cpu for every team size):
+    if( ArgFlag( argc, argv, "--pin" ) )
+        PinThreads( (int) *std::max_element( threads.begin( ), threads.end( ) ), stderr );
 
-    for( int t = 0; t < NUMTRIES; t++ )
+    // roofline mode: measure the ceilings for every thread count up front:
+    std::vector<Roofline> roofs;
+    int widest = 0;
+    if( ArgFlag( argc, argv, "--roofline" ) )
     {
-        double time0 = omp_get_wtime( );
-
-#pragma omp parallel for
-        for( int i = 0; i < SIZE; i++ )
+        for( size_t k = 0; k < threads.size( ); k++ )
         {
-            C[i] = A[i] * B[i];
+            omp_set_num_threads( (int)threads[k] );
+            roofs.push_back( MeasureRoofline( timing ) );
+            PrintRoofline( stderr, roofs.back( ) );
+            if( threads[k] > threads[widest] )
+                widest = (int)k;
         }
-
-        double time1 = omp_get_wtime( );
-        double megaMults = (double)SIZE/(time1-time0)/1000000.;
-        if( megaMults > maxMegaMults )
-            maxMegaMults = megaMults;
     }
 
-    fprintf( stderr, "For %d threads, Peak Performance = %8.2lf MegaMults/Sec\n", NUMT, maxMegaMults );
+    for( long long size : sizes )
+    {
+        int n = (int)size;
+
+        for( size_t k = 0; k < threads.size( ); k++ )
+        {
+            long long numt = threads[k];
+            omp_set_num_threads( (int)numt );
+
+            // the arrays are first touched by the same threads, with the same static partitioning,
+            // as the multiply below, so each thread's pages are on its own NUMA node:
+            float *A = FirstTouchFloats( n, (int)numt, [ ]( long long ) { return 1.f; } );
+            float *B = FirstTouchFloats( n, (int)numt, [ ]( long long ) { return 2.f; } );
+            float *C = FirstTouchFloats( n, (int)numt, [ ]( long long ) { return 0.f; } );
+
+            auto multiply = [&]( )
+            {
+#pragma omp parallel for schedule(static)
+                for( int i = 0; i < n; i++ )
+                {
+                    C[i] = A[i] * B[i];
+                }
+            };
+            TimingStats st = TimeKernel( multiply, timing );
+
+            // 12 bytes move per element (load A[i] and B[i], store C[i]):
+            PerfCounters pc;
+            PerfCounts counts = { 0., 0., 0., 0. };
+            if( usePerf && PerfOpen( pc, (int)numt ) )
+                counts = PerfMeasure( pc, multiply, 10*st.repsPerSample );
+            else
+                usePerf = false;
+
+            double maxMegaMults = (double)n/st.min/1000000.;
+            double medMegaMults = (double)n/st.median/1000000.;
+
+            fprintf( stderr, "For %d threads and %d elements, Peak Performance = %8.2lf MegaMults/Sec (median %8.2lf)\n", (int)numt, n, maxMegaMults, medMegaMults );
+            if( timing.printStats )
+                PrintTimingStats( stderr, "    C = A * B", st, (double)n );
+            if( pc.open )
+                PrintPerfCounts( stderr, "    C = A * B", counts, 12.*n, (double)n );
+            if( placement )
+                PrintPlacement( stderr, "    A pages", A, n, (int)numt );
+
+            // one multiply per 12 bytes moved, and all 12*n bytes are the working set:
+            if( ! roofs.empty( ) )
+                PrintRooflinePoint( stderr, "    C = A * B", (double)n, 12.*n, 12.*n, st.min, roofs[k], roofs[widest] );
+
+            // check the product, then write the structured record:
+            int numWrong = 0;
+            for( int i = 0; i < n; i++ )
+            {
+                if( C[i] != A[i] * B[i] )
+                    numWrong++;
+            }
+
+            Result r;
+            r.benchmark = "Project0";
+            r.kernel    = "C = A * B";
+            r.threads   = (int)numt;
+            r.size      = n;
+            r.unit      = "elements";
+            r.rate      = maxMegaMults;
+            r.rateUnit  = "MegaMults/Sec";
+            r.timing    = st;
+            r.checked   = true;
+            r.passed    = numWrong == 0;
+            r.check     = "C[i] == A[i]*B[i] for all i, " + std::to_string( numWrong ) + " wrong";
+            if( pc.open )
+            {
+                r.extra.push_back( { "ipc", counts.Ipc( ) } );
+                r.extra.push_back( { "bytes_per_cycle", counts.BytesPerCycle( 12.*n ) } );
+                r.extra.push_back( { "llc_misses_per_elem", counts.llcMisses / (double)n } );
+            }
+            EmitResult( r );
+            PerfClose( pc );
+
+            free( A );
+            free( B );
+            free( C );
+        }
+    }
+    CloseResults( );
 
     // note: %lf (ell-eff) stands for "long float", which is how printf prints a "double"
     //        %d stands for "decimal integer", not "double"
@@ -1,8 +1,4 @@
-for t in 1 4
-do
-    echo "NUMT = $t"
-    cmake -S . -B build -DNUMT=$t
-    cmake --build build
-    ./build/Project0
-    rm -rf build
-done
\ No newline at end of file
+cmake -S . -B build
+cmake --build build
+./build/Project0 --threads 1,4
+rm -rf build
\ No newline at end of file
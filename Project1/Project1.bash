@@ -1,13 +1,7 @@
 #!/bin/bash
 
-#number of threads:
-for t in 1 2 4 6 8
-do
-    for n in 1 10 100 1000 10000 100000 500000
-    do
-      # echo NUMT = $t
-      g++ -DNUMT=$t -DNUMTRIALS=$n Project1.cpp -o Project1  -lm -fopenmp
-      ./Project1
-      rm ./Project1
-    done
-done
+# thread counts and trial counts are runtime arguments, so one build runs the whole sweep
+# (one kernel, so there is one csv row a point -- --kernel both adds the SIMD rows and the speedups):
+g++ -O3 -fno-math-errno -fno-trapping-math -DBUILD_FLAGS="\"-O3 -fno-math-errno -fno-trapping-math -fopenmp\"" Project1.cpp -o Project1  -lm -fopenmp
+./Project1 --threads 1,2,4,6,8 --trials 1,10,100,1000,10000,100000,500000 --kernel scalar
+rm ./Project1
@@ -5,6 +5,17 @@
 #include <time.h>
 #include <omp.h>
 
+#include "../Common/driver.h"
+#include "../Common/timing.h"
+#include "../Common/results.h"
+#include "../Common/perfcounters.h"
+#include "../Common/rng.h"
+#include "../Common/sampling.h"
+#include "trajectory.h"
+#include "adaptive.h"
+#include "boxes.h"
+#include "cannon.h"
+
 #ifndef F_PI
 #define F_PI		(float)M_PI
 #endif
@@ -15,22 +26,32 @@
 #endif
 
 // setting the number of threads to use:
-// (this a default value -- it can also be set from the outside by your script)
+// (this a default value -- it can also be set from the outside by your script,
+//  or swept at runtime with --threads 1,2,4)
 #ifndef NUMT
 #define NUMT		2
 #endif
 
 // setting the number of trials in the monte carlo simulation:
-// (this a default value -- it can also be set from the outside by your script)
+// (this a default value -- it can also be set from the outside by your script,
+//  or swept at runtime with --trials 1000,10000)
 #ifndef NUMTRIALS
 #define NUMTRIALS	50000
 #endif
 
-// how many tries to discover the maximum performance:
+// minimum number of timing samples (more are taken until the timing is stable):
 #ifndef NUMTRIES
 #define NUMTRIES	30
 #endif
 
+// --precision mode gives up after this many trials (--max-trials overrides it):
+#ifndef MAXTRIALS
+#define MAXTRIALS	10000000000LL
+#endif
+
+// the hardware counters re-run the simulation; keep that to about this many trials:
+#define PERF_TRIALS	100000000LL
+
 // ranges for the random numbers:
 const float GMIN  =	10.0;	// ground distance in meters
 const float GMAX  =	20.0;	// ground distance in meters
@@ -47,29 +68,17 @@ const float GRAVITY = -9.8;	// acceleraion due to gravity in meters / sec^2
 const float TOL     =  5.0;	// tolerance in cannonball hitting the castle in meters
 							// castle is destroyed if cannonball lands between d-TOL and d+TOL
 
-// Helper function to choose a random number between two given floats
-float
-Ranf( float low, float high )
-{
-	float r = (float) rand();               // 0 - RAND_MAX
-	float t = r  /  (float) RAND_MAX;       // 0. - 1.
-
-	return   low  +  t * ( high - low );
-}
-
-// Helper function to choose a random number between two given integers
-int
-Ranf( int ilow, int ihigh )
-{
-	float low = (float)ilow;
-	float high = ceil( (float)ihigh );
+// the same ranges, in the order the SIMD kernel (trajectory.h) takes them:
+const float RANGES[10] = { VMIN, VMAX, THMIN, THMAX, GMIN, GMAX, HMIN, HMAX, DMIN, DMAX };
 
-	return (int) Ranf(low,high);
-}
+// the random numbers come from a counter-based generator (Philox, ../Common/rng.h): trial n's
+// numbers depend only on the seed and n, so every thread can make its own inside the parallel
+// loop and the hit count for a given seed is the same for any number of threads.
+// --sampling antithetic|stratified|sobol|halton spreads the points more evenly instead
+// (../Common/sampling.h); those run through the scalar loop only.
 
-// call this if you want to force your program to use
-// a different random number sequence every time you run it:
-void
+// a different random number sequence every time you run it, unless --seed is given:
+unsigned int
 TimeOfDaySeed( )
 {
 	time_t now;
@@ -92,7 +101,7 @@ TimeOfDaySeed( )
 
 	double seconds = difftime( now, mktime(&jan01) );
 	unsigned int seed = (unsigned int)( seconds );
-	srand( seed );
+	return seed;
 }
 
 // degrees-to-radians:
@@ -103,147 +112,612 @@ float Radians( float degrees )
 }
 
 
-// main program:
-int
-main( int argc, char *argv[ ] )
+// count the hits in trials first .. first+count-1 on the current number of threads, with the
+// scalar loop (simd == NULL) or a branch-free SIMD kernel from trajectory.h (random sampling only):
+long long
+CountHits( const Sampler &sampler, long long first, long long count, const TrajectoryKernel *simd )
 {
-#ifndef _OPENMP
-	fprintf( stderr, "No OpenMP support!\n" );
-	return 1;
-#endif
-
-	TimeOfDaySeed( );				// seed the random number generator
-
-	omp_set_num_threads( NUMT );	// set the number of threads to use in parallelizing the for-loop:`
+	uint64_t seed = sampler.seed;
+	long long hits = 0;		// a private counter per thread, summed at the end
 
-	// better to define these here so that the rand() calls don't get into the thread timing:
-	float * vs = new float [NUMTRIALS];
-	float *ths = new float [NUMTRIALS];
-	float * gs = new float [NUMTRIALS];
-	float * hs = new float [NUMTRIALS];
-	float * ds = new float [NUMTRIALS];
-
-	// fill the random-value arrays:
-	for( int n = 0; n < NUMTRIALS; n++ )
+	if( simd != NULL )
 	{
-		vs[n]  = Ranf(  VMIN,  VMAX );
-		ths[n] = Ranf( THMIN, THMAX );
- 		gs[n]  = Ranf(  GMIN,  GMAX );
- 		hs[n]  = Ranf(  HMIN,  HMAX );
- 		ds[n]  = Ranf(  DMIN,  DMAX );
+		// blocks of TRIAL_BLOCK trials, each run through the vector kernel:
+		long long numBlocks = ( count + TRIAL_BLOCK-1 ) / TRIAL_BLOCK;
+		#pragma omp parallel for reduction(+:hits) schedule(static)
+		for( long long b = 0; b < numBlocks; b++ )
+		{
+			long long start = first + b * TRIAL_BLOCK;
+			hits += simd->hits( seed, start, std::min( (long long)TRIAL_BLOCK, first+count-start ), RANGES, GRAVITY, TOL );
+		}
+		return hits;
 	}
 
-	// get ready to record the maximum performance and the probability:
-	double maxPerformance = 0.;	// must be declared outside the NUMTRIES loop
-	int numHits;				// must be declared outside the NUMTRIES loop
-
-	// looking for the maximum performance:
-	for( int tries = 0; tries < NUMTRIES; tries++ )
+	#pragma omp parallel for reduction(+:hits)
+	for( long long n = first; n < first+count; n++ )
 	{
-		double time0 = omp_get_wtime( );
-
-		numHits = 0;
-
-		#pragma omp parallel for shared( vs, ths, gs, hs, ds ) reduction(+:numHits)
-		for( int n = 0; n < NUMTRIALS; n++ )
+		// randomize everything:
+		float u[SAMPLING_DIMS];
+		SampleUniforms( sampler, n, u );
+		float v   = Scale( u[0],  VMIN,  VMAX );
+		float thr = Radians( Scale( u[1], THMIN, THMAX ) );
+		float vx  = v * cos(thr);
+		float vy  = v * sin(thr);
+		float  g  = Scale( u[2],  GMIN,  GMAX );
+		float  h  = Scale( u[3],  HMIN,  HMAX );
+		float  d  = Scale( u[4],  DMIN,  DMAX );
+
+		// see if the ball doesn't even reach the cliff:`
+		float t = -vy / (0.5 * GRAVITY);
+		float x = vx * t;
+		if( x <= g )
+		{
+			if( DEBUG )	fprintf( stderr, "Ball doesn't even reach the cliff\n" );
+		}
+		else
 		{
-			// randomize everything:
-			float v   = vs[n];
-			float thr = Radians( ths[n] );
-			float vx  = v * cos(thr);
-			float vy  = v * sin(thr);
-			float  g  = gs[n];
-			float  h  = hs[n];
-			float  d  = ds[n];
-
-			// see if the ball doesn't even reach the cliff:`
-			float t = -vy / (0.5 * GRAVITY);
-			float x = vx * t;
-			if( x <= g )
+			// see if the ball hits the vertical cliff face:
+			t = g / vx;
+			float y = vy * t + 0.5 * GRAVITY * t * t;
+			if( y <= h )
 			{
-				if( DEBUG )	fprintf( stderr, "Ball doesn't even reach the cliff\n" );
+				if( DEBUG )	fprintf( stderr, "Ball hits the cliff face\n" );
 			}
 			else
 			{
-				// see if the ball hits the vertical cliff face:
-				t = g / vx;
-				float y = vy * t + 0.5 * GRAVITY * t * t;
-				if( y <= h )
+				// the ball hits the upper deck:
+				// the time solution for this is a quadratic equation of the form:
+				// At^2 + Bt + C = 0.
+				// where 'A' multiplies time^2
+				//       'B' multiplies time
+				//       'C' is a constant
+				float A = 0.5 * GRAVITY;
+				float B = vy;
+				float C = -h;
+				float disc = B*B - 4.f*A*C;	// quadratic formula discriminant
+
+				// ball doesn't go as high as the upper deck:
+				// this should "never happen" ... :-)
+				if( disc < 0. )
 				{
-					if( DEBUG )	fprintf( stderr, "Ball hits the cliff face\n" );
+					if( DEBUG )	fprintf( stderr, "Ball doesn't reach the upper deck.\n" );
+					exit( 1 );	// something is wrong...
+				}
+
+				// successfully hits the ground above the cliff:
+				// get the intersection:
+				float sqrtdisc = sqrtf( disc );
+				float t1 = (-B + sqrtdisc ) / ( 2.f*A );	// time to intersect high ground
+				float t2 = (-B - sqrtdisc ) / ( 2.f*A );	// time to intersect high ground
+
+				// only care about the second intersection
+				float tmax = t1;
+				if( t2 > t1 )
+					tmax = t2;
+
+				// how far does the ball land horizontlly from the edge of the cliff?
+				float upperDist = vx * tmax - g;
+
+				// see if the ball hits the castle:
+				if(  fabs( upperDist - d ) <= TOL )
+				{
+					if( DEBUG )  fprintf( stderr, "Hits the castle at upperDist = %8.3f\n", upperDist );
+					hits += 1;
 				}
 				else
 				{
-					// the ball hits the upper deck:
-					// the time solution for this is a quadratic equation of the form:
-					// At^2 + Bt + C = 0.
-					// where 'A' multiplies time^2
-					//       'B' multiplies time
-					//       'C' is a constant
-					float A = 0.5 * GRAVITY;
-					float B = vy;
-					float C = -h;
-					float disc = B*B - 4.f*A*C;	// quadratic formula discriminant
-
-					// ball doesn't go as high as the upper deck:
-					// this should "never happen" ... :-)
-					if( disc < 0. )
-					{
-						if( DEBUG )	fprintf( stderr, "Ball doesn't reach the upper deck.\n" );
-						exit( 1 );	// something is wrong...
-					}
-
-					// successfully hits the ground above the cliff:
-					// get the intersection:
-					float sqrtdisc = sqrtf( disc );
-					float t1 = (-B + sqrtdisc ) / ( 2.f*A );	// time to intersect high ground
-					float t2 = (-B - sqrtdisc ) / ( 2.f*A );	// time to intersect high ground
-
-					// only care about the second intersection
-					float tmax = t1;
-					if( t2 > t1 )
-						tmax = t2;
-
-					// how far does the ball land horizontlly from the edge of the cliff?
-					float upperDist = vx * tmax - g;
-
-					// see if the ball hits the castle:
-					if(  fabs( upperDist - d ) <= TOL )
-					{
-						if( DEBUG )  fprintf( stderr, "Hits the castle at upperDist = %8.3f\n", upperDist );
-						numHits += 1;
-					}
-					else
-					{
-						if( DEBUG )  fprintf( stderr, "Misses the castle at upperDist = %8.3f\n", upperDist );
-					}
-				} // if ball clears the cliff face
-			} // if ball gets as far as the cliff face
-		} // for( # of  monte carlo trials )
+					if( DEBUG )  fprintf( stderr, "Misses the castle at upperDist = %8.3f\n", upperDist );
+				}
+			} // if ball clears the cliff face
+		} // if ball gets as far as the cliff face
+	} // for( # of  monte carlo trials )
+
+	return hits;
+}
+
+
+// run the whole simulation once for a given number of threads and trials, with the scalar loop
+// (simd == NULL) or a SIMD kernel; returns the megatrials/sec:
+// (referenceHits is the hit count the first thread count got with the same seed and kernel, or -1)
+// nothing is stored per trial -- each trial's inputs are made in registers and used right away,
+// and each thread only keeps its hit count -- so numTrials is limited by time, not memory:
+double
+RunOne( int numt, long long numTrials, const TimingConfig &timing, bool &usePerf, long long &referenceHits, uint64_t seed,
+	const TrajectoryKernel *simd, SamplingMode sampling )
+{
+	omp_set_num_threads( numt );	// set the number of threads to use in parallelizing the for-loop:`
+	Sampler sampler = MakeSampler( sampling, seed, numTrials );
+
+	// get ready to record the probability:
+	long long numHits = 0;		// must be declared outside the timed kernel
+
+	// warm up, then sample the whole set of trials until the timing is stable:
+	auto simulate = [&]( )
+	{
+		numHits = CountHits( sampler, 0, numTrials, simd );
 
         /* if( DEBUG ) {
-        	float probability = (float)numHits/(float)( NUMTRIALS );
+        	float probability = (float)numHits/(float)( numTrials );
         	fprintf(stderr, "numHits = %d; probability = %6.2f%%", numHits, 100.*probability);
         } */
+	};
+	TimingStats st = TimeKernel( simulate, timing );
 
-		double time1 = omp_get_wtime( );
-		double megaTrialsPerSecond = (double)NUMTRIALS / ( time1 - time0 ) / 1000000.;
-		if( megaTrialsPerSecond > maxPerformance )
-			maxPerformance = megaTrialsPerSecond;
-	} // for ( # of timing tries )
+	// the scalar trajectory test is branchy, so branch misses per trial matter here:
+	PerfCounters pc;
+	PerfCounts counts = { 0., 0., 0., 0. };
+	if( usePerf && PerfOpen( pc, numt ) )
+		counts = PerfMeasure( pc, simulate, (int) std::max( 1LL, std::min( 10LL*st.repsPerSample, PERF_TRIALS / numTrials ) ) );
+	else
+		usePerf = false;		// don't keep complaining
 
-	float probability = (float)numHits/(float)( NUMTRIALS );	// just get for the last run
-	if( DEBUG ) fprintf(stderr, "Number of Hits: %d\n",  numHits);
+	double maxPerformance = (double)numTrials / st.min / 1000000.;
+
+	double probability = (double)numHits/(double)( numTrials );	// just get for the last run
+	std::string kernelName = simd != NULL ? std::string( "simd-" ) + simd->name : std::string( "scalar" );
+	if( sampling != SAMPLING_RANDOM )
+		kernelName += std::string( "/" ) + SamplingName( sampling );
+	if( DEBUG ) fprintf(stderr, "Number of Hits: %lld\n",  numHits);
 
 // uncomment this if you want to print output to a ready-to-use CSV file:
 
 #define CSV
 #ifdef CSV
-	fprintf(stderr, "%2d , %8d , %6.2lf, %6.2lf\n",  NUMT, NUMTRIALS, maxPerformance, 100.*probability);
+	// the same four columns as always -- the kernel's name is in the --results record:
+	fprintf(stderr, "%2d , %8lld , %6.2lf, %6.2lf\n",  numt, numTrials, maxPerformance, 100.*probability);
 #else
-	fprintf(stderr, "%2d threads : %8d trials ; probability = %6.2f%% ; megatrials/sec = %6.2lf\n",
-		NUMT, NUMTRIALS, 100.*probability, maxPerformance);
+	fprintf(stderr, "%2d threads : %8lld trials ; probability = %6.2f%% ; megatrials/sec = %6.2lf ; %s\n",
+		numt, numTrials, 100.*probability, maxPerformance, kernelName.c_str( ));
+#endif
+	if( timing.printStats )
+		PrintTimingStats( stderr, "    trials", st, (double)numTrials );
+	if( pc.open )
+		PrintPerfCounts( stderr, "    trials", counts, 0., (double)numTrials );	// no input arrays any more
+
+	// each trial's inputs depend only on the seed, so the hit count must be the same for every thread count
+	// (the SIMD kernel's sin/cos differ from libm's in the last bits, so it keeps its own reference):
+	if( referenceHits < 0 )
+		referenceHits = numHits;
+
+	Result r;
+	r.benchmark = "Project1";
+	r.kernel    = "castle-hit monte carlo/" + kernelName;
+	r.threads   = numt;
+	r.size      = numTrials;
+	r.unit      = "trials";
+	r.rate      = maxPerformance;
+	r.rateUnit  = "MegaTrials/Sec";
+	r.timing    = st;
+	r.checked   = true;
+	r.passed    = numHits == referenceHits;
+	r.check     = "hits=" + std::to_string( numHits ) + " reference=" + std::to_string( referenceHits );
+	r.extra.push_back( { "probability", probability } );
+	if( pc.open )
+	{
+		r.extra.push_back( { "ipc", counts.Ipc( ) } );
+		r.extra.push_back( { "branch_misses_per_trial", counts.branchMisses / (double)numTrials } );
+		r.extra.push_back( { "llc_misses_per_trial", counts.llcMisses / (double)numTrials } );
+	}
+	EmitResult( r );
+	PerfClose( pc );
+
+	return maxPerformance;
+}
+
+
+// run trials in parallel batches until the hit probability is known to +- halfWidth at the
+// given confidence (adaptive.h), and report how many trials and how long that took:
+void
+RunToTarget( int numt, double halfWidth, double confidence, long long maxTrials, uint64_t seed,
+	const TrajectoryKernel *simd, bool verbose )
+{
+	omp_set_num_threads( numt );
+	Sampler sampler = MakeSampler( SAMPLING_RANDOM, seed, 0 );		// the Wilson interval assumes independent trials
+	auto countHits = [&]( long long first, long long count ) { return CountHits( sampler, first, count, simd ); };
+	AdaptiveResult ar = RunToPrecision( countHits, halfWidth, confidence, maxTrials, verbose ? stderr : NULL );
+
+	std::string kernelName = simd != NULL ? std::string( "simd-" ) + simd->name : std::string( "scalar" );
+	fprintf( stderr, "%2d , %11lld , %8.4lf s , %8.4lf%% +- %.4lf%% (%.4lf%% .. %.4lf%%) at %.4g%%%s, %s\n",
+		numt, ar.trials, ar.seconds, 100.*ar.interval.center, 100.*ar.interval.halfWidth,
+		100.*ar.interval.low, 100.*ar.interval.high, 100.*confidence,
+		ar.converged ? "" : " -- NOT reached, out of trials", kernelName.c_str( ) );
+
+	Result r;
+	r.benchmark = "Project1";
+	r.kernel    = "castle-hit to precision/" + kernelName;
+	r.threads   = numt;
+	r.size      = ar.trials;
+	r.unit      = "trials";
+	r.rate      = (double)ar.trials / ar.seconds / 1000000.;
+	r.rateUnit  = "MegaTrials/Sec";
+	r.timing.samples = 1;
+	r.timing.repsPerSample = 1;
+	r.timing.min = r.timing.max = r.timing.mean = r.timing.median = r.timing.p95 = r.timing.p99 = ar.seconds;
+	r.timing.times.push_back( ar.seconds );
+	r.checked   = true;
+	r.passed    = ar.converged;
+	r.check     = "half-width=" + std::to_string( ar.interval.halfWidth ) + " target=" + std::to_string( halfWidth );
+	r.extra.push_back( { "probability", ar.interval.center } );
+	r.extra.push_back( { "low", ar.interval.low } );
+	r.extra.push_back( { "high", ar.interval.high } );
+	r.extra.push_back( { "confidence", confidence } );
+	r.extra.push_back( { "batches", (double)ar.batches } );
+	r.extra.push_back( { "seconds_to_precision", ar.seconds } );
+	EmitResult( r );
+}
+
+
+// are all of the trial counts within what the sampling mode can index? (prints why not):
+bool
+TrialsFit( SamplingMode mode, const std::vector<long long> &trials )
+{
+	long long most = MaxSamplingTrials( mode );
+	for( long long numTrials : trials )
+	{
+		if( most >= 0  &&  numTrials > most )
+		{
+			fprintf( stderr, "%s sampling takes at most %lld trials, got %lld\n", SamplingName( mode ), most, numTrials );
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// estimate the probability numReplicates times with independent seeds for each sampling mode, and
+// compare the spread of the estimates per unit of CPU time against plain random sampling
+// (efficiency = 1 / ( variance * cpu-seconds per estimate ), so 2x means half the cost for the same error):
+void
+CompareSampling( int numt, long long numTrials, int numReplicates, uint64_t seed, const std::vector<SamplingMode> &modes )
+{
+	omp_set_num_threads( numt );
+	double randomEfficiency = 0., randomVariance = 0.;
+	fprintf( stderr, "%2d threads, %lld trials, %d replicates:\n", numt, numTrials, numReplicates );
+	for( SamplingMode mode : modes )
+	{
+		double sum = 0., sumSquares = 0., seconds = 0.;
+		for( int r = 0; r < numReplicates; r++ )
+		{
+			Sampler sampler = MakeSampler( mode, seed + (uint64_t)r, numTrials );
+			double t0 = omp_get_wtime( );
+			long long hits = CountHits( sampler, 0, numTrials, NULL );
+			seconds += omp_get_wtime( ) - t0;
+			double p = (double)hits / (double)numTrials;
+			sum += p;
+			sumSquares += p * p;
+		}
+		double mean = sum / numReplicates;
+		double variance = std::max( 0., ( sumSquares - numReplicates*mean*mean ) / ( numReplicates - 1 ) );
+		double cpuSeconds = (double)numt * seconds / numReplicates;			// per estimate
+		double efficiency = variance > 0. ? 1. / ( variance * cpuSeconds ) : 0.;
+		if( mode == SAMPLING_RANDOM )
+		{
+			randomEfficiency = efficiency;
+			randomVariance   = variance;
+		}
+
+		fprintf( stderr, "    %-10s  p = %8.5lf%%  stddev = %9.3le  cpu s/estimate = %9.3le",
+			SamplingName( mode ), 100.*mean, sqrt( variance ), cpuSeconds );
+		if( randomEfficiency > 0. && mode != SAMPLING_RANDOM )
+			fprintf( stderr, "  variance / %6.2lf , efficiency x %6.2lf",
+				variance > 0. ? randomVariance / variance : 0., efficiency / randomEfficiency );
+		fprintf( stderr, "\n" );
+
+		Result res;
+		res.benchmark = "Project1";
+		res.kernel    = std::string( "castle-hit sampling/" ) + SamplingName( mode );
+		res.threads   = numt;
+		res.size      = numTrials;
+		res.unit      = "trials";
+		res.rate      = (double)numTrials / ( seconds / numReplicates ) / 1000000.;
+		res.rateUnit  = "MegaTrials/Sec";
+		res.timing.samples = numReplicates;
+		res.timing.repsPerSample = 1;
+		res.timing.min = res.timing.max = res.timing.mean = res.timing.median = res.timing.p95 = res.timing.p99 = seconds / numReplicates;
+		res.extra.push_back( { "probability", mean } );
+		res.extra.push_back( { "variance", variance } );
+		res.extra.push_back( { "cpu_seconds_per_estimate", cpuSeconds } );
+		res.extra.push_back( { "efficiency", efficiency } );
+		if( randomEfficiency > 0. )
+			res.extra.push_back( { "efficiency_vs_random", efficiency / randomEfficiency } );
+		EmitResult( res );
+	}
+}
+
+
+// prove most of the parameter box all-hit or all-miss with interval arithmetic (boxes.h), sample
+// only the undecided part with numTrials trials, and compare with plain Monte Carlo of the same
+// number of trials:
+void
+RunSubdivision( int numt, long long numTrials, int maxDepth, long long maxBoxes, uint64_t seed, const TrajectoryKernel *simd )
+{
+	omp_set_num_threads( numt );
+	CastleProblem cp;
+	for( int k = 0; k < 10; k++ )
+		cp.ranges[k] = RANGES[k];
+	cp.gravity = GRAVITY;
+	cp.tol     = TOL;
+
+	double t0 = omp_get_wtime( );
+	SubdivisionResult sr = Subdivide( cp, seed, numTrials, maxDepth, maxBoxes );
+	double boxSeconds = omp_get_wtime( ) - t0;
+
+	long long checked = 0;
+	long long wrong = ValidateBoxes( cp, sr, seed, 16, 4096, checked );
+
+	// plain Monte Carlo with the same number of trials:
+	Sampler sampler = MakeSampler( SAMPLING_RANDOM, seed, sr.trials );
+	t0 = omp_get_wtime( );
+	long long hits = CountHits( sampler, 0, sr.trials, simd );
+	double mcSeconds = omp_get_wtime( ) - t0;
+	double mcProbability = (double)hits / (double)sr.trials;
+	double mcVariance = mcProbability * ( 1. - mcProbability ) / (double)sr.trials;
+
+	double stderrBoxes = sqrt( sr.variance );
+	double gain = sr.variance > 0. ? ( mcVariance * mcSeconds ) / ( sr.variance * boxSeconds ) : 0.;
+	fprintf( stderr, "%2d threads: %d levels, %lld boxes decided (%.4lf%% all-hit, %.4lf%% all-miss), %lld undecided (%.4lf%% of the volume)\n",
+		numt, sr.depth, sr.decidedBoxes, 100.*sr.hitVolume, 100.*sr.missVolume, sr.undecidedBoxes, 100.*sr.undecidedVolume );
+	fprintf( stderr, "    subdivision : p = %9.5lf%% +- %.5lf%%  (%lld trials, %8.4lf s)\n",
+		100.*sr.probability, 100.*stderrBoxes, sr.trials, boxSeconds );
+	fprintf( stderr, "    monte carlo : p = %9.5lf%% +- %.5lf%%  (%lld trials, %8.4lf s, %s)\n",
+		100.*mcProbability, 100.*sqrt( mcVariance ), sr.trials, mcSeconds, simd != NULL ? simd->name : "scalar" );
+	fprintf( stderr, "    difference = %.2lf sigma ; precision per core-second x %.1lf ; %lld of %lld spot checks in proven boxes disagree\n",
+		fabs( sr.probability - mcProbability ) / sqrt( sr.variance + mcVariance ), gain, wrong, checked );
+
+	Result r;
+	r.benchmark = "Project1";
+	r.kernel    = "castle-hit subdivision";
+	r.threads   = numt;
+	r.size      = sr.trials;
+	r.unit      = "trials";
+	r.rate      = (double)sr.trials / boxSeconds / 1000000.;
+	r.rateUnit  = "MegaTrials/Sec";
+	r.timing.samples = 1;
+	r.timing.repsPerSample = 1;
+	r.timing.min = r.timing.max = r.timing.mean = r.timing.median = r.timing.p95 = r.timing.p99 = boxSeconds;
+	r.timing.times.push_back( boxSeconds );
+	r.checked   = true;
+	r.passed    = wrong == 0 && fabs( sr.probability - mcProbability ) <= 4. * sqrt( sr.variance + mcVariance );
+	r.check     = "monte carlo p=" + std::to_string( mcProbability ) + " spot-check failures=" + std::to_string( wrong );
+	r.extra.push_back( { "probability", sr.probability } );
+	r.extra.push_back( { "stderr", stderrBoxes } );
+	r.extra.push_back( { "undecided_volume", sr.undecidedVolume } );
+	r.extra.push_back( { "efficiency_vs_monte_carlo", gain } );
+	EmitResult( r );
+}
+
+
+// evaluate every scenario in the file (cannon.h) on numt threads; the per-scenario results are
+// printed for the first thread count and checked against it for the others:
+bool
+RunScenarios( int numt, const std::vector<CannonScenario> &scenarios, const TrajectoryKernel &kernel, uint64_t seed,
+	bool independent, std::vector<ScenarioResult> &reference )
+{
+	long long totalTrials = 0;
+	for( const CannonScenario &sc : scenarios )
+		totalTrials += sc.trials;
+
+	double t0 = omp_get_wtime( );
+	std::vector<ScenarioResult> results = EvaluateScenarios( scenarios, kernel, seed, independent, numt );
+	double seconds = omp_get_wtime( ) - t0;
+
+	bool first = reference.empty( );
+	if( first )
+	{
+		reference = results;
+		fprintf( stderr, "scenario , trials , hits , probability , stderr\n" );
+		for( size_t s = 0; s < scenarios.size( ); s++ )
+			fprintf( stderr, "%s , %lld , %lld , %8.4lf%% , %.4lf%%\n", scenarios[s].name.c_str( ),
+				results[s].trials, results[s].hits, 100.*results[s].probability, 100.*results[s].stderror );
+	}
+	bool same = true;
+	for( size_t s = 0; s < scenarios.size( ); s++ )
+		same = same && results[s].hits == reference[s].hits;
+
+	fprintf( stderr, "%2d threads : %zu scenarios , %lld trials in %8.4lf s ; %8.1lf scenarios/sec ; megatrials/sec = %6.2lf%s\n",
+		numt, scenarios.size( ), totalTrials, seconds, (double)scenarios.size( ) / seconds,
+		(double)totalTrials / seconds / 1000000., same ? "" : " -- hits differ from the first thread count!" );
+
+	for( size_t s = 0; s < scenarios.size( ); s++ )
+	{
+		Result r;
+		r.benchmark = "Project1";
+		r.kernel    = "castle-hit scenario/" + scenarios[s].name;
+		r.threads   = numt;
+		r.size      = results[s].trials;
+		r.unit      = "trials";
+		r.rate      = (double)totalTrials / seconds / 1000000.;		// (the whole pass's rate)
+		r.rateUnit  = "MegaTrials/Sec";
+		r.checked   = ! first;
+		r.passed    = results[s].hits == reference[s].hits;
+		r.check     = "hits=" + std::to_string( results[s].hits ) + " reference=" + std::to_string( reference[s].hits );
+		r.extra.push_back( { "probability", results[s].probability } );
+		r.extra.push_back( { "stderr", results[s].stderror } );
+		r.extra.push_back( { "pass_seconds", seconds } );
+		EmitResult( r );
+	}
+	return same;
+}
+
+
+// main program:
+int
+main( int argc, char *argv[ ] )
+{
+#ifndef _OPENMP
+	fprintf( stderr, "No OpenMP support!\n" );
+	return 1;
 #endif
 
+	std::vector<long long> threads = ArgList( argc, argv, "--threads", { NUMT } );
+	std::vector<long long> trials  = ArgList( argc, argv, "--trials",  { NUMTRIALS } );
+	int numTries = (int) ArgInt( argc, argv, "--tries", NUMTRIES );
+	TimingConfig timing = TimingFromArgs( argc, argv, numTries );
+	OpenResults( argc, argv );
+	bool usePerf = ArgFlag( argc, argv, "--perf" );
+
+	// single-pass mode for huge trial counts (--trials 1e10): one timed run per point, no warmup
+	if( ArgFlag( argc, argv, "--stream" ) )
+	{
+		timing.warmups    = 0;
+		timing.minSamples = 1;
+		timing.maxSamples = 1;
+	}
+
+	if( ! PhiloxSelfTest( ) )
+	{
+		fprintf( stderr, "The random number generator fails its known-answer test\n" );
+		return 1;
+	}
+
+	// seed the random number generator (print it so that a run can be repeated with --seed):
+	uint64_t seed = (uint64_t) ArgInt( argc, argv, "--seed", TimeOfDaySeed( ) );
+	fprintf( stderr, "Seed = %llu\n", (unsigned long long)seed );
+
+	// --kernel scalar|simd|both picks the loops to time (one, by default, so the csv has one row a
+	// point); --simd sse|avx2|avx512 forces a vector width instead of the widest one this CPU supports:
+	const char *which = ArgString( argc, argv, "--kernel", "scalar" );
+	bool runScalar = strcmp( which, "simd" ) != 0;
+	bool runSimd   = strcmp( which, "scalar" ) != 0;
+	TrajectoryKernel simd;
+	const char *simdName = ArgString( argc, argv, "--simd", "best" );
+	if( runSimd && ! SelectTrajectoryKernel( simdName, simd ) )
+	{
+		fprintf( stderr, "SIMD kernel '%s' is not available here\n", simdName );
+		return 1;
+	}
+
+	// --sampling random|antithetic|stratified|sobol|halton (the SIMD kernel draws its own random
+	// numbers, so the other modes are scalar only):
+	SamplingMode sampling = SAMPLING_RANDOM;
+	const char *samplingName = ArgString( argc, argv, "--sampling", "random" );
+	if( strcmp( samplingName, "all" ) != 0 && ! SetSampling( samplingName, sampling ) )
+	{
+		fprintf( stderr, "Unknown sampling mode '%s'\n", samplingName );
+		return 1;
+	}
+	if( ! SobolSelfTest( ) )
+	{
+		fprintf( stderr, "The Sobol' direction numbers fail their self-test\n" );
+		return 1;
+	}
+
+	// --variance R: compare the sampling modes (all of them, or just --sampling's against random)
+	// on the variance of R independent estimates per cpu-second:
+	int numReplicates = (int) ArgInt( argc, argv, "--variance", 0 );
+	if( numReplicates > 0 )
+	{
+		std::vector<SamplingMode> modes = { SAMPLING_RANDOM };
+		for( int k = 1; k < NUM_SAMPLING_MODES; k++ )
+		{
+			if( strcmp( samplingName, "all" ) == 0 || sampling == (SamplingMode)k )
+				modes.push_back( (SamplingMode)k );
+		}
+		if( modes.size( ) == 1 )
+		{
+			for( int k = 1; k < NUM_SAMPLING_MODES; k++ )
+				modes.push_back( (SamplingMode)k );
+		}
+		for( SamplingMode mode : modes )
+		{
+			if( ! TrialsFit( mode, trials ) )
+				return 1;
+		}
+		for( long long numt : threads )
+		{
+			for( long long numTrials : trials )
+				CompareSampling( (int)numt, numTrials, std::max( 2, numReplicates ), seed, modes );
+		}
+		CloseResults( );
+		return 0;
+	}
+
+	// --scenarios FILE: a hit probability for every parameter-range scenario in the file, all in one
+	// parallel pass per thread count (--trials is the default per scenario; --independent gives
+	// each scenario its own random stream instead of common random numbers):
+	const char *scenarioFile = ArgValue( argc, argv, "--scenarios" );
+	if( scenarioFile != NULL )
+	{
+		std::vector<CannonScenario> scenarios;
+		long long defaultTrials = ArgValue( argc, argv, "--trials" ) != NULL ? trials[0] : SCENARIO_DEFAULT_TRIALS;
+		if( ! ReadScenarios( scenarioFile, scenarios, defaultTrials ) )
+			return 1;
+		TrajectoryKernel kernel;
+		SelectTrajectoryKernel( runSimd ? simdName : "sse", kernel );
+		fprintf( stderr, "%zu scenarios from %s, %s trajectory kernel\n", scenarios.size( ), scenarioFile, kernel.name );
+
+		bool independent = ArgFlag( argc, argv, "--independent" );
+		std::vector<ScenarioResult> reference;
+		bool same = true;
+		for( long long numt : threads )
+			same = RunScenarios( (int)numt, scenarios, kernel, seed, independent, reference ) && same;
+		CloseResults( );
+		return same ? 0 : 1;
+	}
+
+	// --subdivide: interval-arithmetic proof plus sampling of what's left, for each thread count and
+	// --trials, with --depth and --max-boxes limits on the subdivision:
+	if( ArgFlag( argc, argv, "--subdivide" ) )
+	{
+		int maxDepth = (int) ArgInt( argc, argv, "--depth", MAX_DEPTH );
+		long long maxBoxes = ArgInt( argc, argv, "--max-boxes", MAX_BOXES );
+		for( long long numt : threads )
+		{
+			for( long long numTrials : trials )
+				RunSubdivision( (int)numt, numTrials, maxDepth, maxBoxes, seed, runSimd ? &simd : NULL );
+		}
+		CloseResults( );
+		return 0;
+	}
+
+	if( sampling != SAMPLING_RANDOM && runSimd )
+	{
+		fprintf( stderr, "(%s sampling runs through the scalar loop only)\n", SamplingName( sampling ) );
+		runSimd = false;
+		runScalar = true;
+	}
+	if( runSimd )
+		fprintf( stderr, "Using the %s trajectory kernel (%d trials per vector)\n", simd.name, simd.width );
+
+	// --precision H: instead of a fixed --trials sweep, run each thread count until the probability
+	// is known to +- H (0.0001 is +-0.01%) at --confidence (default 0.99):
+	double precision = ArgDouble( argc, argv, "--precision", 0. );
+	if( precision > 0. )
+	{
+		double confidence = ArgDouble( argc, argv, "--confidence", 0.99 );
+		long long maxTrials = ArgInt( argc, argv, "--max-trials", MAXTRIALS );
+		if( confidence <= 0. || confidence >= 1. )
+		{
+			fprintf( stderr, "--confidence must be between 0 and 1\n" );
+			return 1;
+		}
+		for( long long numt : threads )
+			RunToTarget( (int)numt, precision, confidence, maxTrials, seed, runSimd ? &simd : NULL, timing.printStats );
+		CloseResults( );
+		return 0;
+	}
+
+	if( ! TrialsFit( sampling, trials ) )
+		return 1;
+
+	std::vector<long long> referenceHits( trials.size( ), -1 );
+	std::vector<long long> simdReferenceHits( trials.size( ), -1 );
+	for( long long numt : threads )
+	{
+		for( size_t i = 0; i < trials.size( ); i++ )
+		{
+			double scalarRate = 0.;
+			if( runScalar )
+				scalarRate = RunOne( (int)numt, trials[i], timing, usePerf, referenceHits[i], seed, NULL, sampling );
+			if( runSimd )
+			{
+				double simdRate = RunOne( (int)numt, trials[i], timing, usePerf, simdReferenceHits[i], seed, &simd, SAMPLING_RANDOM );
+				if( runScalar && scalarRate > 0. )
+					fprintf( stderr, "    simd-%s speedup over scalar = %5.2lfx\n", simd.name, simdRate / scalarRate );
+			}
+		}
+	}
+	CloseResults( );
+
 	return 0;
 }
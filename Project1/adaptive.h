@@ -0,0 +1,139 @@
+/*
+ *
+ * Run a Monte Carlo probability estimate only until it is as precise as asked for.
+ *
+ * A fixed trial count is either wasted (the answer was already good to the digits anyone reads)
+ * or not enough (the interval is still wide). Here the trials are run in batches, each batch in
+ * parallel, and after each one the Wilson score interval for the hit probability is updated:
+ *
+ *		center    = ( p + z^2/2n ) / ( 1 + z^2/n )
+ *		halfWidth = z / ( 1 + z^2/n ) * sqrt( p(1-p)/n + z^2/4n^2 )
+ *
+ * where p = hits/n and z is the two-sided normal quantile for the confidence (2.576 for 99%).
+ * Unlike the textbook p +- z*sqrt(p(1-p)/n), it stays inside [0,1] and doesn't collapse to zero
+ * width when there are no hits yet. The run stops when halfWidth <= the target (or at maxTrials).
+ *
+ * The batches are sized from the current estimate of how many trials the target needs (at most
+ * doubling the total each time), so a query that is easy stops early and one that isn't doesn't
+ * spend its time checking. Batches continue the trial numbering, so with a counter-based
+ * generator the answer for a given seed doesn't depend on the batch sizes or the thread count.
+ *
+ */
+
+#ifndef PROJECT1_ADAPTIVE_H
+#define PROJECT1_ADAPTIVE_H
+
+#include <stdio.h>
+#include <math.h>
+#include <omp.h>
+#include <algorithm>
+
+#define ADAPTIVE_FIRST_BATCH	65536LL		// trials in the first batch
+#define ADAPTIVE_ROUND			4096LL		// batch sizes are a multiple of this (one SIMD block)
+
+struct WilsonInterval
+{
+	double	center;
+	double	low;
+	double	high;
+	double	halfWidth;
+};
+
+struct AdaptiveResult
+{
+	long long		trials;			// trials actually run
+	long long		hits;
+	int				batches;
+	double			seconds;		// wall-clock time to reach the precision
+	bool			converged;		// false if maxTrials ran out first
+	WilsonInterval	interval;
+};
+
+
+// the two-sided standard normal quantile: P( |Z| <= z ) = confidence, by bisection on erfc( ):
+inline double
+NormalQuantile( double confidence )
+{
+	double tail = 1. - confidence;
+	double lo = 0., hi = 40.;
+	for( int i = 0; i < 200; i++ )
+	{
+		double mid = 0.5 * ( lo + hi );
+		if( erfc( mid / sqrt( 2. ) ) > tail )
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return 0.5 * ( lo + hi );
+}
+
+inline WilsonInterval
+Wilson( long long hits, long long trials, double z )
+{
+	WilsonInterval w = { 0., 0., 1., 0.5 };
+	if( trials <= 0 )
+		return w;
+
+	double n = (double)trials;
+	double p = (double)hits / n;
+	double z2 = z * z;
+	double denom = 1. + z2/n;
+	w.center    = ( p + z2/(2.*n) ) / denom;
+	w.halfWidth = z / denom * sqrt( p*(1.-p)/n + z2/(4.*n*n) );
+	w.low       = std::max( 0., w.center - w.halfWidth );
+	w.high      = std::min( 1., w.center + w.halfWidth );
+	return w;
+}
+
+// about how many trials in all a half-width of target needs, if the probability is near p:
+inline long long
+TrialsNeeded( double p, double z, double target )
+{
+	p = std::min( std::max( p, 1.e-6 ), 1. - 1.e-6 );		// no hits yet is not "no trials needed"
+	return (long long) ceil( z * z * p * ( 1. - p ) / ( target * target ) );
+}
+
+// run countHits( first, count ) in batches until the Wilson half-width at this confidence is
+// <= targetHalfWidth, or maxTrials have been run; countHits does its own parallelism:
+template< class COUNT >
+AdaptiveResult
+RunToPrecision( COUNT countHits, double targetHalfWidth, double confidence, long long maxTrials, FILE *progress )
+{
+	double z = NormalQuantile( confidence );
+
+	AdaptiveResult r;
+	r.trials    = 0;
+	r.hits      = 0;
+	r.batches   = 0;
+	r.converged = false;
+	r.interval  = Wilson( 0, 0, z );
+
+	double t0 = omp_get_wtime( );
+	long long batch = std::min( ADAPTIVE_FIRST_BATCH, maxTrials );
+	while( batch > 0 )
+	{
+		r.hits += countHits( r.trials, batch );
+		r.trials += batch;
+		r.batches++;
+		r.interval = Wilson( r.hits, r.trials, z );
+		if( progress != NULL )
+			fprintf( progress, "    batch %3d : %12lld trials , p = %8.6lf +- %.6lf\n",
+				r.batches, r.trials, r.interval.center, r.interval.halfWidth );
+
+		if( r.interval.halfWidth <= targetHalfWidth )
+		{
+			r.converged = true;
+			break;
+		}
+
+		// aim for the estimated total, but never more than double what has been run so far:
+		long long wanted = TrialsNeeded( (double)r.hits / (double)r.trials, z, targetHalfWidth ) - r.trials;
+		wanted = std::min( std::max( wanted, ADAPTIVE_ROUND ), r.trials );
+		wanted = ( ( wanted + ADAPTIVE_ROUND-1 ) / ADAPTIVE_ROUND ) * ADAPTIVE_ROUND;
+		batch = std::min( wanted, maxTrials - r.trials );
+	}
+	r.seconds = omp_get_wtime( ) - t0;
+	return r;
+}
+
+#endif		// PROJECT1_ADAPTIVE_H
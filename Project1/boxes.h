@@ -0,0 +1,438 @@
+/*
+ *
+ * Castle-hit probability by subdividing the parameter box and proving most of it with interval
+ * arithmetic; Monte Carlo only where the proof can't decide.
+ *
+ * A trial's outcome depends only on its five inputs ( v, theta, g, h, d ), and the trajectory is
+ * closed-form, so evaluating the hit test with intervals instead of numbers tells us, for a whole
+ * sub-box of the inputs at once, that every point in it hits, every point misses, or "can't tell".
+ * The unit box is split in half along its widest side again and again, in parallel one level at
+ * a time: decided boxes add their volume (all-hit) or nothing (all-miss) exactly, and only the
+ * undecided ones are split further. When the depth or box budget runs out, the undecided boxes
+ * left over are sampled, with trials spread in proportion to their volume:
+ *
+ *		P = sum over all-hit boxes of volume  +  sum over undecided boxes of volume * hits/trials
+ *
+ * so the Monte Carlo error only comes from the undecided volume, which is a small fraction of
+ * the whole. The interval operations round outward (one ulp each way), and "decided" means the
+ * whole interval is strictly on one side of every test.
+ *
+ * Every decided box can also be spot-checked by sampling points inside it (ValidateBoxes( )):
+ * any point whose ordinary floating-point test disagrees with the proof is counted.
+ *
+ */
+
+#ifndef PROJECT1_BOXES_H
+#define PROJECT1_BOXES_H
+
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+#include <vector>
+#include <algorithm>
+
+#include "../Common/rng.h"
+
+#define BOX_DIMS		5			// v, theta, g, h, d
+#define MAX_DEPTH		40			// subdivision levels
+#define MAX_BOXES		( 1 << 16 )	// stop splitting once this many boxes are undecided
+#define MIN_BOX_TRIALS	16			// every undecided box gets at least this many trials
+
+struct Interval
+{
+	double	lo;
+	double	hi;
+};
+
+enum Truth { TRUTH_FALSE, TRUTH_TRUE, TRUTH_UNKNOWN };
+
+// a box in unit coordinates: dimension k runs over [lo[k],hi[k]] of [0,1]:
+struct Box
+{
+	double	lo[BOX_DIMS];
+	double	hi[BOX_DIMS];
+};
+
+// the physical problem: ranges (v, theta in degrees, g, h, d; min/max pairs) and constants:
+struct CastleProblem
+{
+	double	ranges[2*BOX_DIMS];
+	double	gravity;
+	double	tol;
+};
+
+struct SubdivisionResult
+{
+	double		hitVolume;			// proven all-hit
+	double		missVolume;			// proven all-miss
+	double		undecidedVolume;
+	long long	decidedBoxes;
+	long long	undecidedBoxes;
+	int			depth;				// levels actually split
+	long long	trials;				// spent on the undecided boxes
+	double		probability;
+	double		variance;			// of the probability estimate
+	std::vector<Box>	hitBoxes;		// (kept for validation)
+	std::vector<Box>	missBoxes;
+};
+
+
+// ---- interval arithmetic, rounded outward ----
+
+inline Interval
+Widen( double lo, double hi )
+{
+	return { nextafter( lo, -INFINITY ), nextafter( hi, INFINITY ) };
+}
+
+inline Interval	Point( double x )						{ return { x, x }; }
+inline Interval	Add( Interval a, Interval b )			{ return Widen( a.lo + b.lo, a.hi + b.hi ); }
+inline Interval	Sub( Interval a, Interval b )			{ return Widen( a.lo - b.hi, a.hi - b.lo ); }
+
+inline Interval
+Mul( Interval a, Interval b )
+{
+	double p0 = a.lo*b.lo, p1 = a.lo*b.hi, p2 = a.hi*b.lo, p3 = a.hi*b.hi;
+	return Widen( std::min( std::min( p0, p1 ), std::min( p2, p3 ) ), std::max( std::max( p0, p1 ), std::max( p2, p3 ) ) );
+}
+
+inline Interval
+Div( Interval a, Interval b )
+{
+	if( b.lo <= 0. && b.hi >= 0. )
+		return { -INFINITY, INFINITY };
+	return Mul( a, Widen( 1./b.hi, 1./b.lo ) );
+}
+
+inline Interval
+Square( Interval a )
+{
+	if( a.lo >= 0. )
+		return Widen( a.lo*a.lo, a.hi*a.hi );
+	if( a.hi <= 0. )
+		return Widen( a.hi*a.hi, a.lo*a.lo );
+	return Widen( 0., std::max( a.lo*a.lo, a.hi*a.hi ) );
+}
+
+// (the negative part of a is dropped -- the caller tests a >= 0 separately)
+inline Interval
+Sqrt( Interval a )
+{
+	return Widen( sqrt( std::max( a.lo, 0. ) ), sqrt( std::max( a.hi, 0. ) ) );
+}
+
+inline Interval
+Max( Interval a, Interval b )
+{
+	return { std::max( a.lo, b.lo ), std::max( a.hi, b.hi ) };
+}
+
+// sin over any interval: the endpoints, plus +-1 if a peak or trough is inside:
+inline Interval
+Sin( Interval a )
+{
+	if( a.hi - a.lo >= 2.*M_PI )
+		return { -1., 1. };
+	double lo = std::min( sin( a.lo ), sin( a.hi ) );
+	double hi = std::max( sin( a.lo ), sin( a.hi ) );
+	double peak = M_PI/2. + 2.*M_PI * ceil( ( a.lo - M_PI/2. ) / ( 2.*M_PI ) );
+	if( peak <= a.hi )
+		hi = 1.;
+	double trough = -M_PI/2. + 2.*M_PI * ceil( ( a.lo + M_PI/2. ) / ( 2.*M_PI ) );
+	if( trough <= a.hi )
+		lo = -1.;
+	return Widen( std::max( lo, -1. ), std::min( hi, 1. ) );
+}
+
+inline Interval
+Cos( Interval a )
+{
+	return Sin( Add( a, Point( M_PI/2. ) ) );
+}
+
+inline Interval
+Tan( Interval a )
+{
+	return Div( Sin( a ), Cos( a ) );
+}
+
+inline Truth
+Greater( Interval a, Interval b )
+{
+	if( a.lo > b.hi )
+		return TRUTH_TRUE;
+	if( a.hi <= b.lo )
+		return TRUTH_FALSE;
+	return TRUTH_UNKNOWN;
+}
+
+inline Truth
+And( Truth a, Truth b )
+{
+	if( a == TRUTH_FALSE || b == TRUTH_FALSE )
+		return TRUTH_FALSE;
+	if( a == TRUTH_TRUE && b == TRUTH_TRUE )
+		return TRUTH_TRUE;
+	return TRUTH_UNKNOWN;
+}
+
+
+// ---- the hit test ----
+
+// unit coordinate x of dimension k -> its physical value:
+inline double
+Physical( const CastleProblem &cp, int k, double x )
+{
+	return cp.ranges[2*k] + x * ( cp.ranges[2*k+1] - cp.ranges[2*k] );
+}
+
+// the ball's height over the cliff edge minus h, and where it lands past the edge, for launch
+// angles in thr and point values of v and h (both are increasing in v and decreasing in h):
+inline Interval
+HeightOverCliff( Interval v, Interval thr, Interval g, Interval h, double k )		// k = |gravity|/2
+{
+	// vy*t - k*t^2 with t = g/vx, i.e. g tan(thr) - k g^2 / ( v cos(thr) )^2:
+	Interval t = Div( g, Mul( v, Cos( thr ) ) );
+	return Sub( Sub( Mul( Mul( v, Sin( thr ) ), t ), Mul( Point( k ), Square( t ) ) ), h );
+}
+
+inline Interval
+UpperDeckDistance( Interval v, Interval thr, Interval h, double k )
+{
+	// vx * ( vy + sqrt( vy^2 - 4 k h ) ) / 2k, the later of the two landing times:
+	Interval vy = Mul( v, Sin( thr ) );
+	Interval disc = Sub( Square( vy ), Mul( Point( 4.*k ), h ) );
+	return Div( Mul( Mul( v, Cos( thr ) ), Add( vy, Sqrt( disc ) ) ), Point( 2.*k ) );
+}
+
+// the tests of Project1's scalar loop, over a whole box. They are rearranged so each input
+// appears as few times as possible -- plain interval arithmetic treats every appearance of a
+// variable as independent, and the bounds get much wider than the true range -- and the two
+// that are monotone in v and h are bounded by evaluating them at the corners:
+inline Truth
+ClassifyBox( const CastleProblem &cp, const Box &b )
+{
+	Interval in[BOX_DIMS];
+	for( int k = 0; k < BOX_DIMS; k++ )
+		in[k] = Widen( Physical( cp, k, b.lo[k] ), Physical( cp, k, b.hi[k] ) );
+	Interval v = in[0], g = in[2], h = in[3], d = in[4];
+	Interval thr = Mul( in[1], Point( M_PI/180. ) );
+	double k = -0.5 * cp.gravity;
+	Interval vLo = Point( v.lo ), vHi = Point( v.hi ), hLo = Point( h.lo ), hHi = Point( h.hi );
+
+	// does the ball reach the cliff?  vx * 2vy/|gravity| = v^2 sin(2 thr) / 2k > g
+	Interval reach = Div( Mul( Square( v ), Sin( Mul( Point( 2. ), thr ) ) ), Point( 2.*k ) );
+	Truth hit = Greater( reach, g );
+	if( hit == TRUTH_FALSE )
+		return TRUTH_FALSE;
+
+	// does it clear the cliff face?
+	Interval above = { HeightOverCliff( vLo, thr, g, hHi, k ).lo, HeightOverCliff( vHi, thr, g, hLo, k ).hi };
+	hit = And( hit, Greater( above, Point( 0. ) ) );
+	if( hit == TRUTH_FALSE )
+		return TRUTH_FALSE;
+
+	// does it get as high as the upper deck at all?  vy^2 - 4kh >= 0
+	Interval disc = Sub( Square( Mul( v, Sin( thr ) ) ), Mul( Point( 4.*k ), h ) );
+	Truth reachesDeck = disc.lo >= 0. ? TRUTH_TRUE : disc.hi < 0. ? TRUTH_FALSE : TRUTH_UNKNOWN;
+	hit = And( hit, reachesDeck );
+	if( hit == TRUTH_FALSE )
+		return TRUTH_FALSE;
+
+	// does it land within tol of the castle?  (where the deck isn't reached, the clamped square
+	// root still bounds the points that do reach it)
+	Interval landing = { UpperDeckDistance( vLo, thr, hHi, k ).lo, UpperDeckDistance( vHi, thr, hLo, k ).hi };
+	Interval miss = Sub( Sub( landing, g ), d );
+	Truth lands = TRUTH_UNKNOWN;
+	if( miss.lo >= -cp.tol && miss.hi <= cp.tol )
+		lands = TRUTH_TRUE;
+	else if( miss.lo > cp.tol || miss.hi < -cp.tol )
+		lands = TRUTH_FALSE;
+	return And( hit, lands );
+}
+
+// the ordinary float test for one point, as in Project1's scalar loop:
+inline bool
+CastleHit( const CastleProblem &cp, const float x[BOX_DIMS] )
+{
+	float v   = (float)Physical( cp, 0, x[0] );
+	float thr = (float)M_PI/180.f * (float)Physical( cp, 1, x[1] );
+	float g   = (float)Physical( cp, 2, x[2] );
+	float h   = (float)Physical( cp, 3, x[3] );
+	float d   = (float)Physical( cp, 4, x[4] );
+	float G   = (float)cp.gravity;
+
+	float vx = v * cos( thr );
+	float vy = v * sin( thr );
+	float t = -vy / ( 0.5 * G );
+	if( vx * t <= g )
+		return false;
+	t = g / vx;
+	if( vy * t + 0.5 * G * t * t <= h )
+		return false;
+	float A = 0.5 * G;
+	float disc = vy*vy - 4.f*A*(-h);
+	if( disc < 0. )
+		return false;
+	float sqrtdisc = sqrtf( disc );
+	float t1 = ( -vy + sqrtdisc ) / ( 2.f*A );
+	float t2 = ( -vy - sqrtdisc ) / ( 2.f*A );
+	float upperDist = vx * std::max( t1, t2 ) - g;
+	return fabs( upperDist - d ) <= cp.tol;
+}
+
+inline double
+Volume( const Box &b )
+{
+	double vol = 1.;
+	for( int k = 0; k < BOX_DIMS; k++ )
+		vol *= b.hi[k] - b.lo[k];
+	return vol;
+}
+
+// a uniform random point in box b (from trial number n's Philox numbers), in unit coordinates:
+inline void
+PointInBox( const Box &b, uint64_t seed, long long n, float x[BOX_DIMS] )
+{
+	float u[5];
+	PhiloxFiveUniforms( seed, (uint64_t)n, u );
+	for( int k = 0; k < BOX_DIMS; k++ )
+		x[k] = (float)( b.lo[k] + u[k] * ( b.hi[k] - b.lo[k] ) );
+}
+
+
+// ---- subdivide, then sample what's left ----
+
+inline SubdivisionResult
+Subdivide( const CastleProblem &cp, uint64_t seed, long long numTrials, int maxDepth, long long maxBoxes )
+{
+	SubdivisionResult r;
+	r.hitVolume = r.missVolume = r.undecidedVolume = 0.;
+	r.decidedBoxes = 0;
+	r.depth = 0;
+
+	Box unit;
+	for( int k = 0; k < BOX_DIMS; k++ )
+	{
+		unit.lo[k] = 0.;
+		unit.hi[k] = 1.;
+	}
+	std::vector<Box> undecided( 1, unit );
+
+	// one level at a time: classify every box in parallel, keep the undecided ones and split them
+	// along their widest side:
+	std::vector<Truth> truth;
+	while( true )
+	{
+		truth.resize( undecided.size( ) );
+		#pragma omp parallel for schedule(dynamic,64)
+		for( long long i = 0; i < (long long)undecided.size( ); i++ )
+			truth[i] = ClassifyBox( cp, undecided[i] );
+
+		std::vector<Box> next;
+		for( size_t i = 0; i < undecided.size( ); i++ )
+		{
+			if( truth[i] == TRUTH_TRUE )
+			{
+				r.hitVolume += Volume( undecided[i] );
+				r.hitBoxes.push_back( undecided[i] );
+			}
+			else if( truth[i] == TRUTH_FALSE )
+			{
+				r.missVolume += Volume( undecided[i] );
+				r.missBoxes.push_back( undecided[i] );
+			}
+			else
+				next.push_back( undecided[i] );
+		}
+		r.decidedBoxes = (long long)( r.hitBoxes.size( ) + r.missBoxes.size( ) );
+		undecided.swap( next );
+
+		if( undecided.empty( ) || r.depth >= maxDepth || 2*(long long)undecided.size( ) > maxBoxes )
+			break;
+
+		next.clear( );
+		for( const Box &b : undecided )
+		{
+			int widest = 0;
+			for( int k = 1; k < BOX_DIMS; k++ )
+			{
+				if( b.hi[k] - b.lo[k] > b.hi[widest] - b.lo[widest] )
+					widest = k;
+			}
+			double mid = 0.5 * ( b.lo[widest] + b.hi[widest] );
+			Box left = b, right = b;
+			left.hi[widest]  = mid;
+			right.lo[widest] = mid;
+			next.push_back( left );
+			next.push_back( right );
+		}
+		undecided.swap( next );
+		r.depth++;
+	}
+	r.undecidedBoxes = (long long)undecided.size( );
+	for( const Box &b : undecided )
+		r.undecidedVolume += Volume( b );
+
+	// trials for each undecided box in proportion to its volume, numbered consecutively so each
+	// box's points come from their own Philox counters:
+	std::vector<long long> first( undecided.size( ) + 1, 0 );
+	for( size_t i = 0; i < undecided.size( ); i++ )
+	{
+		long long n = (long long)( (double)numTrials * Volume( undecided[i] ) / std::max( r.undecidedVolume, 1.e-300 ) );
+		first[i+1] = first[i] + std::max( n, (long long)MIN_BOX_TRIALS );
+	}
+	r.trials = first[ undecided.size( ) ];
+
+	double estimate = 0., variance = 0.;
+	#pragma omp parallel for schedule(dynamic,16) reduction(+:estimate,variance)
+	for( long long i = 0; i < (long long)undecided.size( ); i++ )
+	{
+		long long hits = 0;
+		for( long long n = first[i]; n < first[i+1]; n++ )
+		{
+			float x[BOX_DIMS];
+			PointInBox( undecided[i], seed, n, x );
+			hits += CastleHit( cp, x ) ? 1 : 0;
+		}
+		double trials = (double)( first[i+1] - first[i] );
+		double p = (double)hits / trials;
+		double vol = Volume( undecided[i] );
+		estimate += vol * p;
+		variance += vol * vol * p * ( 1. - p ) / trials;
+	}
+	r.probability = r.hitVolume + estimate;
+	r.variance = variance;
+	return r;
+}
+
+// sample pointsPerBox points in every proven box (at most maxBoxes of each kind) and count the
+// points where the float test disagrees with the proof:
+inline long long
+ValidateBoxes( const CastleProblem &cp, const SubdivisionResult &r, uint64_t seed, int pointsPerBox, long long maxBoxes, long long &checked )
+{
+	long long wrong = 0;
+	checked = 0;
+	for( int kind = 0; kind < 2; kind++ )
+	{
+		const std::vector<Box> &boxes = kind == 0 ? r.hitBoxes : r.missBoxes;
+		long long numBoxes = std::min( (long long)boxes.size( ), maxBoxes );
+		long long stride = numBoxes > 0 ? (long long)boxes.size( ) / numBoxes : 1;
+		#pragma omp parallel for reduction(+:wrong,checked)
+		for( long long i = 0; i < numBoxes; i++ )
+		{
+			for( int j = 0; j < pointsPerBox; j++ )
+			{
+				float x[BOX_DIMS];
+				long long n = ( ( kind * maxBoxes ) + i ) * pointsPerBox + j;
+				PointInBox( boxes[i*stride], seed ^ 0x5a5a5a5aULL, n, x );
+				if( CastleHit( cp, x ) != ( kind == 0 ) )
+					wrong++;
+				checked++;
+			}
+		}
+	}
+	return wrong;
+}
+
+#endif		// PROJECT1_BOXES_H
@@ -0,0 +1,183 @@
+/*
+ *
+ * Many castle-hit scenarios in one parallel pass.
+ *
+ * The parameter ranges in Project1.cpp are compile-time constants, so a what-if sweep meant one
+ * build and one process per scenario. Here a scenario is data:
+ *
+ *		# name     vmin vmax  thmin thmax  gmin gmax  hmin hmax  dmin dmax  [trials [tol [gravity]]]
+ *		baseline     20   30     70    80    10   20    20   30    10   20   1000000
+ *		tall-cliff   20   30     70    80    10   20    40   50    10   20
+ *
+ * ReadScenarios( ) parses a file of them and EvaluateScenarios( ) runs them all at once: every
+ * scenario is cut into blocks of SCENARIO_BLOCK trials, and the blocks of all the scenarios go
+ * into one OpenMP dynamic loop, so the team's threads work as a pool -- a thread that finishes a
+ * block takes the next one, whichever scenario it belongs to, and a few huge scenarios can't
+ * leave the other threads idle at the end. Each block runs through the same SIMD kernel as
+ * Project1 (trajectory.h), which takes the ranges at runtime.
+ *
+ * By default every scenario uses the same Philox stream -- trial n gets the same uniforms in
+ * every scenario, only scaled to its own ranges (common random numbers) -- so the difference
+ * between two similar scenarios is much less noisy than either probability. With independent
+ * streams, scenario s uses seed + s.
+ *
+ */
+
+#ifndef PROJECT1_CANNON_H
+#define PROJECT1_CANNON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include <string>
+#include <vector>
+
+#include "trajectory.h"
+
+#define SCENARIO_BLOCK			( 16 * TRIAL_BLOCK )	// trials per work item
+#define SCENARIO_DEFAULT_TRIALS	1000000LL
+#define SCENARIO_GRAVITY		-9.8f
+#define SCENARIO_TOL			5.0f
+
+struct CannonScenario
+{
+	std::string	name;
+	float		ranges[10];		// vmin, vmax, thmin, thmax (degrees), gmin, gmax, hmin, hmax, dmin, dmax
+	long long	trials;
+	float		tol;
+	float		gravity;
+};
+
+struct ScenarioResult
+{
+	long long	trials;
+	long long	hits;
+	double		probability;
+	double		stderror;		// binomial standard error of the probability
+};
+
+
+// one scenario per line, whitespace- or comma-separated; '#' starts a comment:
+inline bool
+ReadScenarios( const char *path, std::vector<CannonScenario> &scenarios, long long defaultTrials )
+{
+	FILE *fp = fopen( path, "r" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot open scenario file '%s'\n", path );
+		return false;
+	}
+
+	char line[1024];
+	int lineNumber = 0;
+	while( fgets( line, sizeof(line), fp ) != NULL )
+	{
+		lineNumber++;
+		char *hash = strchr( line, '#' );
+		if( hash != NULL )
+			*hash = '\0';
+
+		std::vector<char *> fields;
+		for( char *tok = strtok( line, " \t\r\n," ); tok != NULL; tok = strtok( NULL, " \t\r\n," ) )
+			fields.push_back( tok );
+		if( fields.empty( ) )
+			continue;
+		if( fields.size( ) < 11 || fields.size( ) > 14 )
+		{
+			fprintf( stderr, "%s:%d: expected a name, 10 range values, and optionally trials, tol and gravity\n", path, lineNumber );
+			fclose( fp );
+			return false;
+		}
+
+		CannonScenario s;
+		s.name    = fields[0];
+		s.trials  = defaultTrials;
+		s.tol     = SCENARIO_TOL;
+		s.gravity = SCENARIO_GRAVITY;
+		double values[13];
+		for( size_t k = 1; k < fields.size( ); k++ )
+		{
+			char *end;
+			values[k-1] = strtod( fields[k], &end );
+			if( *end != '\0' )
+			{
+				fprintf( stderr, "%s:%d: '%s' is not a number\n", path, lineNumber, fields[k] );
+				fclose( fp );
+				return false;
+			}
+		}
+		for( int k = 0; k < 10; k++ )
+			s.ranges[k] = (float)values[k];
+		if( fields.size( ) > 11 )
+			s.trials = (long long)values[10];
+		if( fields.size( ) > 12 )
+			s.tol = (float)values[11];
+		if( fields.size( ) > 13 )
+			s.gravity = (float)values[12];
+
+		bool ok = s.trials > 0 && s.gravity < 0.f && s.tol >= 0.f && s.ranges[2] > 0.f && s.ranges[3] < 90.f;
+		for( int k = 0; k < 10; k += 2 )
+			ok = ok && s.ranges[k] <= s.ranges[k+1];
+		if( ! ok )
+		{
+			fprintf( stderr, "%s:%d: scenario '%s' needs min <= max, angles inside (0,90), trials > 0, tol >= 0, gravity < 0\n",
+				path, lineNumber, s.name.c_str( ) );
+			fclose( fp );
+			return false;
+		}
+		scenarios.push_back( s );
+	}
+	fclose( fp );
+	return true;
+}
+
+// run every scenario with the given kernel on numThreads threads, all in one dynamic loop:
+inline std::vector<ScenarioResult>
+EvaluateScenarios( const std::vector<CannonScenario> &scenarios, const TrajectoryKernel &kernel, uint64_t seed,
+	bool independentStreams, int numThreads )
+{
+	struct WorkItem
+	{
+		int			scenario;
+		long long	first;
+		long long	count;
+	};
+	std::vector<WorkItem> work;
+	for( size_t s = 0; s < scenarios.size( ); s++ )
+	{
+		for( long long first = 0; first < scenarios[s].trials; first += SCENARIO_BLOCK )
+			work.push_back( { (int)s, first, std::min( (long long)SCENARIO_BLOCK, scenarios[s].trials - first ) } );
+	}
+
+	std::vector<long long> hits( work.size( ), 0 );
+	#pragma omp parallel for schedule(dynamic) num_threads( numThreads )
+	for( long long i = 0; i < (long long)work.size( ); i++ )
+	{
+		const WorkItem &w = work[i];
+		const CannonScenario &s = scenarios[w.scenario];
+		uint64_t key = independentStreams ? seed + (uint64_t)w.scenario : seed;
+		long long h = 0;
+		for( long long first = w.first; first < w.first + w.count; first += TRIAL_BLOCK )
+			h += kernel.hits( key, first, std::min( (long long)TRIAL_BLOCK, w.first + w.count - first ), s.ranges, s.gravity, s.tol );
+		hits[i] = h;
+	}
+
+	std::vector<ScenarioResult> results( scenarios.size( ) );
+	for( size_t s = 0; s < scenarios.size( ); s++ )
+	{
+		results[s].trials = scenarios[s].trials;
+		results[s].hits = 0;
+	}
+	for( size_t i = 0; i < work.size( ); i++ )
+		results[ work[i].scenario ].hits += hits[i];
+	for( ScenarioResult &r : results )
+	{
+		r.probability = (double)r.hits / (double)r.trials;
+		r.stderror = sqrt( r.probability * ( 1. - r.probability ) / (double)r.trials );
+	}
+	return results;
+}
+
+#endif		// PROJECT1_CANNON_H
@@ -0,0 +1,199 @@
+/*
+ *
+ * Branch-free SIMD version of the castle-hit test for Project #1.
+ *
+ * The scalar loop walks a chain of ifs (reaches the cliff? clears the face? lands within TOL of
+ * the castle?) and calls the double-precision cos( ), sin( ) and fabs( ) on float data, so the
+ * compiler can't vectorize it and the branch predictor guesses wrong on a good share of the
+ * trials. Here every trial evaluates every test, the tests become lane masks that are ANDed
+ * together, and the hits are counted by summing the masks -- nothing in the loop body branches,
+ * so "#pragma omp simd" runs 4, 8 or 16 trials per instruction:
+ *
+ *		hit = reachesCliff & clearsFace & ( disc >= 0 ) & ( |upperDist - d| <= TOL )
+ *
+ * The inputs come from the same Philox streams as the scalar loop (../Common/rng.h), and sin/cos
+ * from a Cephes-style polynomial FastSinCos( ) instead of libm, so the hit count can differ from
+ * the scalar one only for the few trials that land within rounding of a test's edge.
+ *
+ * As in Project #4, each vector width is compiled with __attribute__((target)) and the widest one
+ * the CPU supports is picked at startup (--simd sse|avx2|avx512 overrides it). Build with
+ * -fno-math-errno -fno-trapping-math (CMakeLists.txt and Project1.bash do): otherwise GCC has to
+ * keep sqrtf( )'s errno path and the float selects as branches, and the loop stays scalar.
+ *
+ */
+
+#ifndef PROJECT1_TRAJECTORY_H
+#define PROJECT1_TRAJECTORY_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "../Common/rng.h"
+#include "../Common/cpufeatures.h"
+
+#if defined(__GNUC__)
+#define TRAJECTORY_INLINE	__attribute__(( always_inline )) inline
+#else
+#define TRAJECTORY_INLINE	inline
+#endif
+
+#define TRIAL_BLOCK		4096		// trials per block handed to one thread
+
+
+// sin and cos of x together, branch-free (Cephes sinf/cosf coefficients, ~1 ulp on the range we use):
+TRAJECTORY_INLINE void
+FastSinCos( float x, float &s, float &c )
+{
+	const float FOPI = 1.27323954473516f;		// 4/pi
+	const float DP1  = 0.78515625f;				// pi/4 in three parts, so x - j*pi/4 stays exact
+	const float DP2  = 2.4187564849853515625e-4f;
+	const float DP3  = 3.77489497744594108e-8f;
+
+	float sign = x < 0.f ? -1.f : 1.f;
+	x = fabsf( x );
+
+	// which octant, rounded to an even one:
+	int j = (int)( x * FOPI );
+	j = ( j + 1 ) & ~1;
+	float y = (float)j;
+	x = ( ( x - y*DP1 ) - y*DP2 ) - y*DP3;
+
+	float z = x * x;
+	float cosPoly = ( ( 2.443315711809948e-5f * z - 1.388731625493765e-3f ) * z + 4.166664568298827e-2f ) * z * z - 0.5f * z + 1.f;
+	float sinPoly = ( ( -1.9515295891e-4f * z + 8.3321608736e-3f ) * z - 1.6666654611e-1f ) * z * x + x;
+
+	// octants 2 and 6 swap the polynomials, 4..7 flip sin's sign, 2..5 flip cos's:
+	bool swap = ( j & 2 ) != 0;
+	float sinSign = ( j & 4 ) != 0 ? -sign : sign;
+	float cosSign = ( ( j - 2 ) & 4 ) == 0 ? -1.f : 1.f;
+	s = sinSign * ( swap ? cosPoly : sinPoly );
+	c = cosSign * ( swap ? sinPoly : cosPoly );
+}
+
+// does the trial with counter ( lo, hi ) hit the castle? (same physics as the scalar loop, every
+// test evaluated; the five uniforms are the ones PhiloxFiveUniforms( ) gives trial hi:lo):
+TRAJECTORY_INLINE int
+TrialHits( uint32_t lo, uint32_t hi, uint32_t k0, uint32_t k1, const float ranges[10], float gravity, float tol )
+{
+	uint32_t b0 = lo, b1 = hi, b2 = 0, b3 = 0;
+	PhiloxRounds( b0, b1, b2, b3, k0, k1 );
+	float v   = Scale( UniformFloat( b0 ), ranges[0], ranges[1] );
+	float thr = (float)M_PI/180.f * Scale( UniformFloat( b1 ), ranges[2], ranges[3] );
+	float g   = Scale( UniformFloat( b2 ), ranges[4], ranges[5] );
+	float h   = Scale( UniformFloat( b3 ), ranges[6], ranges[7] );
+	float d   = Scale( UniformFloat( ( b0 & 0xff ) << 24 | ( b1 & 0xff ) << 16 | ( b2 & 0xff ) << 8 ), ranges[8], ranges[9] );
+
+	float sn, cs;
+	FastSinCos( thr, sn, cs );
+	float vx = v * cs;
+	float vy = v * sn;
+
+	// does the ball reach the cliff?
+	float t = -vy / ( 0.5f * gravity );
+	bool reaches = vx * t > g;
+
+	// does it clear the cliff face?
+	t = g / vx;
+	bool clears = vy * t + 0.5f * gravity * t * t > h;
+
+	// where does it come down on the upper deck?
+	float A = 0.5f * gravity;
+	float B = vy;
+	float C = -h;
+	float disc = B*B - 4.f*A*C;
+	float sqrtdisc = sqrtf( disc > 0.f ? disc : 0.f );
+	float t1 = ( -B + sqrtdisc ) / ( 2.f*A );
+	float t2 = ( -B - sqrtdisc ) / ( 2.f*A );
+	float upperDist = vx * ( t1 > t2 ? t1 : t2 ) - g;
+	bool lands = fabsf( upperDist - d ) <= tol;
+
+	return (int)( reaches & clears & ( disc >= 0.f ) & lands );
+}
+
+// the hits in trials first .. first+count-1 (count <= TRIAL_BLOCK), one vector of trials at a
+// time. The lane index is 32 bits so the vectors hold 16 trials, not 8 64-bit counters; the
+// high counter word is carried if the block crosses a multiple of 2^32:
+#define TRAJECTORY_BODY												\
+	uint32_t lo0 = (uint32_t)first;									\
+	uint32_t hi0 = (uint32_t)( (uint64_t)first >> 32 );				\
+	uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)( seed >> 32 );	\
+	int n = (int)count;												\
+	int hits = 0;													\
+	_Pragma( "omp simd reduction(+:hits)" )							\
+	for( int j = 0; j < n; j++ )									\
+	{																\
+		uint32_t lo = lo0 + (uint32_t)j;							\
+		uint32_t hi = hi0 + ( lo < lo0 ? 1u : 0u );					\
+		hits += TrialHits( lo, hi, k0, k1, ranges, gravity, tol );	\
+	}																\
+	return hits;
+
+typedef long long	(*HitsFunc)( uint64_t, long long, long long, const float *, float, float );
+
+inline long long
+SseHits( uint64_t seed, long long first, long long count, const float *ranges, float gravity, float tol )
+{
+	TRAJECTORY_BODY
+}
+
+#if defined(__GNUC__) && HAVE_CPUID
+__attribute__(( target( "avx2,fma" ) )) inline long long
+Avx2Hits( uint64_t seed, long long first, long long count, const float *ranges, float gravity, float tol )
+{
+	TRAJECTORY_BODY
+}
+
+__attribute__(( target( "avx512f,avx512dq" ) )) inline long long
+Avx512Hits( uint64_t seed, long long first, long long count, const float *ranges, float gravity, float tol )
+{
+	TRAJECTORY_BODY
+}
+#endif
+
+struct TrajectoryKernel
+{
+	const char *	name;
+	int				width;		// trials per instruction
+	HitsFunc		hits;
+};
+
+// the widths this CPU can run, narrowest first:
+inline std::vector<TrajectoryKernel>
+TrajectoryKernels( )
+{
+	std::vector<TrajectoryKernel> kernels;
+	kernels.push_back( { "sse", 4, SseHits } );
+#if defined(__GNUC__) && HAVE_CPUID
+	const CpuFeatures &cpu = GetCpuFeatures( );
+	if( cpu.avx2 && cpu.fma )
+		kernels.push_back( { "avx2", 8, Avx2Hits } );
+	if( cpu.avx512f && cpu.avx512dq )			// Avx512Hits is built for both
+		kernels.push_back( { "avx512", 16, Avx512Hits } );
+#endif
+	return kernels;
+}
+
+// the named kernel, or the widest if name is "best"; false if it can't run here:
+inline bool
+SelectTrajectoryKernel( const char *name, TrajectoryKernel &kernel )
+{
+	std::vector<TrajectoryKernel> kernels = TrajectoryKernels( );
+	if( strcmp( name, "best" ) == 0 )
+	{
+		kernel = kernels.back( );
+		return true;
+	}
+	for( TrajectoryKernel &k : kernels )
+	{
+		if( strcmp( k.name, name ) == 0 )
+		{
+			kernel = k;
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif		// PROJECT1_TRAJECTORY_H
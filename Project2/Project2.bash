@@ -1,5 +1,25 @@
 #!/bin/bash
 
-g++ Project2.cpp -o Project2  -lm -fopenmp
+g++ -DBUILD_FLAGS="\"-fopenmp\"" Project2.cpp -o Project2  -lm -fopenmp
 ./Project2
 rm ./Project2
+
+# months/sec with the original three barriers a month, with the one, and as a task graph:
+g++ -O3 -std=c++17 -DBUILD_FLAGS="\"-O3 -std=c++17 -fopenmp\"" Project2.cpp -o Project2  -lm -fopenmp
+./Project2 --sync three,one,tasks --quiet --months 200000
+rm ./Project2
+
+# the months to a file, every 12th, through the background writer:
+g++ -O3 -std=c++17 -DBUILD_FLAGS="\"-O3 -std=c++17 -fopenmp\"" Project2.cpp -o Project2  -lm -fopenmp
+./Project2 --months 1200 --every 12 --output months.csv
+rm ./Project2
+
+# a million farms at once:
+g++ -O3 -std=c++17 -fno-math-errno -fno-trapping-math -DBUILD_FLAGS="\"-O3 -std=c++17 -fno-math-errno -fno-trapping-math -fopenmp\"" Project2.cpp -o Project2  -lm -fopenmp
+./Project2 --ensemble 1000000 --threads 1,2,4,8
+rm ./Project2
+
+# barrier latency versus thread count:
+g++ -O3 -std=c++17 -DBUILD_FLAGS="\"-O3 -std=c++17 -fopenmp\"" barrierbench.cpp -o barrierbench  -lm -fopenmp
+./barrierbench --threads 1,2,4,8,16
+rm ./barrierbench
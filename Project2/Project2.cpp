@@ -15,55 +15,91 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <omp.h>
 
+#include "../Common/driver.h"
+#include "../Common/timing.h"
+#include "../Common/results.h"
+#include "barriers.h"
+#include "model.h"
+#include "ensemble.h"
+#include "agents.h"
+#include "recorder.h"
+
 #ifndef DEBUG
 #define DEBUG		false
 #endif
 
 unsigned int seed = 0;
-int	    NowYear;		// 2025- 2030
-int	    NowMonth;		// 0 - 11
-int 	TotalMonth;
-
-float	NowPrecip;		// inches of rain per month
-float	NowTemp;		// temperature this month
-float	NowHeight;		// grain height in inches
-int	    NowNumDeer;		// number of deer in the current population
-int 	NowNumWolf;		// number of wolves in the current population
-
-const float GRAIN_GROWS_PER_MONTH     =	    100.0;
-const float ONE_DEER_EATS_PER_MONTH   =		1.0;
-
-const float AVG_PRECIP_PER_MONTH      =		15.0;	// average
-const float AMP_PRECIP_PER_MONTH      =		6.0;	// plus or minus
-const float RANDOM_PRECIP             =		2.0;	// plus or minus noise
-
-const float AVG_TEMP                  =		60.0;	// average
-const float AMP_TEMP                  =		20.0;	// plus or minus
-const float RANDOM_TEMP               =		10.0;	// plus or minus noise
-
-const float MIDTEMP                   =		40.0;
-const float MIDPRECIP                 =	    10.0;
-
-// Constants for Lotka-Volterra model that simulates the prey/predator relationship between deer and wolves:
-const float ALPHA = 0.3;		// growth rate of the prey (deer)
-const float BETA  = 0.015;		// death rate of the prey (deer)
-const float DELTA =	0.01;		// growth rate of the predator (wolf)
-const float GAMMA = 0.9;		// death rate of the predator (wolf)
-const float DT	  = 1;			// time step - 1 month
-
-// Variables for the custom barriers:
-omp_lock_t		Lock;
-volatile int	NumInThreadTeam;
-volatile int	NumAtBarrier;
-volatile int	NumGone;
+
+// The state of the farm for one month:
+struct State
+{
+	int	    year;			// 2025- 2030
+	int	    month;			// 0 - 11
+	int 	totalMonth;
+
+	float	precip;			// inches of rain per month
+	float	temp;			// temperature this month
+	float	height;			// grain height in inches
+	int	    numDeer;		// number of deer in the current population
+	int 	numWolf;		// number of wolves in the current population
+};
+
+// The two snapshots take turns: in step s, Snapshot[s&1] is this month's state, which nobody
+// changes, and every agent writes its own fields of next month's into Snapshot[(s+1)&1]. So one
+// barrier a month is enough -- once everyone is through it, the two swap roles (each thread flips
+// its own index, so there is nothing shared to swap). With --sync three the agents instead work
+// in place on Snapshot[0] with the original three barriers a month (compute, assign, print), and
+// with --sync tasks they are scheduled as a task graph (agents.h) with no barriers at all:
+enum SyncKind
+{
+	SYNC_ONE,
+	SYNC_THREE,
+	SYNC_TASKS
+};
+const char *SyncNames[ ] = { "one", "three", "tasks" };
+
+State		Snapshot[2];
+int			NumMonths;		// how long to run -- 72 months is 2025 - 2030
+bool		Quiet;			// don't print the months, just time them
+SyncKind	Sync;
+
+// The custom barrier (barriers.h) -- central, tree or dissemination, picked with --barrier:
+BarrierKind		Kind = BARRIER_CENTRAL;
+Barrier			TheBarrier;
 
 // Functions for the custom barriers:
 void InitBarrier( int n );
 void WaitBarrier( );
 
+// The ensemble mode (ensemble.h):
+#define ENSEMBLE_MONTHS		72		// 2025 - 2030, like the single farm
+bool RunEnsemble( int numFarms, int months, int numt, uint64_t seed, bool printMonths, uint64_t &checksum );
+
+// The single farm, --sync one|three|tasks (or a list of them):
+#define FARM_MONTHS		72
+void   InitFarm( );
+double RunFarm( SyncKind sync, int numt );
+void   AddFarmAgents( AgentModel<State> &model );
+
+// The Watcher's output: the months go through a ring to a background writer (recorder.h), to
+// --output FILE (stderr if not given) as --format csv or binary, every --every months; --direct
+// prints them from the Watcher itself, the way it used to:
+Recorder<State>	Output;
+int				Every = 1;
+bool			Direct;
+int FormatMonth( char *line, size_t size, const State &month );
+
+// The next month's value of each agent's part of the state:
+int   NextNumDeer( const State &now );
+int   NextNumWolf( const State &now );
+float NextHeight( const State &now );
+void  NextMonth( const State &now, State &next );
+void  PrintMonth( const State &when, const State &farm );
+
 // Functions for the tasks for grain-growing operations:
 void Deer( );
 void Grain( );
@@ -78,29 +114,238 @@ float SQR( float x);
 // Main program:
 int main( int argc, char *argv[ ] ) {
 
+	// --ensemble N[,N...] simulates that many independent farms at once instead of the one farm:
+	if( ArgValue( argc, argv, "--ensemble" ) != NULL )
+	{
+		std::vector<long long> farms   = ArgList( argc, argv, "--ensemble", { 1000000 } );
+		std::vector<long long> threads = ArgList( argc, argv, "--threads",  { omp_get_num_procs( ) } );
+		int months    = (int) ArgInt( argc, argv, "--months", ENSEMBLE_MONTHS );
+		uint64_t seed = (uint64_t) ArgInt( argc, argv, "--seed", 0 );
+		OpenResults( argc, argv );
+
+		bool ok = true;
+		for( long long numFarms : farms )
+		{
+			if( numFarms > 0x7fffffff )
+			{
+				fprintf( stderr, "At most %d farms, got %lld\n", 0x7fffffff, numFarms );
+				return 1;
+			}
+			uint64_t reference = 0;
+			for( size_t i = 0; i < threads.size( ); i++ )
+			{
+				// the month-by-month statistics only for the first thread count -- they're the same for all:
+				uint64_t checksum;
+				ok = RunEnsemble( (int)numFarms, months, (int)threads[i], seed, i == 0, checksum ) && ok;
+				if( i == 0 )
+					reference = checksum;
+				else if( checksum != reference )
+				{
+					fprintf( stderr, "    %lld threads gave a different ensemble than %lld threads!\n", threads[i], threads[0] );
+					ok = false;
+				}
+			}
+		}
+		CloseResults( );
+		return ok ? 0 : 1;
+	}
+
+	OpenResults( argc, argv );
+
+	const char *barrierName = ArgString( argc, argv, "--barrier", "central" );
+	if( ! BarrierFromName( barrierName, Kind ) )
+	{
+		fprintf( stderr, "Unknown barrier '%s' -- use central, tree or dissemination\n", barrierName );
+		return 1;
+	}
+
+	// --sync three,one,tasks runs the farm each way in turn and checks that they all end up with
+	// the same farm ("both" is three,one):
+	std::string syncList = ArgString( argc, argv, "--sync", "one" );
+	if( syncList == "both" )
+		syncList = "three,one";
+	std::vector<SyncKind> syncs;
+	for( size_t start = 0; start < syncList.size( ); )
+	{
+		size_t comma = syncList.find( ',', start );
+		std::string name = syncList.substr( start, comma == std::string::npos ? std::string::npos : comma - start );
+		start = comma == std::string::npos ? syncList.size( ) : comma + 1;
+
+		int k = 0;
+		while( k < 3  &&  name != SyncNames[k] )
+			k++;
+		if( k == 3 )
+		{
+			fprintf( stderr, "Unknown --sync '%s' -- use one, three, tasks or a list of them\n", name.c_str( ) );
+			return 1;
+		}
+		syncs.push_back( (SyncKind)k );
+	}
+	NumMonths = (int) ArgInt( argc, argv, "--months", FARM_MONTHS );
+	Quiet = ArgFlag( argc, argv, "--quiet" );
+	int numt = (int) ArgInt( argc, argv, "--threads", omp_get_num_procs( ) );		// for --sync tasks
+
+	const char *outputName = ArgString( argc, argv, "--output", "-" );
+	std::string format = ArgString( argc, argv, "--format", "csv" );
+	Every  = (int) ArgInt( argc, argv, "--every", 1 );
+	Direct = ArgFlag( argc, argv, "--direct" );
+	if( ( format != "csv"  &&  format != "binary" )  ||  Every < 1 )
+	{
+		fprintf( stderr, "Use --format csv or binary, and --every 1 or more\n" );
+		return 1;
+	}
+	if( format == "binary"  &&  ( Direct  ||  strcmp( outputName, "-" ) == 0 ) )
+	{
+		fprintf( stderr, "--format binary needs an --output file, and can't be --direct\n" );
+		return 1;
+	}
+	if( Direct  &&  strcmp( outputName, "-" ) != 0 )
+	{
+		fprintf( stderr, "--direct prints to stderr -- leave out --output\n" );
+		return 1;
+	}
+
+	bool ok = true;
+	bool rates = Quiet  ||  syncs.size( ) > 1  ||  strcmp( outputName, "-" ) != 0;	// the months/sec lines would break up the CSV
+	State first = { };
+	for( size_t i = 0; i < syncs.size( ); i++ )
+	{
+		if( ! Quiet  &&  ! Direct  &&  ! Output.Open( outputName, format == "binary", FormatMonth ) )
+			return 1;
+		double monthsPerSecond = RunFarm( syncs[i], numt );
+		if( Output.IsOpen( ) )
+		{
+			Output.Close( );
+			if( Output.stalls > 0 )
+				fprintf( stderr, "    the output fell %d months behind %lld times\n", RECORDER_RING, Output.stalls );
+		}
+		const State &last = Snapshot[ syncs[i] == SYNC_THREE ? 0 : NumMonths & 1 ];
+		if( rates )
+		{
+			char how[32];
+			if( syncs[i] == SYNC_TASKS )
+				snprintf( how, sizeof how, "%d threads", numt );
+			else
+				snprintf( how, sizeof how, "%s", syncs[i] == SYNC_THREE ? "3 barriers/month" : "1 barrier/month" );
+			fprintf( stderr, "%-14s , %-17s , %6d months , %10.0lf months/sec\n",
+				syncs[i] == SYNC_TASKS ? "task graph" : BarrierName( Kind ), how, NumMonths, monthsPerSecond );
+		}
+		Quiet = true;		// print the months only once
+
+		if( i == 0 )
+			first = last;
+		else if( last.numDeer != first.numDeer || last.numWolf != first.numWolf || last.height != first.height )
+		{
+			fprintf( stderr, "    --sync %s ended with %d deer, %d wolves, %.2f inches -- %s had %d, %d, %.2f\n",
+				SyncNames[ syncs[i] ], last.numDeer, last.numWolf, last.height,
+				SyncNames[ syncs[0] ], first.numDeer, first.numWolf, first.height );
+			ok = false;
+		}
+	}
+	CloseResults( );
+
+	return ok ? 0 : 1;
+}
+
+/*
+ * Set the farm up for month 0 (feel free to change the starting state if you want)
+ */
+void InitFarm( ) {
+	srand( 1 );			// every run of the farm gets the same weather
+
+	State &now = Snapshot[0];
+
 	// starting date and time:
-	NowMonth   = 0;
-    TotalMonth = 0;
-	NowYear    = 2025;
+	now.month      = 0;
+	now.totalMonth = 0;
+	now.year       = 2025;
 
-	// starting state (feel free to change this if you want):
-	NowNumDeer = 20;
-    NowNumWolf = 5;
-	NowHeight  = 300.;
+	// starting state:
+	now.numDeer = 20;
+	now.numWolf = 5;
+	now.height  = 300.;
 
-    // starting temperature and precipitation
-	float ang = (  30.*(float)NowMonth + 15.  ) * ( M_PI / 180. );
+	// starting temperature and precipitation
+	float ang = (  30.*(float)now.month + 15.  ) * ( M_PI / 180. );
 
 	float temp = AVG_TEMP - AMP_TEMP * cos( ang );
-	NowTemp = temp + Ranf( -RANDOM_TEMP, RANDOM_TEMP );
+	now.temp = temp + Ranf( -RANDOM_TEMP, RANDOM_TEMP );
 
 	float precip = AVG_PRECIP_PER_MONTH + AMP_PRECIP_PER_MONTH * sin( ang );
-	NowPrecip = precip + Ranf( -RANDOM_PRECIP, RANDOM_PRECIP );
-	if( NowPrecip < 0. )
-		NowPrecip = 0.;
+	now.precip = precip + Ranf( -RANDOM_PRECIP, RANDOM_PRECIP );
+	if( now.precip < 0. )
+		now.precip = 0.;
 
+	Snapshot[1] = now;
+}
+
+/*
+ * The farm's agents for --sync tasks: what each one reads and writes, and its step
+ * (a new species is one more field and one more agent here)
+ */
+void AddFarmAgents( AgentModel<State> &model ) {
+	for( const char *field : { "date", "temp", "precip", "height", "deer", "wolves" } )
+		model.Field( field );
+
+	model.Add( "Watcher", { "date" }, { "date", "temp", "precip" },
+		[ ]( const State &now, State &next ) { NextMonth( now, next ); } );
+	model.Add( "Grain", { "temp", "precip", "height", "deer" }, { "height" },
+		[ ]( const State &now, State &next ) { next.height = NextHeight( now ); } );
+	model.Add( "Deer", { "height", "deer", "wolves" }, { "deer" },
+		[ ]( const State &now, State &next ) { next.numDeer = NextNumDeer( now ); } );
+	model.Add( "Wolf", { "deer", "wolves" }, { "wolves" },
+		[ ]( const State &now, State &next ) { next.numWolf = NextNumWolf( now ); } );
+}
+
+/*
+ * Run the farm for NumMonths months -- on four threads, one per agent, with the chosen barrier,
+ * or as a task graph on numt threads; return the months/sec:
+ */
+double RunFarm( SyncKind sync, int numt ) {
+	InitFarm( );
+	Sync = sync;
+
+	if( sync == SYNC_TASKS ) {
+		AgentModel<State> model;
+		AddFarmAgents( model );
+		if( ! model.Check( ) )
+			return 0.;
+
+		double time0 = omp_get_wtime( );
+		if( Quiet )
+			model.Run( Snapshot, NumMonths, numt );
+		else
+			model.Run( Snapshot, NumMonths, numt, [ ]( const State &before, const State &after, int ) { PrintMonth( before, after ); } );
+		double time1 = omp_get_wtime( );
+
+		std::vector<double> times = { time1 - time0 };
+		const State &last = Snapshot[ NumMonths & 1 ];
+
+		Result r;
+		r.benchmark = "Project2";
+		r.kernel    = "grain/deer/wolf simulation/tasks";
+		r.threads   = numt;
+		r.size      = last.totalMonth;
+		r.unit      = "months";
+		r.rate      = (double)last.totalMonth / ( time1 - time0 );
+		r.rateUnit  = "Months/Sec";
+		r.timing    = Summarize( times, 1 );
+		r.checked   = true;
+		r.passed    = last.numDeer >= 0 && last.numWolf >= 0 && last.height >= 0.;
+		r.check     = "populations and grain height never negative";
+		r.extra.push_back( { "agents", (double)model.agents.size( ) } );
+		r.extra.push_back( { "final_deer",   (double)last.numDeer } );
+		r.extra.push_back( { "final_wolves", (double)last.numWolf } );
+		r.extra.push_back( { "final_height", (double)last.height } );
+		EmitResult( r );
+
+		return (double)last.totalMonth / ( time1 - time0 );
+	}
+
+	bool threeBarriers = sync == SYNC_THREE;
 	omp_set_num_threads( 4 );	// same as # of sections
 	InitBarrier( 4 );
+	double time0 = omp_get_wtime( );
 	#pragma omp parallel sections
 	{
 		#pragma omp section
@@ -124,101 +369,288 @@ int main( int argc, char *argv[ ] ) {
 		}
 	}       // implied barrier -- all functions must return in order
 			// to allow any of them to get past here
-	return 0;
+	double time1 = omp_get_wtime( );
+
+	// the whole run is one sample:
+	std::vector<double> times = { time1 - time0 };
+	const State &last = Snapshot[ threeBarriers ? 0 : NumMonths & 1 ];
+
+	Result r;
+	r.benchmark = "Project2";
+	r.kernel    = std::string( "grain/deer/wolf simulation/" ) + BarrierName( Kind ) + ( threeBarriers ? "/3 barriers" : "/1 barrier" );
+	r.threads   = 4;
+	r.size      = last.totalMonth;
+	r.unit      = "months";
+	r.rate      = (double)last.totalMonth / ( time1 - time0 );
+	r.rateUnit  = "Months/Sec";
+	r.timing    = Summarize( times, 1 );
+	r.checked   = true;
+	r.passed    = last.numDeer >= 0 && last.numWolf >= 0 && last.height >= 0.;
+	r.check     = "populations and grain height never negative";
+	r.extra.push_back( { "barriers_per_month", threeBarriers ? 3. : 1. } );
+	r.extra.push_back( { "final_deer",   (double)last.numDeer } );
+	r.extra.push_back( { "final_wolves", (double)last.numWolf } );
+	r.extra.push_back( { "final_height", (double)last.height } );
+	EmitResult( r );
+
+	return (double)last.totalMonth / ( time1 - time0 );
 }
 
 /*
- * Handle the task of updating the number of deers based on the current state
+ * Simulate numFarms farms for the given number of months on numt threads, a month of all of them
+ * per sweep; print the throughput (and the statistics for every month, if asked):
  */
-void Deer( ) {
-	int nextNumDeer, carryingCapacity;
-	while ( NowYear < 2031 ) {
+bool RunEnsemble( int numFarms, int months, int numt, uint64_t seed, bool printMonths, uint64_t &checksum ) {
+	omp_set_num_threads( numt );
+
+	Ensemble e;
+	InitEnsemble( e, numFarms, seed );
+
+	std::vector<EnsembleStats> stats;
+	stats.reserve( months );
+	std::vector<double> monthTimes;
+	double time0 = omp_get_wtime( );
+	for( int m = 0; m < months; m++ ) {
+		double t0 = omp_get_wtime( );
+		stats.push_back( StepEnsemble( e ) );
+		monthTimes.push_back( omp_get_wtime( ) - t0 );
+	}
+	double time1 = omp_get_wtime( );
+	checksum = EnsembleChecksum( e );
+
+	if( printMonths ) {
+		fprintf( stderr, "month, precip, temp, height (mean sd), deer (mean sd min max), wolves (mean sd min max), no deer, no wolves\n" );
+		for( const EnsembleStats &st : stats )
+			fprintf( stderr, "%4d, %6.2lf, %6.2lf, %7.2lf, %7.2lf, %7.2lf, %6.2lf, %4d, %4d, %6.2lf, %6.2lf, %4d, %4d, %5.3lf, %5.3lf\n",
+				st.totalMonth, st.meanPrecip, st.meanTemp, st.meanHeight, st.sdHeight,
+				st.meanDeer, st.sdDeer, st.minDeer, st.maxDeer, st.meanWolf, st.sdWolf, st.minWolf, st.maxWolf,
+				st.noDeer, st.noWolves );
+	}
 
-		nextNumDeer = NowNumDeer;
-		carryingCapacity = (int)( NowHeight );
+	double farmMonthsPerSecond = (double)numFarms * (double)months / ( time1 - time0 );
+	fprintf( stderr, "%10d farms , %2d threads , %4d months , %10.2lf MegaFarmMonths/Sec\n",
+		numFarms, numt, months, farmMonthsPerSecond / 1000000. );
+
+	// the populations and the grain can never go negative:
+	bool passed = true;
+	for( const EnsembleStats &st : stats )
+		passed = passed && st.minDeer >= 0 && st.minWolf >= 0 && st.meanHeight >= 0.;
+
+	Result r;
+	r.benchmark = "Project2";
+	r.kernel    = "grain/deer/wolf ensemble";
+	r.threads   = numt;
+	r.size      = numFarms;
+	r.unit      = "farms";
+	r.rate      = farmMonthsPerSecond / 1000000.;
+	r.rateUnit  = "MegaFarmMonths/Sec";
+	r.timing    = Summarize( monthTimes, 1 );
+	r.checked   = true;
+	r.passed    = passed;
+	r.check     = "populations and grain height never negative";
+	r.extra.push_back( { "months", (double)months } );
+	r.extra.push_back( { "final_mean_deer",   stats.empty( ) ? 0. : stats.back( ).meanDeer } );
+	r.extra.push_back( { "final_mean_wolves", stats.empty( ) ? 0. : stats.back( ).meanWolf } );
+	r.extra.push_back( { "final_no_deer",     stats.empty( ) ? 0. : stats.back( ).noDeer } );
+	EmitResult( r );
+
+	return passed;
+}
 
-		// Lotka-Volterra equation for the prey population
-		int deltaDeer =  ( ALPHA * (float)NowNumDeer - BETA * (float)NowNumDeer * (float)NowNumWolf) * (float)DT;
-		nextNumDeer += deltaDeer;
+/*
+ * The number of deer next month, from the state this month
+ */
+int NextNumDeer( const State &now ) {
+	int nextNumDeer = now.numDeer;
+	int carryingCapacity = (int)( now.height );
 
-		if( nextNumDeer < carryingCapacity )
-			nextNumDeer++;
-		else if( nextNumDeer > carryingCapacity )
-			nextNumDeer--;
+	// Lotka-Volterra equation for the prey population
+	int deltaDeer =  ( ALPHA * (float)now.numDeer - BETA * (float)now.numDeer * (float)now.numWolf) * (float)DT;
+	nextNumDeer += deltaDeer;
 
-		if( nextNumDeer < 0 )
-			nextNumDeer = 0;		// clamp nextNumDeer against zero
+	if( nextNumDeer < carryingCapacity )
+		nextNumDeer++;
+	else if( nextNumDeer > carryingCapacity )
+		nextNumDeer--;
 
-		WaitBarrier(); 				// DoneComputing barrier
+	if( nextNumDeer < 0 )
+		nextNumDeer = 0;		// clamp nextNumDeer against zero
 
-		NowNumDeer = nextNumDeer;
+	return nextNumDeer;
+}
 
-		WaitBarrier();				// DoneAssigning barrier
+/*
+ * The number of wolves next month, from the state this month
+ */
+int NextNumWolf( const State &now ) {
+	int nextNumWolf = now.numWolf;
+	int carryingCapacity = now.numDeer;
 
-		WaitBarrier();				// DonePrinting barrier
+	// Lotka-Volterra equation for the predator population
+	int deltaWolf =  (DELTA * (float)now.numDeer * (float)now.numWolf - GAMMA * (float)now.numWolf) * (float)DT;
+	nextNumWolf += deltaWolf;
 
+	if( nextNumWolf > carryingCapacity )
+		nextNumWolf--;
+	else if ( nextNumWolf < carryingCapacity )
+		nextNumWolf++;
 
-	}
+	if( nextNumWolf < 0 )
+		nextNumWolf = 0;		// clamp nextNumWolf against zero
+
+	return nextNumWolf;
 }
 
 /*
- * Handle the task of updating the number of wolves based on the current state
+ * The height of the grain next month, from the state this month
  */
-void Wolf( ) {
-	int nextNumWolf, carryingCapacity;
-	while ( NowYear < 2031 ) {
-
-		nextNumWolf = NowNumWolf;
-		carryingCapacity = NowNumDeer;
+float NextHeight( const State &now ) {
+	float tempFactor = exp( -SQR(  ( now.temp - MIDTEMP ) / 10. ) );
+	float precipFactor = exp( -SQR(  ( now.precip - MIDPRECIP ) / 10.  ) );
 
-        // Lotka-Volterra equation for the predator population
-        int deltaWolf =  (DELTA * (float)NowNumDeer * (float)NowNumWolf - GAMMA * (float)NowNumWolf) * (float)DT;
-		nextNumWolf += deltaWolf;
+	float nextHeight = now.height;
+	nextHeight += tempFactor * precipFactor * GRAIN_GROWS_PER_MONTH;
+	nextHeight -= (float)now.numDeer * ONE_DEER_EATS_PER_MONTH;
 
-		if( nextNumWolf > carryingCapacity )
-			nextNumWolf--;
-        else if ( nextNumWolf < carryingCapacity )
-          	nextNumWolf++;
+	if ( nextHeight < 0. )
+		nextHeight = 0.;		// clamp nextHeight against zero
 
-		if( nextNumWolf < 0 )
-			nextNumWolf = 0;		// clamp nextNumWolf against zero
-
-		WaitBarrier(); 				// DoneComputing barrier
+	return nextHeight;
+}
 
-		NowNumWolf = nextNumWolf;
+/*
+ * Set next month's date and weather from this month's -- only those fields of next are written,
+ * and now may be next
+ */
+void NextMonth( const State &now, State &next ) {
+	// increment time accordingly:
+	int month = now.month + 1;
+	int year  = now.year;
+	if ( month > 11 ) {
+		year++;
+		month = 0;
+	}
+	next.year       = year;
+	next.month      = month;
+	next.totalMonth = now.totalMonth + 1;
 
-		WaitBarrier();				// DoneAssigning barrier
+	// calculate new environment variables and update them:
+	float ang = (  30.*(float)month + 15.  ) * ( M_PI / 180. );
 
-		WaitBarrier();				// DonePrinting barrier
+	float temp = AVG_TEMP - AMP_TEMP * cos( ang );
+	next.temp = temp + Ranf( -RANDOM_TEMP, RANDOM_TEMP );
 
+	float precip = AVG_PRECIP_PER_MONTH + AMP_PRECIP_PER_MONTH * sin( ang );
+	next.precip = precip + Ranf( -RANDOM_PRECIP, RANDOM_PRECIP );
+	if( next.precip < 0. )
+		next.precip = 0.;
+}
 
+/*
+ * Record a month: its date and weather from when, and the grain and herds that came of it from farm
+ */
+void PrintMonth( const State &when, const State &farm ) {
+	if( Quiet  ||  when.totalMonth % Every != 0 )
+		return;
+
+	// only the date and weather from when -- with --sync one the agents are writing its grain and
+	// herds right now:
+	State month = farm;
+	month.year       = when.year;
+	month.month      = when.month;
+	month.totalMonth = when.totalMonth;
+	month.temp       = when.temp;
+	month.precip     = when.precip;
+	if( Direct ) {
+		char line[256];
+		FormatMonth( line, sizeof line, month );
+		fputs( line, stderr );
 	}
+	else
+		Output.Push( month );
 }
 
 /*
- * Handle the task of updating the height of the grain based on the current state
+ * Format a month's line of output, like snprintf( )
  */
-void Grain( ) {
-	float tempFactor, precipFactor, nextHeight;
-	while ( NowYear < 2031 ) {
-
-		float tempFactor = exp( -SQR(  ( NowTemp - MIDTEMP ) / 10. ) );
-		float precipFactor = exp( -SQR(  ( NowPrecip - MIDPRECIP ) / 10.  ) );
+int FormatMonth( char *line, size_t size, const State &month ) {
+#define CSV
+#ifdef  CSV
+	return snprintf(line, size, "%4d, %6.2lf, %6.2lf, %6.2lf, %4d, %4d\n",
+		month.totalMonth, month.precip, month.temp, month.height, month.numDeer, month.numWolf);
+#else
+	if ( DEBUG )
+		return snprintf(line, size, "Year: %4d, Month: %2d, Total Month: %2d, Precip (inches): %6.2lf, Temp (°F): %6.2lf, Height: %6.2lf, Deer #: %4d, Wolf #: %4d\n",
+			month.year, month.month+1, month.totalMonth, month.precip, month.temp, month.height, month.numDeer, month.numWolf);
+	else
+		return snprintf(line, size, "%4d, %2d, %2d, %6.2lf, %6.2lf, %6.2lf, %4d, %4d\n",
+			month.year, month.month+1, month.totalMonth, month.precip, month.temp, month.height, month.numDeer, month.numWolf);
+#endif
+}
 
-		nextHeight = NowHeight;
-		nextHeight += tempFactor * precipFactor * GRAIN_GROWS_PER_MONTH;
-		nextHeight -= (float)NowNumDeer * ONE_DEER_EATS_PER_MONTH;
+/*
+ * Handle the task of updating the number of deers based on the current state
+ */
+void Deer( ) {
+	if ( Sync == SYNC_THREE ) {
+		State &now = Snapshot[0];
+		while ( now.totalMonth < NumMonths ) {
+			int nextNumDeer = NextNumDeer( now );
+			WaitBarrier(); 				// DoneComputing barrier
+			now.numDeer = nextNumDeer;
+			WaitBarrier();				// DoneAssigning barrier
+			WaitBarrier();				// DonePrinting barrier
+		}
+		return;
+	}
 
-        if ( nextHeight < 0. )
-        	nextHeight = 0.;		// clamp nextHeight against zero
+	for ( int s = 0; Snapshot[s&1].totalMonth < NumMonths; s++ ) {
+		Snapshot[(s+1)&1].numDeer = NextNumDeer( Snapshot[s&1] );
+		WaitBarrier();				// next month is done -- it's now this month
+	}
+}
 
-		WaitBarrier();				// DoneComputing barrier
+/*
+ * Handle the task of updating the number of wolves based on the current state
+ */
+void Wolf( ) {
+	if ( Sync == SYNC_THREE ) {
+		State &now = Snapshot[0];
+		while ( now.totalMonth < NumMonths ) {
+			int nextNumWolf = NextNumWolf( now );
+			WaitBarrier(); 				// DoneComputing barrier
+			now.numWolf = nextNumWolf;
+			WaitBarrier();				// DoneAssigning barrier
+			WaitBarrier();				// DonePrinting barrier
+		}
+		return;
+	}
 
-        NowHeight = nextHeight;
+	for ( int s = 0; Snapshot[s&1].totalMonth < NumMonths; s++ ) {
+		Snapshot[(s+1)&1].numWolf = NextNumWolf( Snapshot[s&1] );
+		WaitBarrier();				// next month is done -- it's now this month
+	}
+}
 
-		WaitBarrier();				// DoneAssigning barrier
+/*
+ * Handle the task of updating the height of the grain based on the current state
+ */
+void Grain( ) {
+	if ( Sync == SYNC_THREE ) {
+		State &now = Snapshot[0];
+		while ( now.totalMonth < NumMonths ) {
+			float nextHeight = NextHeight( now );
+			WaitBarrier();				// DoneComputing barrier
+			now.height = nextHeight;
+			WaitBarrier();				// DoneAssigning barrier
+			WaitBarrier();				// DonePrinting barrier
+		}
+		return;
+	}
 
-		WaitBarrier();				// DonePrinting barrier
+	for ( int s = 0; Snapshot[s&1].totalMonth < NumMonths; s++ ) {
+		Snapshot[(s+1)&1].height = NextHeight( Snapshot[s&1] );
+		WaitBarrier();				// next month is done -- it's now this month
 	}
 }
 
@@ -226,88 +658,55 @@ void Grain( ) {
  * Handle the task of printing the updated current state and updating
  * environment parameters accordingly
  */
-
 void Watcher( ) {
-	while ( NowYear < 2031 ) {
-
-		WaitBarrier();				// DoneComputing barrier
-
-		WaitBarrier();				// DoneAssigning barrier
-
-        // Once the update of all the current state have been completed
-        // print the updated current state:
-#define CSV
-#ifdef  CSV
-		fprintf(stderr, "%4d, %6.2lf, %6.2lf, %6.2lf, %4d, %4d\n",
-            TotalMonth, NowPrecip, NowTemp, NowHeight, NowNumDeer, NowNumWolf);
-#else
-        if ( DEBUG )
-			fprintf(stderr, "Year: %4d, Month: %2d, Total Month: %2d, Precip (inches): %6.2lf, Temp (°F): %6.2lf, Height: %6.2lf, Deer #: %4d, Wolf #: %4d\n",
-				NowYear, NowMonth+1, TotalMonth, NowPrecip, NowTemp, NowHeight, NowNumDeer, NowNumWolf);
-        else
-        	fprintf(stderr, "%4d, %2d, %2d, %6.2lf, %6.2lf, %6.2lf, %4d, %4d\n",
-			  	NowYear, NowMonth+1, TotalMonth, NowPrecip, NowTemp, NowHeight, NowNumDeer, NowNumWolf);
-#endif
-       	// increment time accordingly:
-        NowMonth++;
-        if ( NowMonth > 11 ) {
-        	NowYear++;
-            NowMonth = 0;
-        }
-        TotalMonth++;
-
-        // calculate new environment variables and update them:
-		float ang = (  30.*(float)NowMonth + 15.  ) * ( M_PI / 180. );
-
-		float temp = AVG_TEMP - AMP_TEMP * cos( ang );
-		NowTemp = temp + Ranf( -RANDOM_TEMP, RANDOM_TEMP );
-
-		float precip = AVG_PRECIP_PER_MONTH + AMP_PRECIP_PER_MONTH * sin( ang );
-		NowPrecip = precip + Ranf( -RANDOM_PRECIP, RANDOM_PRECIP );
-		if( NowPrecip < 0. )
-			NowPrecip = 0.;
-
-		WaitBarrier();
+	if ( Sync == SYNC_THREE ) {
+		State &now = Snapshot[0];
+		while ( now.totalMonth < NumMonths ) {
+			WaitBarrier();				// DoneComputing barrier
+			WaitBarrier();				// DoneAssigning barrier
+
+			// Once the update of all the current state have been completed
+			// print the updated current state, and move on to the next month:
+			PrintMonth( now, now );
+			NextMonth( now, now );
+
+			WaitBarrier();				// DonePrinting barrier
+		}
+		return;
 	}
 
+	// Each month's line has its weather and the grain and herds that came of it, which aren't
+	// known until the next step -- so step s prints month s-1, from the snapshot that's being
+	// refilled (its date and weather, which only the Watcher writes) and the one that's done:
+	for ( int s = 0; ; s++ ) {
+		const State &now = Snapshot[s&1];
+		State &next = Snapshot[(s+1)&1];
+		if ( s > 0 )
+			PrintMonth( next, now );
+		if ( now.totalMonth >= NumMonths )
+			break;
+
+		NextMonth( now, next );
+		WaitBarrier();				// next month is done -- it's now this month
+	}
 }
 
 /*
  * For Custom Barriers:
- * Specify how many threads will be in the barrier and initialize the lock
+ * Specify how many threads will be in the barrier and set it up
  */
 void InitBarrier( int n )
 {
-	NumInThreadTeam = n;
-	NumAtBarrier = 0;
-	omp_init_lock( &Lock );
+	TheBarrier.Init( Kind, n );
 }
 
 /*
  * For Custom Barriers:
  * Have the calling thread wait here until all the other threads catch up
+ * (each section runs on its own thread of the team, so the thread number is its id)
  */
 void WaitBarrier( ) {
-	omp_set_lock( &Lock );
-	{
-		NumAtBarrier++;
-		if( NumAtBarrier == NumInThreadTeam )
-		{
-			NumGone = 0;
-			NumAtBarrier = 0;
-			// let all other threads get back to what they were doing
-			// before this one unlocks, knowing that they might immediately
-			// call WaitBarrier( ) again:
-			while( NumGone != NumInThreadTeam-1 );
-			omp_unset_lock( &Lock );
-			return;
-		}
-	}
-	omp_unset_lock( &Lock );
-
-	while( NumAtBarrier != 0 );	// this waits for the nth thread to arrive
-	#pragma omp atomic
-		NumGone++;			// this flags how many threads have returned
+	TheBarrier.Wait( omp_get_thread_num( ) );
 }
 
 /*
@@ -0,0 +1,180 @@
+/*
+ *
+ * Agents for the Project #2 simulation, scheduled as a task graph.
+ *
+ * The state is a struct S with named fields, kept as two snapshots that trade places every step
+ * (the same scheme as --sync one in Project2.cpp): step m reads snap[m&1] and writes snap[(m+1)&1].
+ * Each agent declares which fields it reads and which it writes, and its step( now, next ) may only
+ * touch those. Every (agent, step) pair becomes an OpenMP task whose depend clauses are on one token
+ * per field per snapshot -- in: the fields it reads in now, out: the fields it writes in next -- so
+ * the runtime orders exactly what has to be ordered:
+ *
+ *	read after write		an agent's step m+1 waits for the writers of what it reads in step m
+ *	write after read		step m+1 writes the snapshot step m read, so its writers wait for those readers
+ *
+ * and nothing else: there are no barriers, agents that don't depend on each other run at the same
+ * time, and an agent can run steps ahead of one it doesn't read. Any number of agents on a team of
+ * any size -- one generating thread hands out the tasks, the team runs them. The generating thread
+ * hands out AGENT_WINDOW steps at a time and waits for them, so the queue stays small.
+ *
+ *		AgentModel<State> model;
+ *		model.Field( "height" );  model.Field( "deer" );  ...
+ *		model.Add( "Grain", { "temp", "precip", "height", "deer" }, { "height" },
+ *			[ ]( const State &now, State &next ) { next.height = NextHeight( now ); } );
+ *		...
+ *		if( model.Check( ) )
+ *			model.Run( snap, months, numThreads, observer );
+ *
+ * A field is written by at most one agent. One that nobody writes is a constant, and has to be set
+ * in both snapshots before Run( ). The observer, if any, sees each step's before and after once it
+ * is complete, in order, and holds back the steps that would overwrite them until it returns.
+ *
+ */
+
+#ifndef PROJECT2_AGENTS_H
+#define PROJECT2_AGENTS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+#ifndef AGENT_WINDOW
+#define AGENT_WINDOW		64		// steps handed out before the generating thread waits for them
+#endif
+
+template< class S >
+struct Agent
+{
+	std::string									name;
+	std::vector<int>							reads;		// field numbers
+	std::vector<int>							writes;
+	std::function<void( const S &, S & )>		step;		// ( now, next )
+};
+
+template< class S >
+struct AgentModel
+{
+	std::vector<std::string>	fields;
+	std::vector< Agent<S> >		agents;
+	bool						ok = true;		// false once something was declared wrong
+
+	// the number of a field, declaring it the first time:
+	int
+	Field( const char *name )
+	{
+		for( size_t f = 0; f < fields.size( ); f++ )
+			if( fields[f] == name )
+				return (int)f;
+		fields.push_back( name );
+		return (int)fields.size( ) - 1;
+	}
+
+	// the number of a declared field, or -1:
+	int
+	Find( const char *name ) const
+	{
+		for( size_t f = 0; f < fields.size( ); f++ )
+			if( fields[f] == name )
+				return (int)f;
+		return -1;
+	}
+
+	void
+	Add( const char *name, std::vector<const char *> reads, std::vector<const char *> writes, std::function<void( const S &, S & )> step )
+	{
+		Agent<S> a;
+		a.name = name;
+		a.step = step;
+		for( int pass = 0; pass < 2; pass++ )
+		{
+			for( const char *field : pass == 0 ? reads : writes )
+			{
+				int f = Find( field );
+				if( f < 0 )
+				{
+					fprintf( stderr, "Agent %s %s '%s', which isn't a field\n", name, pass == 0 ? "reads" : "writes", field );
+					ok = false;
+					continue;
+				}
+				( pass == 0 ? a.reads : a.writes ).push_back( f );
+			}
+		}
+		agents.push_back( a );
+	}
+
+	// every field has at most one writer (the one that doesn't get written stays the same):
+	bool
+	Check( )
+	{
+		std::vector<int> writer( fields.size( ), -1 );
+		for( size_t i = 0; i < agents.size( ); i++ )
+		{
+			for( int f : agents[i].writes )
+			{
+				if( writer[f] >= 0 )
+				{
+					fprintf( stderr, "Agents %s and %s both write '%s'\n",
+						agents[ writer[f] ].name.c_str( ), agents[i].name.c_str( ), fields[f].c_str( ) );
+					ok = false;
+				}
+				writer[f] = (int)i;
+			}
+		}
+		return ok;
+	}
+
+	// run steps steps on numt threads, starting from snap[0]; the result is in snap[steps&1].
+	// observe( before, after, m ), if given, is called for every step m, in order:
+	void
+	Run( S snap[2], int steps, int numt, std::function<void( const S &, const S &, int )> observe = nullptr )
+	{
+		// tokens[b*nf + f] stands for field f of snapshot b -- only its address matters:
+		int nf = (int)fields.size( );
+		std::vector<char> tokens( 2 * ( nf > 0 ? nf : 1 ) );
+		char *tok = tokens.data( );
+		char order;			// the observer's calls, one after another
+		char *ord = &order;
+		Agent<S> *as = agents.data( );
+		int na = (int)agents.size( );
+
+		#pragma omp parallel num_threads( numt )
+		#pragma omp single
+		for( int m = 0; m < steps; m++ )
+		{
+			// without a bound the whole run would be queued up front, a few hundred bytes a task:
+			if( m > 0  &&  m % AGENT_WINDOW == 0 )
+			{
+				#pragma omp taskwait
+			}
+
+			const S *now = &snap[ m & 1 ];
+			S *next = &snap[ ( m + 1 ) & 1 ];
+			char *in  = tok + ( m & 1 ) * nf;
+			char *out = tok + ( ( m + 1 ) & 1 ) * nf;
+
+			for( int i = 0; i < na; i++ )
+			{
+				Agent<S> *a = &as[i];
+				const int *r = a->reads.data( );
+				const int *w = a->writes.data( );
+				int nr = (int)a->reads.size( );
+				int nw = (int)a->writes.size( );
+				#pragma omp task firstprivate( a, now, next ) \
+					depend( iterator( j = 0:nr ), in: in[ r[j] ] ) depend( iterator( k = 0:nw ), out: out[ w[k] ] )
+				a->step( *now, *next );
+			}
+
+			if( observe )
+			{
+				#pragma omp task firstprivate( now, next, m ) shared( observe ) \
+					depend( iterator( j = 0:nf ), in: in[j] ) depend( iterator( k = 0:nf ), in: out[k] ) depend( inout: ord[0] )
+				observe( *now, *next, m );
+			}
+		}		// the implied barrier at the end of the single waits for all the tasks
+	}
+};
+
+#endif		// PROJECT2_AGENTS_H
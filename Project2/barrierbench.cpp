@@ -0,0 +1,208 @@
+/*
+ *
+ * Project #2 - barrier latency versus thread count.
+ *
+ * The simulation crosses three barriers a month and does a handful of flops in between, so the
+ * months/sec it gets is really the barrier's latency. This times each barrier in barriers.h, the
+ * original lock-and-spin WaitBarrier( ), and OpenMP's own "#pragma omp barrier" on a team of each
+ * size, back to back:
+ *
+ *		./barrierbench --threads 1,2,4,8,16 --barriers central,tree,dissemination,lock,omp --episodes 20000
+ *
+ * One line per kind and team size: the time per barrier (min and median of NUMTRIES samples) and
+ * barriers/sec. Each episode also checks the barrier: every thread posts the episode number before
+ * it, and after it must see its neighbor's post for the same episode.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "../Common/driver.h"
+#include "../Common/timing.h"
+#include "../Common/results.h"
+#include "barriers.h"
+
+#ifndef NUMTRIES
+#define NUMTRIES		5
+#endif
+
+#ifndef EPISODES
+#define EPISODES		10000
+#endif
+
+
+// the original WaitBarrier( ) from Project2.cpp, as the baseline -- data race and all:
+omp_lock_t		Lock;
+volatile int	NumInThreadTeam;
+volatile int	NumAtBarrier;
+volatile int	NumGone;
+
+void
+InitLockBarrier( int n )
+{
+	NumInThreadTeam = n;
+	NumAtBarrier = 0;
+	omp_init_lock( &Lock );
+}
+
+void
+WaitLockBarrier( )
+{
+	omp_set_lock( &Lock );
+	{
+		NumAtBarrier++;
+		if( NumAtBarrier == NumInThreadTeam )
+		{
+			NumGone = 0;
+			NumAtBarrier = 0;
+			while( NumGone != NumInThreadTeam-1 );
+			omp_unset_lock( &Lock );
+			return;
+		}
+	}
+	omp_unset_lock( &Lock );
+
+	while( NumAtBarrier != 0 );
+	#pragma omp atomic
+		NumGone++;
+}
+
+
+// each thread's "I got to episode e", on its own cache line:
+struct alignas(BARRIER_LINE) Post
+{
+	std::atomic<int>	episode;
+};
+
+// time episodes barriers on numt threads with wait( tid ); returns seconds per barrier, and counts
+// the episodes where a thread got through before its neighbor had arrived:
+template< class WAIT >
+double
+TimeBarrier( int numt, int episodes, WAIT wait, long long &violations )
+{
+	std::vector<Post> posts( numt );
+	for( Post &p : posts )
+		p.episode.store( 0 );
+
+	long long bad = 0;
+	double time0 = 0., time1 = 0.;
+	#pragma omp parallel num_threads( numt ) reduction(+:bad)
+	{
+		int tid = omp_get_thread_num( );
+		int neighbor = ( tid + 1 ) % numt;
+
+		wait( tid );			// everyone is up before the clock starts
+		if( tid == 0 )
+			time0 = omp_get_wtime( );
+		for( int e = 1; e <= episodes; e++ )
+		{
+			posts[tid].episode.store( e, std::memory_order_relaxed );
+			wait( tid );
+			if( posts[neighbor].episode.load( std::memory_order_relaxed ) < e )
+				bad++;
+		}
+		wait( tid );
+		if( tid == 0 )
+			time1 = omp_get_wtime( );
+	}
+	violations += bad;
+	return ( time1 - time0 ) / (double)( episodes + 1 );
+}
+
+
+int
+main( int argc, char *argv[ ] )
+{
+#ifndef _OPENMP
+	fprintf( stderr, "No OpenMP support!\n" );
+	return 1;
+#endif
+
+	int numProcs = omp_get_num_procs( );
+	std::vector<long long> threads = ArgList( argc, argv, "--threads", { 1, 2, 4, 8 } );
+	int episodes = (int) ArgInt( argc, argv, "--episodes", EPISODES );
+	std::string kinds = ArgString( argc, argv, "--barriers", "central,tree,dissemination,lock,omp" );
+	OpenResults( argc, argv );
+
+	fprintf( stderr, "%-14s , %3s , %10s , %10s , %12s\n", "barrier", "thr", "min ns", "median ns", "barriers/sec" );
+	int failures = 0;
+	for( size_t start = 0; start < kinds.size( ); )
+	{
+		size_t comma = kinds.find( ',', start );
+		std::string name = kinds.substr( start, comma == std::string::npos ? std::string::npos : comma - start );
+		start = comma == std::string::npos ? kinds.size( ) : comma + 1;
+
+		BarrierKind kind = BARRIER_CENTRAL;
+		bool isLock = name == "lock";
+		bool isOmp  = name == "omp";
+		if( ! isLock  &&  ! isOmp  &&  ! BarrierFromName( name.c_str( ), kind ) )
+		{
+			fprintf( stderr, "Unknown barrier '%s' -- use central, tree, dissemination, lock or omp\n", name.c_str( ) );
+			return 1;
+		}
+
+		for( long long nt : threads )
+		{
+			int numt = (int)nt;
+			if( isLock  &&  numt > numProcs )
+			{
+				// its waiters never yield, so with more threads than cpus every barrier costs timeslices:
+				fprintf( stderr, "%-14s , %3d , skipped -- more threads than the %d cpus\n", name.c_str( ), numt, numProcs );
+				continue;
+			}
+
+			Barrier b;
+			b.Init( kind, numt );
+			long long violations = 0;
+			std::vector<double> times;
+			for( int t = 0; t < NUMTRIES; t++ )
+			{
+				if( isLock )
+				{
+					InitLockBarrier( numt );
+					times.push_back( TimeBarrier( numt, episodes, []( int ) { WaitLockBarrier( ); }, violations ) );
+					omp_destroy_lock( &Lock );
+				}
+				else if( isOmp )
+					times.push_back( TimeBarrier( numt, episodes, []( int )
+						{
+							#pragma omp barrier
+						}, violations ) );
+				else
+					times.push_back( TimeBarrier( numt, episodes, [&b]( int tid ) { b.Wait( tid ); }, violations ) );
+			}
+
+			TimingStats st = Summarize( times, episodes );
+			fprintf( stderr, "%-14s , %3d , %10.1lf , %10.1lf , %12.0lf\n",
+				name.c_str( ), numt, 1.e9*st.min, 1.e9*st.median, 1./st.min );
+			if( violations != 0 )
+			{
+				fprintf( stderr, "    %lld episodes let a thread through before its neighbor arrived\n", violations );
+				failures++;
+			}
+
+			Result r;
+			r.benchmark = "Project2";
+			r.kernel    = "barrier/" + name;
+			r.threads   = numt;
+			r.size      = episodes;
+			r.unit      = "barriers";
+			r.rate      = 1. / st.min;
+			r.rateUnit  = "Barriers/Sec";
+			r.timing    = st;
+			r.checked   = true;
+			r.passed    = violations == 0;
+			r.check     = std::to_string( violations ) + " early releases in " + std::to_string( (long long)NUMTRIES * episodes ) + " episodes";
+			EmitResult( r );
+		}
+	}
+	CloseResults( );
+
+	return failures == 0 ? 0 : 1;
+}
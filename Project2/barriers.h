@@ -0,0 +1,364 @@
+/*
+ *
+ * Barriers for the Project #2 simulation threads.
+ *
+ * The original WaitBarrier( ) takes an omp_lock_t for every arrival and then spins on plain
+ * volatile ints: the arrivals are serialized through the lock, the last thread holds it while it
+ * spins until everyone has left, the waiting threads burn their cores, and the volatile reads and
+ * writes without atomics are a data race. These are the usual replacements, all on std::atomic:
+ *
+ *	central			one counter and one sense flag: each thread flips its own sense, the last to
+ *					arrive resets the counter and sets the flag to the new sense, so the barrier
+ *					can be reused at once without waiting for everyone to leave
+ *	tree			a combining tree with BARRIER_ARITY children per node: threads arrive at their
+ *					leaf, the last one at each node goes on up, and the release comes back down the
+ *					same nodes -- no counter sees more than BARRIER_ARITY arrivals
+ *	dissemination	ceil(log2 n) rounds; in round r thread i signals thread (i + 2^r) mod n and
+ *					waits for thread (i - 2^r) mod n -- no counters at all, only flags with one
+ *					writer and one reader each
+ *
+ * A waiting thread spins for BARRIER_SPINS polls and then sleeps: on Linux in futex( ) on the
+ * word it is waiting on (woken only if someone is actually asleep), elsewhere by yielding. So a
+ * short wait costs no system call, and a long one doesn't burn a core. A team with more threads
+ * than cpus skips the spinning and sleeps right away.
+ *
+ *		Barrier b;
+ *		b.Init( BARRIER_TREE, numThreads );
+ *		...
+ *		b.Wait( omp_get_thread_num( ) );		// every thread of the team, each with its own id
+ *
+ */
+
+#ifndef PROJECT2_BARRIERS_H
+#define PROJECT2_BARRIERS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_RELAX( )		_mm_pause( )
+#else
+#define CPU_RELAX( )
+#endif
+
+#ifndef BARRIER_SPINS
+#define BARRIER_SPINS		4096	// polls before a waiting thread goes to sleep
+#endif
+#define BARRIER_ARITY		4		// children per combining-tree node
+#define BARRIER_LINE		64		// keep each shared word on its own cache line
+
+enum BarrierKind
+{
+	BARRIER_CENTRAL,
+	BARRIER_TREE,
+	BARRIER_DISSEMINATION
+};
+#define NUM_BARRIER_KINDS	3
+
+inline const char *
+BarrierName( BarrierKind kind )
+{
+	switch( kind )
+	{
+		case BARRIER_CENTRAL:		return "central";
+		case BARRIER_TREE:			return "tree";
+		case BARRIER_DISSEMINATION:	return "dissemination";
+	}
+	return "?";
+}
+
+// look a kind up by name; false if there is no such barrier:
+inline bool
+BarrierFromName( const char *name, BarrierKind &kind )
+{
+	for( int k = 0; k < NUM_BARRIER_KINDS; k++ )
+	{
+		if( strcmp( name, BarrierName( (BarrierKind)k ) ) == 0 )
+		{
+			kind = (BarrierKind)k;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// a word threads wait on, and how many of them are asleep on it:
+struct alignas(BARRIER_LINE) WaitWord
+{
+	std::atomic<int>	value;
+	std::atomic<int>	sleepers;
+
+	WaitWord( ) : value( 0 ), sleepers( 0 ) { }
+};
+
+// how long a team of n threads should spin: with more threads than cpus, the thread being waited
+// for may need the very cpu the waiter is spinning on, so don't spin at all (libgomp does the same):
+inline int
+BarrierSpins( int n )
+{
+	return n > (int)std::thread::hardware_concurrency( ) ? 0 : BARRIER_SPINS;
+}
+
+// wait until done( value ) is true -- spin first, then sleep on the word:
+template< class DONE >
+inline void
+WaitFor( WaitWord &w, int spins, DONE done )
+{
+	for( int i = 0; i < spins; i++ )
+	{
+		if( done( w.value.load( std::memory_order_acquire ) ) )
+			return;
+		CPU_RELAX( );
+	}
+
+	while( true )
+	{
+		int v = w.value.load( std::memory_order_acquire );
+		if( done( v ) )
+			return;
+#ifdef __linux__
+		// sleeps only if the word still holds v, so a change made after the load isn't missed:
+		w.sleepers.fetch_add( 1 );
+		syscall( SYS_futex, (int *)&w.value, FUTEX_WAIT_PRIVATE, v, NULL, NULL, 0 );
+		w.sleepers.fetch_sub( 1 );
+#else
+		std::this_thread::yield( );
+#endif
+	}
+}
+
+// after changing w.value, wake whoever is asleep on it:
+inline void
+WakeAll( WaitWord &w )
+{
+#ifdef __linux__
+	// the new value has to be visible before we look at sleepers -- otherwise a waiter can count
+	// itself in and go to sleep on the old value while we read sleepers == 0, and never wake up.
+	// (A release store alone can sit in the store buffer past the load.) This pairs with the
+	// waiter's seq_cst sleepers.fetch_add( ) before its futex( ):
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( w.sleepers.load( ) > 0 )
+		syscall( SYS_futex, (int *)&w.value, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0 );
+#else
+	(void)w;
+#endif
+}
+
+// each thread's own sense, on its own line:
+struct alignas(BARRIER_LINE) LocalSense
+{
+	int		sense;
+	int		episode;
+
+	LocalSense( ) : sense( 0 ), episode( 0 ) { }
+};
+
+
+// the centralized sense-reversing barrier:
+struct CentralBarrier
+{
+	alignas(BARRIER_LINE) std::atomic<int>	count;
+	WaitWord								sense;
+	int										numThreads;
+	int										spins;
+	std::vector<LocalSense>					local;
+
+	void
+	Init( int n )
+	{
+		numThreads = n;
+		spins = BarrierSpins( n );
+		count.store( 0 );
+		sense.value.store( 0 );
+		local.assign( n, LocalSense( ) );
+	}
+
+	void
+	Wait( int tid )
+	{
+		int s = 1 - local[tid].sense;
+		local[tid].sense = s;
+		if( count.fetch_add( 1, std::memory_order_acq_rel ) == numThreads-1 )
+		{
+			// last one in -- nobody touches count again until they see the new sense:
+			count.store( 0, std::memory_order_relaxed );
+			sense.value.store( s, std::memory_order_release );
+			WakeAll( sense );
+		}
+		else
+			WaitFor( sense, spins, [s]( int v ) { return v == s; } );
+	}
+};
+
+
+// the combining-tree barrier:
+struct TreeBarrier
+{
+	struct alignas(BARRIER_LINE) Node
+	{
+		std::atomic<int>	count;
+		int					expected;		// arrivals that complete this node
+		int					parent;			// -1 at the root
+		WaitWord			release;		// set to the episode's sense when the whole tree is in
+	};
+
+	std::vector<Node>		nodes;
+	std::vector<int>		leaf;			// each thread's leaf node
+	int						spins;
+	std::vector<LocalSense>	local;
+
+	void
+	Init( int n )
+	{
+		spins = BarrierSpins( n );
+
+		// the leaves take the threads BARRIER_ARITY at a time, each level above takes the level
+		// below BARRIER_ARITY nodes at a time, up to a single root:
+		std::vector<int> expected, parent;
+		leaf.resize( n );
+		for( int t = 0; t < n; t++ )
+			leaf[t] = t / BARRIER_ARITY;
+		int first = 0;
+		int width = ( n + BARRIER_ARITY-1 ) / BARRIER_ARITY;
+		for( int i = 0; i < width; i++ )
+			expected.push_back( std::min( BARRIER_ARITY, n - i*BARRIER_ARITY ) );
+		while( width > 1 )
+		{
+			int above = ( width + BARRIER_ARITY-1 ) / BARRIER_ARITY;
+			int next = first + width;
+			for( int i = 0; i < width; i++ )
+				parent.push_back( next + i / BARRIER_ARITY );
+			for( int i = 0; i < above; i++ )
+				expected.push_back( std::min( BARRIER_ARITY, width - i*BARRIER_ARITY ) );
+			first = next;
+			width = above;
+		}
+		parent.push_back( -1 );
+
+		nodes = std::vector<Node>( expected.size( ) );
+		for( size_t i = 0; i < nodes.size( ); i++ )
+		{
+			nodes[i].count.store( 0 );
+			nodes[i].expected = expected[i];
+			nodes[i].parent   = parent[i];
+			nodes[i].release.value.store( 0 );
+		}
+		local.assign( n, LocalSense( ) );
+	}
+
+	void
+	Wait( int tid )
+	{
+		int s = 1 - local[tid].sense;
+		local[tid].sense = s;
+
+		// go up while we're the last to arrive; wait at the first node where we aren't:
+		int path[32];
+		int depth = 0;
+		int node = leaf[tid];
+		while( node >= 0 )
+		{
+			Node &nd = nodes[node];
+			if( nd.count.fetch_add( 1, std::memory_order_acq_rel ) != nd.expected-1 )
+			{
+				WaitFor( nd.release, spins, [s]( int v ) { return v == s; } );
+				break;
+			}
+			path[depth++] = node;
+			node = nd.parent;
+		}
+
+		// then release the nodes we completed, top down:
+		while( depth > 0 )
+		{
+			Node &nd = nodes[ path[--depth] ];
+			nd.count.store( 0, std::memory_order_relaxed );
+			nd.release.value.store( s, std::memory_order_release );
+			WakeAll( nd.release );
+		}
+	}
+};
+
+
+// the dissemination barrier -- flags[t*rounds + r] counts the signals thread t has had in round r:
+struct DisseminationBarrier
+{
+	int						numThreads;
+	int						rounds;
+	int						spins;
+	std::vector<WaitWord>	flags;
+	std::vector<LocalSense>	local;
+
+	void
+	Init( int n )
+	{
+		numThreads = n;
+		spins = BarrierSpins( n );
+		rounds = 0;
+		while( ( 1 << rounds ) < n )
+			rounds++;
+		flags = std::vector<WaitWord>( n * std::max( rounds, 1 ) );
+		local.assign( n, LocalSense( ) );
+	}
+
+	void
+	Wait( int tid )
+	{
+		int e = ++local[tid].episode;
+		for( int r = 0; r < rounds; r++ )
+		{
+			WaitWord &partner = flags[ ( ( tid + (1<<r) ) % numThreads ) * rounds + r ];
+			partner.value.fetch_add( 1, std::memory_order_acq_rel );
+			WakeAll( partner );
+			WaitFor( flags[ tid*rounds + r ], spins, [e]( int v ) { return v - e >= 0; } );
+		}
+	}
+};
+
+
+// any of the three, picked at runtime:
+struct Barrier
+{
+	BarrierKind				kind;
+	CentralBarrier			central;
+	TreeBarrier				tree;
+	DisseminationBarrier	dissemination;
+
+	void
+	Init( BarrierKind k, int n )
+	{
+		kind = k;
+		switch( kind )
+		{
+			case BARRIER_CENTRAL:		central.Init( n );			break;
+			case BARRIER_TREE:			tree.Init( n );				break;
+			case BARRIER_DISSEMINATION:	dissemination.Init( n );	break;
+		}
+	}
+
+	void
+	Wait( int tid )
+	{
+		switch( kind )
+		{
+			case BARRIER_CENTRAL:		central.Wait( tid );		break;
+			case BARRIER_TREE:			tree.Wait( tid );			break;
+			case BARRIER_DISSEMINATION:	dissemination.Wait( tid );	break;
+		}
+	}
+};
+
+#endif		// PROJECT2_BARRIERS_H
@@ -0,0 +1,267 @@
+/*
+ *
+ * The grain/deer/wolf model for a whole ensemble of farms at once.
+ *
+ * Project2.cpp runs one farm for six years on four threads, one per agent, and a month is a few
+ * flops between three barriers -- it measures synchronization, not the model. Here thousands to
+ * millions of independent farms, each with its own starting state and its own weather, are kept
+ * as a structure of arrays:
+ *
+ *		precip[ ], temp[ ], height[ ], deer[ ], wolf[ ]		one entry per farm
+ *
+ * and StepEnsemble( ) moves every farm one month ahead in a single "omp parallel for simd" sweep.
+ * Each farm does exactly what the Deer( ), Wolf( ) and Grain( ) agents do, all from last month's
+ * state, and then the Watcher( )'s weather update. The loop is branch-free (the clamps are
+ * selects, exp( ) is a polynomial) so it vectorizes, and the month's statistics -- means, spreads,
+ * extremes and how many farms have lost all their deer or wolves -- are reduced in the same sweep.
+ *
+ * The randomness comes from Philox (Common/rng.h): farm f's starting state is block 0 of counter f,
+ * and its weather noise for month m is block m+1, so an ensemble's trajectory for a given seed is
+ * the same whatever the thread count. EnsembleChecksum( ) (integer sums, so it doesn't depend on
+ * the order they are added in either) is how that gets checked.
+ *
+ */
+
+#ifndef PROJECT2_ENSEMBLE_H
+#define PROJECT2_ENSEMBLE_H
+
+#include <stdint.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <omp.h>
+#include <vector>
+
+#include "../Common/rng.h"
+#include "model.h"
+
+// the starting states are spread over these ranges:
+#define ENSEMBLE_DEER_MIN		10
+#define ENSEMBLE_DEER_MAX		30
+#define ENSEMBLE_WOLF_MIN		2
+#define ENSEMBLE_WOLF_MAX		8
+#define ENSEMBLE_HEIGHT_MIN		200.f
+#define ENSEMBLE_HEIGHT_MAX		400.f
+
+#if defined(__GNUC__)
+#define ENSEMBLE_INLINE	__attribute__(( always_inline )) inline
+#else
+#define ENSEMBLE_INLINE	inline
+#endif
+
+// the sweep is compiled for plain x86-64, AVX2 and AVX-512, and the loader picks the widest one the
+// CPU has (GCC function multiversioning, Linux only):
+#if defined(__GNUC__) && ! defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define ENSEMBLE_CLONES	__attribute__(( target_clones( "default", "avx2", "avx512f" ) ))
+#else
+#define ENSEMBLE_CLONES
+#endif
+
+struct Ensemble
+{
+	int					numFarms;
+	uint64_t			seed;
+	int					totalMonth;		// months simulated so far
+	int					month;			// 0 - 11, the same on every farm
+	std::vector<float>	precip;			// inches of rain this month
+	std::vector<float>	temp;			// temperature this month
+	std::vector<float>	height;			// grain height in inches
+	std::vector<int>	deer;
+	std::vector<int>	wolf;
+};
+
+// one month across the ensemble:
+struct EnsembleStats
+{
+	int		totalMonth;
+	double	meanPrecip, meanTemp;
+	double	meanHeight, sdHeight;
+	double	meanDeer, sdDeer;
+	double	meanWolf, sdWolf;
+	int		minDeer, maxDeer;
+	int		minWolf, maxWolf;
+	double	noDeer;				// fraction of farms with no deer left
+	double	noWolves;			// ... and with no wolves
+};
+
+
+// e^x for x <= 0, branch-free (Cephes expf coefficients, a few ulp):
+ENSEMBLE_INLINE float
+FastExp( float x )
+{
+	x = x < -87.f ? -87.f : x;
+	float n = floorf( x * 1.44269504088896341f + 0.5f );		// x / ln 2, rounded
+	x = x - n * 0.693359375f + n * 2.12194440e-4f;				// ln 2 in two parts
+	float p = ( ( ( ( 1.9875691500e-4f * x + 1.3981999507e-3f ) * x + 8.3334519073e-3f ) * x
+		+ 4.1665795894e-2f ) * x + 1.6666665459e-1f ) * x + 5.0000001201e-1f;
+	p = p * x * x + x + 1.f;
+	int32_t bits = ( (int32_t)n + 127 ) << 23;				// 2^n
+	float scale;
+	memcpy( &scale, &bits, sizeof(scale) );
+	return p * scale;
+}
+
+// this month's weather for a farm, from its noise for the month:
+ENSEMBLE_INLINE void
+Weather( float baseTemp, float basePrecip, uint32_t f, uint32_t block, uint32_t k0, uint32_t k1, float &temp, float &precip )
+{
+	uint32_t c0 = f, c1 = 0, c2 = block, c3 = 0;
+	PhiloxRounds( c0, c1, c2, c3, k0, k1 );
+	temp   = baseTemp   + Scale( UniformFloat( c0 ), -RANDOM_TEMP,   RANDOM_TEMP );
+	precip = basePrecip + Scale( UniformFloat( c1 ), -RANDOM_PRECIP, RANDOM_PRECIP );
+	precip = precip < 0.f ? 0.f : precip;
+}
+
+// the seasonal part of the weather, the same for every farm:
+inline void
+Season( int month, float &baseTemp, float &basePrecip )
+{
+	float ang = (  30.*(float)month + 15.  ) * ( M_PI / 180. );
+	baseTemp   = AVG_TEMP - AMP_TEMP * cos( ang );
+	basePrecip = AVG_PRECIP_PER_MONTH + AMP_PRECIP_PER_MONTH * sin( ang );
+}
+
+// numFarms farms in month 0, each with its own starting populations, grain and weather:
+inline void
+InitEnsemble( Ensemble &e, int numFarms, uint64_t seed )
+{
+	e.numFarms   = numFarms;
+	e.seed       = seed;
+	e.totalMonth = 0;
+	e.month      = 0;
+	e.precip.resize( numFarms );
+	e.temp.resize( numFarms );
+	e.height.resize( numFarms );
+	e.deer.resize( numFarms );
+	e.wolf.resize( numFarms );
+
+	float baseTemp, basePrecip;
+	Season( e.month, baseTemp, basePrecip );
+	uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)( seed >> 32 );
+
+	// first touch with the same static split the sweeps use:
+	#pragma omp parallel for schedule(static)
+	for( int f = 0; f < numFarms; f++ )
+	{
+		float u[PHILOX_OUTPUTS];
+		PhiloxUniforms( seed, f, 0, u );
+		e.deer[f]   = (int)Scale( u[0], ENSEMBLE_DEER_MIN, ENSEMBLE_DEER_MAX + 1 );
+		e.wolf[f]   = (int)Scale( u[1], ENSEMBLE_WOLF_MIN, ENSEMBLE_WOLF_MAX + 1 );
+		e.height[f] = Scale( u[2], ENSEMBLE_HEIGHT_MIN, ENSEMBLE_HEIGHT_MAX );
+		Weather( baseTemp, basePrecip, f, 1, k0, k1, e.temp[f], e.precip[f] );
+	}
+}
+
+// move every farm one month ahead; returns the statistics of the new month:
+ENSEMBLE_CLONES inline EnsembleStats
+StepEnsemble( Ensemble &e )
+{
+	int n = e.numFarms;
+	float *precip = e.precip.data( ), *temp = e.temp.data( ), *height = e.height.data( );
+	int *deer = e.deer.data( ), *wolf = e.wolf.data( );
+
+	// the calendar and the season are the Watcher's, common to all the farms:
+	e.totalMonth++;
+	e.month = ( e.month + 1 ) % 12;
+	float baseTemp, basePrecip;
+	Season( e.month, baseTemp, basePrecip );
+	uint32_t block = (uint32_t)e.totalMonth + 1;
+	uint32_t k0 = (uint32_t)e.seed, k1 = (uint32_t)( e.seed >> 32 );
+
+	double sumPrecip = 0., sumTemp = 0., sumHeight = 0., sumHeight2 = 0.;
+	double sumDeer = 0., sumDeer2 = 0., sumWolf = 0., sumWolf2 = 0.;
+	int minDeer = 0x7fffffff, maxDeer = 0, minWolf = 0x7fffffff, maxWolf = 0;
+	int noDeer = 0, noWolves = 0;
+	#pragma omp parallel for simd schedule(static) \
+		reduction(+:sumPrecip,sumTemp,sumHeight,sumHeight2,sumDeer,sumDeer2,sumWolf,sumWolf2,noDeer,noWolves) \
+		reduction(min:minDeer,minWolf) reduction(max:maxDeer,maxWolf)
+	for( int f = 0; f < n; f++ )
+	{
+		float p = precip[f], t = temp[f], h = height[f];
+		int d = deer[f], w = wolf[f];
+
+		// Deer( ):
+		int nextDeer = d + (int)( ( ALPHA * (float)d - BETA * (float)d * (float)w ) * (float)DT );
+		int capacity = (int)h;
+		nextDeer += nextDeer < capacity ? 1 : ( nextDeer > capacity ? -1 : 0 );
+		nextDeer = nextDeer < 0 ? 0 : nextDeer;
+
+		// Wolf( ):
+		int nextWolf = w + (int)( ( DELTA * (float)d * (float)w - GAMMA * (float)w ) * (float)DT );
+		nextWolf += nextWolf > d ? -1 : ( nextWolf < d ? 1 : 0 );
+		nextWolf = nextWolf < 0 ? 0 : nextWolf;
+
+		// Grain( ):
+		float tf = ( t - MIDTEMP ) / 10.f;
+		float pf = ( p - MIDPRECIP ) / 10.f;
+		float nextHeight = h + FastExp( -tf*tf ) * FastExp( -pf*pf ) * GRAIN_GROWS_PER_MONTH
+							 - (float)d * ONE_DEER_EATS_PER_MONTH;
+		nextHeight = nextHeight < 0.f ? 0.f : nextHeight;
+
+		// Watcher( ): the new month's weather:
+		float nextTemp, nextPrecip;
+		Weather( baseTemp, basePrecip, (uint32_t)f, block, k0, k1, nextTemp, nextPrecip );
+
+		precip[f] = nextPrecip;
+		temp[f]   = nextTemp;
+		height[f] = nextHeight;
+		deer[f]   = nextDeer;
+		wolf[f]   = nextWolf;
+
+		sumPrecip  += nextPrecip;
+		sumTemp    += nextTemp;
+		sumHeight  += nextHeight;
+		sumHeight2 += nextHeight * nextHeight;
+		sumDeer    += (float)nextDeer;
+		sumDeer2   += (float)nextDeer * (float)nextDeer;
+		sumWolf    += (float)nextWolf;
+		sumWolf2   += (float)nextWolf * (float)nextWolf;
+		minDeer = nextDeer < minDeer ? nextDeer : minDeer;
+		maxDeer = nextDeer > maxDeer ? nextDeer : maxDeer;
+		minWolf = nextWolf < minWolf ? nextWolf : minWolf;
+		maxWolf = nextWolf > maxWolf ? nextWolf : maxWolf;
+		noDeer   += nextDeer == 0 ? 1 : 0;
+		noWolves += nextWolf == 0 ? 1 : 0;
+	}
+
+	EnsembleStats st;
+	double dn = (double)n;
+	st.totalMonth = e.totalMonth;
+	st.meanPrecip = sumPrecip / dn;
+	st.meanTemp   = sumTemp / dn;
+	st.meanHeight = sumHeight / dn;
+	st.meanDeer   = sumDeer / dn;
+	st.meanWolf   = sumWolf / dn;
+	st.sdHeight   = sqrt( fmax( 0., sumHeight2/dn - st.meanHeight*st.meanHeight ) );
+	st.sdDeer     = sqrt( fmax( 0., sumDeer2/dn   - st.meanDeer*st.meanDeer ) );
+	st.sdWolf     = sqrt( fmax( 0., sumWolf2/dn   - st.meanWolf*st.meanWolf ) );
+	st.minDeer    = minDeer;
+	st.maxDeer    = maxDeer;
+	st.minWolf    = minWolf;
+	st.maxWolf    = maxWolf;
+	st.noDeer     = (double)noDeer / dn;
+	st.noWolves   = (double)noWolves / dn;
+	return st;
+}
+
+// an order-independent fingerprint of the whole state (integer sums of every farm's bits), to check
+// that different thread counts computed the same trajectories:
+inline uint64_t
+EnsembleChecksum( const Ensemble &e )
+{
+	uint64_t sum = 0;
+	#pragma omp parallel for schedule(static) reduction(+:sum)
+	for( int f = 0; f < e.numFarms; f++ )
+	{
+		uint32_t h, t, p;
+		memcpy( &h, &e.height[f], sizeof(h) );
+		memcpy( &t, &e.temp[f],   sizeof(t) );
+		memcpy( &p, &e.precip[f], sizeof(p) );
+		uint64_t farm = (uint64_t)h * 0x9E3779B97F4A7C15ull ^ (uint64_t)t * 0xC2B2AE3D27D4EB4Full
+					  ^ (uint64_t)p * 0x165667B19E3779F9ull ^ (uint64_t)(uint32_t)e.deer[f] << 32 ^ (uint32_t)e.wolf[f];
+		sum += farm * ( 2*(uint64_t)f + 1 );
+	}
+	return sum;
+}
+
+#endif		// PROJECT2_ENSEMBLE_H
@@ -0,0 +1,33 @@
+/*
+ *
+ * The Project #2 model's constants -- how fast the grain grows, the weather, and the Lotka-Volterra
+ * rates for the deer and the wolves -- shared by the four-thread simulation (Project2.cpp) and the
+ * ensemble engine (ensemble.h).
+ *
+ */
+
+#ifndef PROJECT2_MODEL_H
+#define PROJECT2_MODEL_H
+
+const float GRAIN_GROWS_PER_MONTH     =	    100.0;
+const float ONE_DEER_EATS_PER_MONTH   =		1.0;
+
+const float AVG_PRECIP_PER_MONTH      =		15.0;	// average
+const float AMP_PRECIP_PER_MONTH      =		6.0;	// plus or minus
+const float RANDOM_PRECIP             =		2.0;	// plus or minus noise
+
+const float AVG_TEMP                  =		60.0;	// average
+const float AMP_TEMP                  =		20.0;	// plus or minus
+const float RANDOM_TEMP               =		10.0;	// plus or minus noise
+
+const float MIDTEMP                   =		40.0;
+const float MIDPRECIP                 =	    10.0;
+
+// Constants for Lotka-Volterra model that simulates the prey/predator relationship between deer and wolves:
+const float ALPHA = 0.3;		// growth rate of the prey (deer)
+const float BETA  = 0.015;		// death rate of the prey (deer)
+const float DELTA =	0.01;		// growth rate of the predator (wolf)
+const float GAMMA = 0.9;		// death rate of the predator (wolf)
+const float DT	  = 1;			// time step - 1 month
+
+#endif		// PROJECT2_MODEL_H
@@ -0,0 +1,214 @@
+/*
+ *
+ * A non-blocking recorder for the Project #2 Watcher.
+ *
+ * Printing each month with fprintf( stderr, ... ) from inside the simulation makes every agent wait
+ * on the terminal: stderr is unbuffered, so each line is a write( ) system call, and a slow terminal,
+ * pipe or disk holds up the whole month. Here the simulation thread only copies the record into a
+ * ring and moves on; a background thread drains the ring, formats the records, and writes them in
+ * large blocks:
+ *
+ *	ring		RECORDER_RING records, a single producer and a single consumer: the producer alone
+ *				writes head, the writer alone writes tail, so a push is a copy and one atomic store
+ *	writer		takes everything in the ring at once; when it runs dry it puts out what it has
+ *				and naps for RECORDER_NAP microseconds, so a terminal still sees the lines within
+ *				about that -- the producer never has to wake it, which would cost it a system call
+ *	sinks		csv -- each record through format( ), into a RECORDER_BUFFER-byte buffer
+ *				binary -- "RECORDS\0", the record size as a 4-byte int, then the records as they
+ *				are in memory
+ *
+ * The producer only waits if the ring is full -- the writer is RECORDER_RING records behind -- and
+ * counts the times it had to (stalls).
+ *
+ *		Recorder<State> rec;
+ *		rec.Open( "-", false, FormatMonth );		// "-" is stderr
+ *		...
+ *		rec.Push( s );								// from one thread only
+ *		...
+ *		rec.Close( );
+ *
+ */
+
+#ifndef PROJECT2_RECORDER_H
+#define PROJECT2_RECORDER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#ifndef RECORDER_RING
+#define RECORDER_RING		4096		// records -- a power of two
+#endif
+#ifndef RECORDER_BUFFER
+#define RECORDER_BUFFER		(1<<16)		// bytes the writer collects before each write
+#endif
+#ifndef RECORDER_NAP
+#define RECORDER_NAP		1000		// microseconds the writer sleeps when the ring is empty
+#endif
+#define RECORDER_LINE		64			// keep head and tail on their own cache lines
+
+#if ( RECORDER_RING & ( RECORDER_RING-1 ) ) != 0
+#error RECORDER_RING must be a power of two
+#endif
+
+template< class R >
+struct Recorder
+{
+	std::vector<R>									ring;
+	alignas(RECORDER_LINE) std::atomic<unsigned int>	head;	// the next slot the producer fills
+	alignas(RECORDER_LINE) std::atomic<unsigned int>	tail;	// the next slot the writer drains
+	alignas(RECORDER_LINE) std::atomic<bool>			closing;
+
+	std::thread										writer;
+	FILE *											fp = NULL;
+	bool											ownFile;
+	bool											binary;
+	std::function<int( char *, size_t, const R & )>	format;		// like snprintf( )
+	std::vector<char>								buffer;
+	size_t											used;
+
+	long long										records;
+	long long										stalls;		// pushes that found the ring full
+
+	bool
+	IsOpen( ) const
+	{
+		return fp != NULL;
+	}
+
+	// start recording to path ("-" is stderr), as binary records or through format( ); false if
+	// the file can't be opened:
+	bool
+	Open( const char *path, bool binaryRecords, std::function<int( char *, size_t, const R & )> formatRecord )
+	{
+		ownFile = strcmp( path, "-" ) != 0;
+		fp = ownFile ? fopen( path, binaryRecords ? "wb" : "w" ) : stderr;
+		if( fp == NULL )
+		{
+			fprintf( stderr, "Cannot open '%s' for the output\n", path );
+			return false;
+		}
+		if( ownFile )
+			setvbuf( fp, NULL, _IONBF, 0 );		// the writer does its own buffering
+
+		binary = binaryRecords;
+		format = formatRecord;
+		ring.resize( RECORDER_RING );
+		head.store( 0 );
+		tail.store( 0 );
+		closing.store( false );
+		buffer.resize( RECORDER_BUFFER );
+		used = 0;
+		records = 0;
+		stalls = 0;
+
+		if( binary )
+		{
+			int size = (int)sizeof( R );
+			Append( "RECORDS", 8 );
+			Append( &size, sizeof( size ) );
+		}
+		writer = std::thread( [this]( ) { Drain( ); } );
+		return true;
+	}
+
+	// hand r to the writer -- from the one producing thread only:
+	void
+	Push( const R &r )
+	{
+		unsigned int h = head.load( std::memory_order_relaxed );
+		if( h - tail.load( std::memory_order_acquire ) == RECORDER_RING )
+		{
+			stalls++;
+			while( h - tail.load( std::memory_order_acquire ) == RECORDER_RING )
+				std::this_thread::yield( );
+		}
+		ring[ h & ( RECORDER_RING-1 ) ] = r;
+		head.store( h + 1, std::memory_order_release );
+		records++;
+	}
+
+	// let the writer finish what's in the ring, and close the file:
+	void
+	Close( )
+	{
+		if( ! IsOpen( ) )
+			return;
+		closing.store( true, std::memory_order_release );
+		writer.join( );
+
+		Flush( );
+		if( ownFile )
+			fclose( fp );
+		fp = NULL;
+	}
+
+	// the writer thread:
+	void
+	Drain( )
+	{
+		while( true )
+		{
+			// look at closing before the ring, so the last pushes are in it if it's set:
+			bool done = closing.load( std::memory_order_acquire );
+			unsigned int t = tail.load( std::memory_order_relaxed );
+			unsigned int h = head.load( std::memory_order_acquire );
+			if( t != h )
+			{
+				for( ; t != h; t++ )
+				{
+					Write( ring[ t & ( RECORDER_RING-1 ) ] );
+					tail.store( t + 1, std::memory_order_release );
+				}
+				continue;
+			}
+
+			Flush( );			// caught up -- put out what we have
+			if( done )
+				return;
+			std::this_thread::sleep_for( std::chrono::microseconds( RECORDER_NAP ) );
+		}
+	}
+
+	void
+	Write( const R &r )
+	{
+		if( binary )
+		{
+			Append( &r, sizeof( r ) );
+			return;
+		}
+		char line[512];
+		int n = format( line, sizeof line, r );
+		if( n > 0 )
+			Append( line, n < (int)sizeof line ? (size_t)n : sizeof line - 1 );
+	}
+
+	void
+	Append( const void *bytes, size_t n )
+	{
+		if( used + n > buffer.size( ) )
+			Flush( );
+		if( n > buffer.size( ) )
+		{
+			fwrite( bytes, 1, n, fp );
+			return;
+		}
+		memcpy( &buffer[used], bytes, n );
+		used += n;
+	}
+
+	void
+	Flush( )
+	{
+		if( used > 0 )
+			fwrite( buffer.data( ), 1, used, fp );
+		used = 0;
+	}
+};
+
+#endif		// PROJECT2_RECORDER_H
@@ -18,7 +18,12 @@
 #include <omp.h>
 #include <string>
 
+#include "../Common/driver.h"
+#include "../Common/timing.h"
+#include "../Common/results.h"
+
 // setting the number of threads:
+// (these are the defaults -- sweep at runtime with --threads 1,2,4 --capitals 2,5,10)
 #ifndef NUMT
 #define NUMT		    1
 #endif
@@ -32,8 +37,8 @@
 // maximum iterations to allow looking for convergence:
 #define MAXITERATIONS	100
 
-// how many tries to discover the maximum performance:
-#define NUMTRIES		30
+// how many of the first iterations to leave out of the timing statistics (warmup):
+#define NUMWARMUPS		5
 
 #define CSV
 
@@ -63,7 +68,8 @@ struct capital
 };
 
 
-struct capital	Capitals[NUMCAPITALS];
+struct capital	*Capitals;		// NumCapitals of them, allocated for each run
+int				NumCapitals;
 
 
 float
@@ -75,54 +81,46 @@ Distance( int city, int capital )
 }
 
 
-int
-main( int argc, char *argv[ ] )
+// run the whole k-means clustering once for a given number of threads and capitals:
+void
+RunOne( int numt, int numCapitals, bool printStats )
 {
-#ifdef _OPENMP
-	// fprintf( stderr, "OpenMP is supported -- version = %d\n", _OPENMP );
-#else
-        fprintf( stderr, "No OpenMP support!\n" );
-        return 1;
-#endif
+	NumCapitals = numCapitals;
+	Capitals = new struct capital [NumCapitals];
 
-	// make sure we have the data correctly:
-	/* for( int i = 0; i < NUMCITIES; i++ )
-	{
-		fprintf( stderr, "%3d  %8.2f  %8.2f  %s\n", i, Cities[i].longitude, Cities[i].latitude, Cities[i].name.c_str() );
-	} */
-
-    omp_set_num_threads( NUMT );    // set the number of threads to use in parallelizing the for-loop:`
+    omp_set_num_threads( numt );    // set the number of threads to use in parallelizing the for-loop:`
 
 	// seed the capitals:
 	// (this is just picking initial capital cities at uniform intervals)
-	for( int k = 0; k < NUMCAPITALS; k++ )
+	for( int k = 0; k < NumCapitals; k++ )
 	{
-		int cityIndex = k * (NUMCITIES-1) / (NUMCAPITALS-1);
+		int cityIndex = k * (NUMCITIES-1) / (NumCapitals-1);
 		Capitals[k].longitude = Cities[cityIndex].longitude;
 		Capitals[k].latitude  = Cities[cityIndex].latitude;
 	}
 
-	double time0, time1;
+	// every iteration's assignment step is one timing sample:
+	std::vector<double> iterationTimes;
 	for( int n = 0;  n < MAXITERATIONS; n++ )
 	{
 		// reset the summations for the capitals:
-		for( int k = 0; k < NUMCAPITALS; k++ )
+		for( int k = 0; k < NumCapitals; k++ )
 		{
 			Capitals[k].longsum = 0.;
 			Capitals[k].latsum  = 0.;
 			Capitals[k].numsum = 0;
 		}
 
-		time0 = omp_get_wtime( );
+		double time0 = omp_get_wtime( );
 
         // the #pragma goes here -- you figure out what it needs to look like:
-		#pragma omp parallel for default(none) shared(Cities, Capitals)
+		#pragma omp parallel for default(none) shared(Cities, Capitals, NumCapitals)
 		for( int i = 0; i < NUMCITIES; i++ )
 		{
 			int capitalnumber = -1;
 			float mindistance = 1.e+37;
 
-			for( int k = 0; k < NUMCAPITALS; k++ )
+			for( int k = 0; k < NumCapitals; k++ )
 			{
 				float dist = Distance( i, k );
 				if( dist < mindistance )
@@ -143,24 +141,27 @@ main( int argc, char *argv[ ] )
 				Capitals[k].numsum++;
 			}
 		}
-		time1 = omp_get_wtime( );
+		double time1 = omp_get_wtime( );
+		if( n >= NUMWARMUPS )
+			iterationTimes.push_back( time1 - time0 );
 
 
 		// get the average longitude and latitude for each capital:
-		for( int k = 0; k < NUMCAPITALS; k++ )
+		for( int k = 0; k < NumCapitals; k++ )
 		{
 			Capitals[k].longitude = Capitals[k].longsum / (double) Capitals[k].numsum;
 			Capitals[k].latitude  = Capitals[k].latsum / (double) Capitals[k].numsum;
 		}
 	}
 
-	double megaCityCapitalsPerSecond = (double)NUMCITIES * (double)NUMCAPITALS / ( time1 - time0 ) / 1000000.;
+	TimingStats st = Summarize( iterationTimes, 1 );
+	double megaCityCapitalsPerSecond = (double)NUMCITIES * (double)NumCapitals / st.min / 1000000.;
 
 
 	// figure out what actual city is closest to each capital:
 	// this is the extra credit:
-	#pragma omp parallel for default(none) shared(Cities, Capitals)
-	for( int k = 0; k < NUMCAPITALS; k++ )
+	#pragma omp parallel for default(none) shared(Cities, Capitals, NumCapitals)
+	for( int k = 0; k < NumCapitals; k++ )
 	{
 		int nearestcitynumber = -1;
 		float mindistance = 1.e+37;
@@ -178,11 +179,11 @@ main( int argc, char *argv[ ] )
 
 
 	// print the longitude-latitude of each new capital city:
-	// you only need to do this once per some number of NUMCAPITALS -- do it for the 1-thread version:
-	if( NUMT == 1 )
-	// if( NUMT >= 1 )
+	// you only need to do this once per some number of capitals -- do it for the 1-thread version:
+	if( numt == 1 )
+	// if( numt >= 1 )
 	{
-		for( int k = 0; k < NUMCAPITALS; k++ )
+		for( int k = 0; k < NumCapitals; k++ )
 		{
 			// fprintf( stderr, "\t%3d:  %8.2f , %8.2f\n", k, Capitals[k].longitude, Capitals[k].latitude );
 
@@ -191,10 +192,72 @@ main( int argc, char *argv[ ] )
 		}
 	}
 #ifdef CSV
-        fprintf(stderr, "%2d , %4d , %4d , %8.3lf\n", NUMT, (int) NUMCITIES, NUMCAPITALS, megaCityCapitalsPerSecond );
+        fprintf(stderr, "%2d , %4d , %4d , %8.3lf\n", numt, (int) NUMCITIES, NumCapitals, megaCityCapitalsPerSecond );
 #else
         fprintf(stderr, "%2d threads : %4d cities ; %4d capitals; megatrials/sec = %8.3lf\n",
-                NUMT, (int) NUMCITIES, NUMCAPITALS, megaCityCapitalsPerSecond );
+                numt, (int) NUMCITIES, NumCapitals, megaCityCapitalsPerSecond );
 #endif
+	if( printStats )
+		PrintTimingStats( stderr, "    assignment step", st, (double)NUMCITIES * (double)NumCapitals );
+
+	// every city must have landed in exactly one capital's sums:
+	int numAssigned = 0;
+	for( int k = 0; k < NumCapitals; k++ )
+		numAssigned += Capitals[k].numsum;
+
+	Result r;
+	r.benchmark = "Project3";
+	r.kernel    = "k-means assignment step";
+	r.threads   = numt;
+	r.size      = NumCapitals;
+	r.unit      = "capitals";
+	r.rate      = megaCityCapitalsPerSecond;
+	r.rateUnit  = "MegaCityCapitals/Sec";
+	r.timing    = st;
+	r.checked   = true;
+	r.passed    = numAssigned == (int)NUMCITIES;
+	r.check     = std::to_string( numAssigned ) + " of " + std::to_string( (int)NUMCITIES ) + " cities assigned";
+	r.extra.push_back( { "cities", (double)NUMCITIES } );
+	EmitResult( r );
+
+	delete [ ] Capitals;
+}
+
+
+int
+main( int argc, char *argv[ ] )
+{
+#ifdef _OPENMP
+	// fprintf( stderr, "OpenMP is supported -- version = %d\n", _OPENMP );
+#else
+        fprintf( stderr, "No OpenMP support!\n" );
+        return 1;
+#endif
+
+	// make sure we have the data correctly:
+	/* for( int i = 0; i < NUMCITIES; i++ )
+	{
+		fprintf( stderr, "%3d  %8.2f  %8.2f  %s\n", i, Cities[i].longitude, Cities[i].latitude, Cities[i].name.c_str() );
+	} */
+
+	std::vector<long long> threads  = ArgList( argc, argv, "--threads",  { NUMT } );
+	std::vector<long long> capitals = ArgList( argc, argv, "--capitals", { NUMCAPITALS } );
+	bool printStats = ArgFlag( argc, argv, "--stats" );
+	OpenResults( argc, argv );
+
+	for( long long numt : threads )
+	{
+		for( long long numCapitals : capitals )
+		{
+			if( numCapitals < 2 )
+			{
+				fprintf( stderr, "Need at least 2 capitals, got %lld\n", numCapitals );
+				return 1;
+			}
+			RunOne( (int)numt, (int)numCapitals, printStats );
+		}
+	}
+	CloseResults( );
 
+	return 0;
 }
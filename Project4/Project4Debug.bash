@@ -1,5 +1,5 @@
 #!/bin/bash
 
-g++   proj04.cpp -o proj04  -lm  -fopenmp
+g++  -O3  -DBUILD_FLAGS="\"-O3 -fopenmp\""  proj04.cpp -o proj04  -lm  -fopenmp
 ./proj04
 rm ./proj04
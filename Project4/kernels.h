@@ -0,0 +1,355 @@
+/*
+ *
+ * SIMD kernels for Project #4, written with intrinsics instead of inline assembly.
+ *
+ * The original versions loaded their arguments from hard-coded frame offsets ( -24(%rbp) etc. ),
+ * which only held for unoptimized builds with a frame pointer. These let the compiler do the
+ * register allocation, so the benchmark can be built with -O3 like the rest of our code.
+ *
+ * Both kernels take an aligned path ( movaps ) when every array starts on a 16-byte boundary and an
+ * unaligned path ( movups ) otherwise -- the per-thread slices in the multicore runs generally
+ * don't. The last len % 4 elements are done with one more vector instead of a scalar loop:
+ *
+ *		SimdMul:	the final vector is re-done over c[len-4 .. len-1], overlapping the previous one
+ *					(harmless: it writes the same products again)
+ *		SimdMulSum:	the final vector is loaded over a[len-4 .. len-1] with the lanes that were
+ *					already summed masked to zero
+ *
+ * Arrays shorter than one vector fall back to scalar code.
+ *
+ * Wider variants are compiled alongside with __attribute__((target)), so one binary carries all of
+ * them and picks at startup (SelectSimd( )) the widest one the CPU and OS support:
+ *
+ *		sse		 4 floats, mul + add
+ *		avx2	 8 floats, fused multiply-add in SimdMulSum (needs AVX2 and FMA)
+ *		avx512	16 floats, fused multiply-add in SimdMulSum
+ *
+ * Those two do their tail with masked loads and stores, so they need no scalar code at all.
+ * SimdMul( ) and SimdMulSum( ) call whichever variant is selected.
+ *
+ */
+
+#ifndef PROJECT4_KERNELS_H
+#define PROJECT4_KERNELS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "../Common/cpufeatures.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_SSE	1
+#else
+#define HAVE_SSE	0
+#endif
+
+// the AVX variants need per-function target attributes:
+#if HAVE_SSE && defined(__GNUC__) && HAVE_CPUID
+#include <immintrin.h>
+#define HAVE_AVX_VARIANTS	1
+#else
+#define HAVE_AVX_VARIANTS	0
+#endif
+
+// SSE stands for Streaming SIMD Extensions
+
+#define SSE_WIDTH		4
+#define AVX2_WIDTH		8
+#define AVX512_WIDTH	16
+
+
+inline bool
+AlignedTo( const void *p, int bytes )
+{
+	return ( (uintptr_t)p & ( bytes-1 ) ) == 0;
+}
+
+#if HAVE_SSE
+
+inline void
+SseMul( float *a, float *b, float *c, int len )
+{
+	if( len < SSE_WIDTH )
+	{
+		for( int i = 0; i < len; i++ )
+			c[i] = a[i] * b[i];
+		return;
+	}
+
+	int limit = ( len/SSE_WIDTH ) * SSE_WIDTH;
+	if( AlignedTo( a, 16 ) && AlignedTo( b, 16 ) && AlignedTo( c, 16 ) )
+	{
+		for( int i = 0; i < limit; i += SSE_WIDTH )
+			_mm_store_ps( &c[i], _mm_mul_ps( _mm_load_ps( &a[i] ), _mm_load_ps( &b[i] ) ) );
+	}
+	else
+	{
+		for( int i = 0; i < limit; i += SSE_WIDTH )
+			_mm_storeu_ps( &c[i], _mm_mul_ps( _mm_loadu_ps( &a[i] ), _mm_loadu_ps( &b[i] ) ) );
+	}
+
+	// tail: one overlapping vector ending at the last element
+	if( limit < len )
+	{
+		int last = len - SSE_WIDTH;
+		_mm_storeu_ps( &c[last], _mm_mul_ps( _mm_loadu_ps( &a[last] ), _mm_loadu_ps( &b[last] ) ) );
+	}
+}
+
+inline float
+SseMulSum( float *a, float *b, int len )
+{
+	if( len < SSE_WIDTH )
+	{
+		float sum = 0.;
+		for( int i = 0; i < len; i++ )
+			sum += a[i] * b[i];
+		return sum;
+	}
+
+	__m128 sums = _mm_setzero_ps( );
+	int limit = ( len/SSE_WIDTH ) * SSE_WIDTH;
+	if( AlignedTo( a, 16 ) && AlignedTo( b, 16 ) )
+	{
+		for( int i = 0; i < limit; i += SSE_WIDTH )
+			sums = _mm_add_ps( sums, _mm_mul_ps( _mm_load_ps( &a[i] ), _mm_load_ps( &b[i] ) ) );
+	}
+	else
+	{
+		for( int i = 0; i < limit; i += SSE_WIDTH )
+			sums = _mm_add_ps( sums, _mm_mul_ps( _mm_loadu_ps( &a[i] ), _mm_loadu_ps( &b[i] ) ) );
+	}
+
+	// tail: one overlapping vector ending at the last element, keeping only the
+	// len-limit lanes at its top that haven't been summed yet
+	int extra = len - limit;
+	if( extra > 0 )
+	{
+		static const int32_t masks[SSE_WIDTH][SSE_WIDTH] =
+		{
+			{  0,  0,  0,  0 },
+			{  0,  0,  0, -1 },
+			{  0,  0, -1, -1 },
+			{  0, -1, -1, -1 },
+		};
+		int last = len - SSE_WIDTH;
+		__m128 mask = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i *)masks[extra] ) );
+		__m128 prod = _mm_mul_ps( _mm_loadu_ps( &a[last] ), _mm_loadu_ps( &b[last] ) );
+		sums = _mm_add_ps( sums, _mm_and_ps( prod, mask ) );
+	}
+
+	float sum[SSE_WIDTH];
+	_mm_storeu_ps( sum, sums );
+	return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+#else		// no SSE on this target -- keep the same 4-lane arithmetic in plain C++
+
+inline void
+SseMul( float *a, float *b, float *c, int len )
+{
+	for( int i = 0; i < len; i++ )
+		c[i] = a[i] * b[i];
+}
+
+inline float
+SseMulSum( float *a, float *b, int len )
+{
+	float sum[SSE_WIDTH] = { 0., 0., 0., 0. };
+	int limit = ( len/SSE_WIDTH ) * SSE_WIDTH;
+	for( int i = 0; i < limit; i += SSE_WIDTH )
+	{
+		for( int j = 0; j < SSE_WIDTH; j++ )
+			sum[j] += a[i+j] * b[i+j];
+	}
+	for( int i = limit; i < len; i++ )
+		sum[i-limit] += a[i] * b[i];
+	return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+#endif		// HAVE_SSE
+
+
+#if HAVE_AVX_VARIANTS
+
+// a sliding window over this gives the mask for the first "extra" lanes of an 8-float vector:
+static const int32_t Avx2TailMask[2*AVX2_WIDTH] = { -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+__attribute__(( target( "avx2,fma" ) )) inline void
+Avx2Mul( float *a, float *b, float *c, int len )
+{
+	int limit = ( len/AVX2_WIDTH ) * AVX2_WIDTH;
+	if( AlignedTo( a, 32 ) && AlignedTo( b, 32 ) && AlignedTo( c, 32 ) )
+	{
+		for( int i = 0; i < limit; i += AVX2_WIDTH )
+			_mm256_store_ps( &c[i], _mm256_mul_ps( _mm256_load_ps( &a[i] ), _mm256_load_ps( &b[i] ) ) );
+	}
+	else
+	{
+		for( int i = 0; i < limit; i += AVX2_WIDTH )
+			_mm256_storeu_ps( &c[i], _mm256_mul_ps( _mm256_loadu_ps( &a[i] ), _mm256_loadu_ps( &b[i] ) ) );
+	}
+
+	int extra = len - limit;
+	if( extra > 0 )
+	{
+		__m256i mask = _mm256_loadu_si256( (const __m256i *)&Avx2TailMask[AVX2_WIDTH-extra] );
+		__m256 prod = _mm256_mul_ps( _mm256_maskload_ps( &a[limit], mask ), _mm256_maskload_ps( &b[limit], mask ) );
+		_mm256_maskstore_ps( &c[limit], mask, prod );
+	}
+}
+
+__attribute__(( target( "avx2,fma" ) )) inline float
+Avx2MulSum( float *a, float *b, int len )
+{
+	__m256 sums = _mm256_setzero_ps( );
+	int limit = ( len/AVX2_WIDTH ) * AVX2_WIDTH;
+	if( AlignedTo( a, 32 ) && AlignedTo( b, 32 ) )
+	{
+		for( int i = 0; i < limit; i += AVX2_WIDTH )
+			sums = _mm256_fmadd_ps( _mm256_load_ps( &a[i] ), _mm256_load_ps( &b[i] ), sums );
+	}
+	else
+	{
+		for( int i = 0; i < limit; i += AVX2_WIDTH )
+			sums = _mm256_fmadd_ps( _mm256_loadu_ps( &a[i] ), _mm256_loadu_ps( &b[i] ), sums );
+	}
+
+	// masked-off lanes load as zero, so they add nothing:
+	int extra = len - limit;
+	if( extra > 0 )
+	{
+		__m256i mask = _mm256_loadu_si256( (const __m256i *)&Avx2TailMask[AVX2_WIDTH-extra] );
+		sums = _mm256_fmadd_ps( _mm256_maskload_ps( &a[limit], mask ), _mm256_maskload_ps( &b[limit], mask ), sums );
+	}
+
+	float sum[AVX2_WIDTH];
+	_mm256_storeu_ps( sum, sums );
+	float total = 0.;
+	for( int j = 0; j < AVX2_WIDTH; j++ )
+		total += sum[j];
+	return total;
+}
+
+__attribute__(( target( "avx512f" ) )) inline void
+Avx512Mul( float *a, float *b, float *c, int len )
+{
+	int limit = ( len/AVX512_WIDTH ) * AVX512_WIDTH;
+	if( AlignedTo( a, 64 ) && AlignedTo( b, 64 ) && AlignedTo( c, 64 ) )
+	{
+		for( int i = 0; i < limit; i += AVX512_WIDTH )
+			_mm512_store_ps( &c[i], _mm512_mul_ps( _mm512_load_ps( &a[i] ), _mm512_load_ps( &b[i] ) ) );
+	}
+	else
+	{
+		for( int i = 0; i < limit; i += AVX512_WIDTH )
+			_mm512_storeu_ps( &c[i], _mm512_mul_ps( _mm512_loadu_ps( &a[i] ), _mm512_loadu_ps( &b[i] ) ) );
+	}
+
+	int extra = len - limit;
+	if( extra > 0 )
+	{
+		__mmask16 mask = (__mmask16)( ( 1u << extra ) - 1 );
+		__m512 prod = _mm512_mul_ps( _mm512_maskz_loadu_ps( mask, &a[limit] ), _mm512_maskz_loadu_ps( mask, &b[limit] ) );
+		_mm512_mask_storeu_ps( &c[limit], mask, prod );
+	}
+}
+
+__attribute__(( target( "avx512f" ) )) inline float
+Avx512MulSum( float *a, float *b, int len )
+{
+	__m512 sums = _mm512_setzero_ps( );
+	int limit = ( len/AVX512_WIDTH ) * AVX512_WIDTH;
+	if( AlignedTo( a, 64 ) && AlignedTo( b, 64 ) )
+	{
+		for( int i = 0; i < limit; i += AVX512_WIDTH )
+			sums = _mm512_fmadd_ps( _mm512_load_ps( &a[i] ), _mm512_load_ps( &b[i] ), sums );
+	}
+	else
+	{
+		for( int i = 0; i < limit; i += AVX512_WIDTH )
+			sums = _mm512_fmadd_ps( _mm512_loadu_ps( &a[i] ), _mm512_loadu_ps( &b[i] ), sums );
+	}
+
+	int extra = len - limit;
+	if( extra > 0 )
+	{
+		__mmask16 mask = (__mmask16)( ( 1u << extra ) - 1 );
+		sums = _mm512_fmadd_ps( _mm512_maskz_loadu_ps( mask, &a[limit] ), _mm512_maskz_loadu_ps( mask, &b[limit] ), sums );
+	}
+
+	float sum[AVX512_WIDTH];
+	_mm512_storeu_ps( sum, sums );
+	float total = 0.;
+	for( int j = 0; j < AVX512_WIDTH; j++ )
+		total += sum[j];
+	return total;
+}
+
+#endif		// HAVE_AVX_VARIANTS
+
+
+// the dispatch table:
+struct SimdVariant
+{
+	const char *	name;
+	int				width;		// floats per vector
+	void			(*mul)( float *, float *, float *, int );
+	float			(*mulSum)( float *, float *, int );
+};
+
+// the variants this CPU can run, narrowest first:
+inline std::vector<SimdVariant>
+SimdVariants( )
+{
+	std::vector<SimdVariant> variants;
+	variants.push_back( { "sse", SSE_WIDTH, SseMul, SseMulSum } );
+#if HAVE_AVX_VARIANTS
+	const CpuFeatures &cpu = GetCpuFeatures( );
+	if( cpu.avx2 && cpu.fma )
+		variants.push_back( { "avx2", AVX2_WIDTH, Avx2Mul, Avx2MulSum } );
+	if( cpu.avx512f )
+		variants.push_back( { "avx512", AVX512_WIDTH, Avx512Mul, Avx512MulSum } );
+#endif
+	return variants;
+}
+
+static SimdVariant	Simd = { "sse", SSE_WIDTH, SseMul, SseMulSum };
+
+// use the named variant, or the widest one if name is NULL or "best";
+// returns false (and keeps the current one) if it can't run here:
+inline bool
+SelectSimd( const char *name )
+{
+	std::vector<SimdVariant> variants = SimdVariants( );
+	if( name == NULL || strcmp( name, "best" ) == 0 )
+	{
+		Simd = variants.back( );
+		return true;
+	}
+	for( SimdVariant &v : variants )
+	{
+		if( strcmp( v.name, name ) == 0 )
+		{
+			Simd = v;
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void
+SimdMul( float *a, float *b, float *c, int len )
+{
+	Simd.mul( a, b, c, len );
+}
+
+inline float
+SimdMulSum( float *a, float *b, int len )
+{
+	return Simd.mulSum( a, b, len );
+}
+
+#endif		// PROJECT4_KERNELS_H
@@ -0,0 +1,220 @@
+/*
+ *
+ * Splitting an array among the threads of the Project #4 multicore ("extra credit") runs.
+ *
+ * The original split gave each thread arraySize/t elements: the last arraySize%t were never
+ * computed, and the boundaries fell in the middle of cache lines, so two threads storing into C
+ * next to a boundary kept stealing the line from each other (false sharing). Here every chunk
+ * starts on a cache-line boundary (the arrays are 64-byte aligned), the whole array is always
+ * covered, and the chunks can be handed out three ways:
+ *
+ *		static		one contiguous chunk per thread, split as evenly as the cache lines allow
+ *		dynamic		chunks of --chunk floats, taken from a shared counter as threads free up
+ *		guided		like dynamic, but each grab is remaining/(2*threads), never below --chunk
+ *
+ * With Busy( ) on, every thread also records how long it spent from entering the parallel region
+ * to finishing its last chunk, so a lopsided split shows up as per-thread time, not just as a
+ * lower speedup.
+ *
+ */
+
+#ifndef PROJECT4_PARTITION_H
+#define PROJECT4_PARTITION_H
+
+#include <stdio.h>
+#include <string.h>
+#include <omp.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#define CACHE_LINE_BYTES	64
+#define CACHE_LINE_FLOATS	( CACHE_LINE_BYTES / (int)sizeof(float) )
+#define DEFAULT_CHUNK		4096		// floats per dynamic/guided chunk (16 KB)
+
+enum Schedule { SCHEDULE_STATIC, SCHEDULE_DYNAMIC, SCHEDULE_GUIDED };
+
+// one per thread, each on its own cache line so the timers don't false-share either:
+struct alignas(CACHE_LINE_BYTES) BusyTime
+{
+	double	seconds;
+};
+
+struct Partitioner
+{
+	Schedule				schedule;
+	int						chunk;			// floats, a multiple of CACHE_LINE_FLOATS
+	bool					timing;			// record per-thread busy time?
+	std::vector<BusyTime>	busy;			// summed over calls while timing is on
+	int						calls;
+
+	Partitioner( ) : schedule( SCHEDULE_STATIC ), chunk( DEFAULT_CHUNK ), timing( false ), calls( 0 ) { }
+};
+
+
+inline int
+RoundUpToLine( long long n )
+{
+	return (int)( ( ( n + CACHE_LINE_FLOATS-1 ) / CACHE_LINE_FLOATS ) * CACHE_LINE_FLOATS );
+}
+
+inline const char *
+ScheduleName( Schedule s )
+{
+	return s == SCHEDULE_DYNAMIC ? "dynamic" : s == SCHEDULE_GUIDED ? "guided" : "static";
+}
+
+// "static", "dynamic" or "guided", with the chunk size in floats:
+inline bool
+SetSchedule( Partitioner &p, const char *name, long long chunk )
+{
+	if( strcmp( name, "static" ) == 0 )
+		p.schedule = SCHEDULE_STATIC;
+	else if( strcmp( name, "dynamic" ) == 0 )
+		p.schedule = SCHEDULE_DYNAMIC;
+	else if( strcmp( name, "guided" ) == 0 )
+		p.schedule = SCHEDULE_GUIDED;
+	else
+		return false;
+	p.chunk = RoundUpToLine( std::max( chunk, 1LL ) );
+	return true;
+}
+
+// where thread t's static chunk starts -- always on a cache line, and thread numThreads "starts" at n:
+inline int
+StaticBoundary( int t, int n, int numThreads )
+{
+	if( t >= numThreads )
+		return n;
+	long long line = ( (long long)n * t / numThreads ) / CACHE_LINE_FLOATS * CACHE_LINE_FLOATS;
+	return (int) std::min( line, (long long)n );
+}
+
+// the same, in the form numa.h's FirstTouchFloats( ) and PrintPlacement( ) take, so the arrays are
+// first touched -- and their placement checked -- along the kernels' boundaries:
+inline long long
+StaticBoundaryStart( int t, long long n, int numThreads )
+{
+	return StaticBoundary( t, (int)n, numThreads );
+}
+
+// call body( first, count ) for this thread's share of [0,n) -- must be called by every thread
+// of the current team, with "next" shared among them and 0 at the start:
+template< class BODY >
+void
+ForEachChunk( const Partitioner &p, int n, std::atomic<long long> &next, BODY body )
+{
+	int me = omp_get_thread_num( );
+	int numThreads = omp_get_num_threads( );
+
+	switch( p.schedule )
+	{
+		case SCHEDULE_STATIC:
+		{
+			int first = StaticBoundary( me, n, numThreads );
+			int last  = StaticBoundary( me+1, n, numThreads );
+			if( last > first )
+				body( first, last-first );
+			break;
+		}
+
+		case SCHEDULE_DYNAMIC:
+			while( true )
+			{
+				long long first = next.fetch_add( p.chunk );
+				if( first >= n )
+					break;
+				body( (int)first, (int) std::min( (long long)p.chunk, n-first ) );
+			}
+			break;
+
+		case SCHEDULE_GUIDED:
+			while( true )
+			{
+				long long first = next.load( );
+				long long remaining = n - first;
+				if( remaining <= 0 )
+					break;
+				long long count = std::max( (long long)p.chunk, (long long)RoundUpToLine( remaining / (2*numThreads) ) );
+				count = std::min( count, remaining );
+				if( next.compare_exchange_weak( first, first+count ) )
+					body( (int)first, (int)count );
+			}
+			break;
+	}
+}
+
+// run body( first, count ) over [0,n) on the current team size:
+template< class BODY >
+void
+ParallelFor( Partitioner &p, int n, BODY body )
+{
+	std::atomic<long long> next( 0 );
+	#pragma omp parallel
+	{
+		double t0 = p.timing ? omp_get_wtime( ) : 0.;
+		ForEachChunk( p, n, next, body );
+		if( p.timing )
+			p.busy[ omp_get_thread_num( ) ].seconds += omp_get_wtime( ) - t0;
+	}
+	if( p.timing )
+		p.calls++;
+}
+
+// the same, summing what body( first, count ) returns:
+template< class BODY >
+float
+ParallelSum( Partitioner &p, int n, BODY body )
+{
+	std::atomic<long long> next( 0 );
+	float sum = 0.;
+	#pragma omp parallel reduction(+:sum)
+	{
+		double t0 = p.timing ? omp_get_wtime( ) : 0.;
+		ForEachChunk( p, n, next, [&]( int first, int count ) { sum += body( first, count ); } );
+		if( p.timing )
+			p.busy[ omp_get_thread_num( ) ].seconds += omp_get_wtime( ) - t0;
+	}
+	if( p.timing )
+		p.calls++;
+	return sum;
+}
+
+// run the kernel numCalls times with the busy timers on, and return each thread's
+// busy seconds per call:
+template< class KERNEL >
+std::vector<double>
+MeasureBusy( Partitioner &p, int numThreads, KERNEL kernel, int numCalls )
+{
+	p.busy.assign( numThreads, BusyTime( ) );
+	p.calls = 0;
+	p.timing = true;
+	for( int i = 0; i < numCalls; i++ )
+		kernel( );
+	p.timing = false;
+
+	std::vector<double> perCall( numThreads, 0. );
+	for( int t = 0; t < numThreads; t++ )
+		perCall[t] = p.calls > 0 ? p.busy[t].seconds / (double)p.calls : 0.;
+	return perCall;
+}
+
+// one line per kernel: every thread's busy time and the max/mean imbalance:
+inline void
+PrintBusy( FILE *fp, const char *label, const std::vector<double> &busy )
+{
+	double sum = 0., most = 0.;
+	for( double b : busy )
+	{
+		sum += b;
+		most = std::max( most, b );
+	}
+	double mean = busy.empty( ) ? 0. : sum / (double)busy.size( );
+
+	fprintf( fp, "%-24s busy us/call:", label );
+	for( size_t t = 0; t < busy.size( ); t++ )
+		fprintf( fp, "  t%zu %8.2lf", t, 1.e6*busy[t] );
+	fprintf( fp, "   imbalance (max/mean) %5.2lf\n", mean > 0. ? most/mean : 0. );
+}
+
+#endif		// PROJECT4_PARTITION_H
@@ -19,14 +19,22 @@
 #include <sys/resource.h>
 #include <omp.h>
 
-// SSE stands for Streaming SIMD Extensions
+#include "../Common/driver.h"
+#include "../Common/timing.h"
+#include "../Common/results.h"
+#include "../Common/perfcounters.h"
+#include "../Common/roofline.h"
+#include "../Common/numa.h"
 
-#define SSE_WIDTH	4
-#define ALIGNED		__attribute__((aligned(16)))
+#include "kernels.h"
+#include "reductions.h"
+#include "partition.h"
 
 
+// minimum number of timing samples (more are taken until the timing is stable):
 #define NUMTRIES	100
 
+// default array size -- sweep at runtime with --sizes 4,40,400,...
 #ifndef ARRAYSIZE
 #define ARRAYSIZE	1000
 #endif
@@ -40,61 +48,105 @@
 #define CSV		false
 
 
-ALIGNED float A[ARRAYSIZE];
-ALIGNED float B[ARRAYSIZE];
-ALIGNED float C[ARRAYSIZE];
+// allocated (cache-line aligned) for each array size and thread count in the sweep, and first
+// touched by the threads that use them:
+float *A;
+float *B;
+float *C;
+
+// how the multicore runs split the arrays among their threads (--schedule, --chunk):
+Partitioner		Part;
+
+// report which NUMA node the array pages are on (--placement)?
+bool			Placement;
+
+// largest relative error a multiply-sum may have against the double-precision reference (--budget):
+double			ErrorBudget;
+
+// hardware counters for the thread count being measured (--perf):
+bool			UsePerf;
+PerfCounters	Perf;
+
+// ceilings for 1 thread and each --threads value (--roofline), and which one is the widest:
+std::vector<Roofline>	Roofs;
+int						Widest;
 
 
-void	SimdMul(    float *, float *,  float *, int );
 void	NonSimdMul( float *, float *,  float *, int );
-float	SimdMulSum(    float *, float *, int );
 float	NonSimdMulSum( float *, float *, int );
+void	RunSize( int, std::vector<long long> &, const TimingConfig &, bool );
+void	PlaceArrays( int, int );
+void	FreeArrays( );
+void	EmitMul( const char *, int, int, double, const TimingStats &, const PerfCounts & );
+void	EmitMulSum( const char *, int, int, double, const TimingStats &, const PerfCounts &, float, double );
+void	OpenPerf( int );
+void	RunVariants( int, double, double, double, const TimingConfig & );
+void	RunReductions( int, double, double, const TimingConfig & );
+void	PrintRooflineRow( int, bool, int, const TimingStats &, const TimingStats &, const TimingStats &, const TimingStats & );
+
+
+// count one kernel with the hardware counters, if they are on:
+template< class KERNEL >
+PerfCounts
+CountKernel( KERNEL kernel, const TimingStats &st )
+{
+	PerfCounts c = { 0., 0., 0., 0. };
+	if( Perf.open )
+		c = PerfMeasure( Perf, kernel, 10*st.repsPerSample );
+	return c;
+}
 
 
-int
-main( int argc, char *argv[ ] )
+void
+RunSize( int arraySize, std::vector<long long> &threads, const TimingConfig &timing, bool reductions )
 {
-	for( int i = 0; i < ARRAYSIZE; i++ )
-	{
-		A[i] = sqrtf( (float)(i+1) );
-		B[i] = sqrtf( (float)(i+1) );
-	}
+	// the single-thread columns run on the main thread, so it touches the arrays first:
+	PlaceArrays( arraySize, 1 );
+
+	// double-precision reference for checking the reductions:
+	double reference = 0.;
+	for( int i = 0; i < arraySize; i++ )
+		reference += (double)A[i] * (double)B[i];
+
+	OpenPerf( 1 );
+
+	// the S columns use the selected (by default the widest) SIMD variant:
+	std::string simdMul    = std::string( "SimdMul/" ) + Simd.name;
+	std::string simdMulSum = std::string( "SimdMulSum/" ) + Simd.name;
 
 	if ( CSV )
-		fprintf( stderr, "%12d,", ARRAYSIZE );
+		fprintf( stderr, "%12d,", arraySize );
 	else
-		fprintf( stderr, "%12d\t", ARRAYSIZE );
+		fprintf( stderr, "%12d\t", arraySize );
 
-	double maxPerformance = 0.;
-	for( int t = 0; t < NUMTRIES; t++ )
+	memset( C, 0, arraySize*sizeof(float) );
+	auto mulN = [&]( )
 	{
-		double time0 = omp_get_wtime( );
-		NonSimdMul( A, B, C, ARRAYSIZE );
-		double time1 = omp_get_wtime( );
-		double perf = (double)ARRAYSIZE / (time1 - time0);
-		if( perf > maxPerformance )
-			maxPerformance = perf;
-	}
+		NonSimdMul( A, B, C, arraySize );
+	};
+	TimingStats stn = TimeKernel( mulN, timing );
+	PerfCounts pcn = CountKernel( mulN, stn );
+	double maxPerformance = (double)arraySize / stn.min;
 	double megaMults = maxPerformance / 1000000.;
+	EmitMul( "NonSimdMul", 1, arraySize, megaMults, stn, pcn );
 	if ( CSV )
 		fprintf( stderr, "%10.2lf,", megaMults );
 	else
 		fprintf( stderr, "N   %10.2lf\t", megaMults );
 	double mmn = megaMults;
 	if ( DEBUG )
-		fprintf( stderr, "\nNon-SIMD SimdMul:\t\t[ %8.1f , %8.1f ]\n", C[0], C[ARRAYSIZE-1]);
+		fprintf( stderr, "\nNon-SIMD SimdMul:\t\t[ %8.1f , %8.1f ]\n", C[0], C[arraySize-1]);
 
-	maxPerformance = 0.;
-	for( int t = 0; t < NUMTRIES; t++ )
+	memset( C, 0, arraySize*sizeof(float) );
+	auto mulS = [&]( )
 	{
-		double time0 = omp_get_wtime( );
-		SimdMul( A, B, C, ARRAYSIZE );
-		double time1 = omp_get_wtime( );
-		double perf = (double)ARRAYSIZE / (time1 - time0);
-		if( perf > maxPerformance )
-			maxPerformance = perf;
-	}
+		SimdMul( A, B, C, arraySize );
+	};
+	TimingStats sts = TimeKernel( mulS, timing );
+	PerfCounts pcs = CountKernel( mulS, sts );
+	maxPerformance = (double)arraySize / sts.min;
 	megaMults = maxPerformance / 1000000.;
+	EmitMul( simdMul.c_str( ), 1, arraySize, megaMults, sts, pcs );
 	if ( CSV )
 		fprintf( stderr, "%10.2lf,", megaMults );
 	else
@@ -106,37 +158,33 @@ main( int argc, char *argv[ ] )
 	else
 		fprintf( stderr, "(%6.2lf)\t", speedup );
 	if ( DEBUG )
-		fprintf( stderr, "\nSIMD SimdMul:\t\t\t[ %8.1f , %8.1f ]\n", C[0], C[ARRAYSIZE-1]);
+		fprintf( stderr, "\nSIMD SimdMul:\t\t\t[ %8.1f , %8.1f ]\n", C[0], C[arraySize-1]);
 
-	maxPerformance = 0.;
 	float sumn, sums;
-	for( int t = 0; t < NUMTRIES; t++ )
+	auto mulSumN = [&]( )
 	{
-		double time0 = omp_get_wtime( );
-		sumn = NonSimdMulSum( A, B, ARRAYSIZE );
-		double time1 = omp_get_wtime( );
-		double perf = (double)ARRAYSIZE / (time1 - time0);
-		if( perf > maxPerformance )
-			maxPerformance = perf;
-	}
+		sumn = NonSimdMulSum( A, B, arraySize );
+	};
+	TimingStats strn = TimeKernel( mulSumN, timing );
+	PerfCounts pcrn = CountKernel( mulSumN, strn );
+	maxPerformance = (double)arraySize / strn.min;
 	double megaMultAdds = maxPerformance / 1000000.;
+	EmitMulSum( "NonSimdMulSum", 1, arraySize, megaMultAdds, strn, pcrn, sumn, reference );
 	if ( CSV )
 		fprintf( stderr, "%10.2lf,", megaMultAdds );
 	else
 		fprintf( stderr, "N   %10.2lf\t", megaMultAdds );
 	double mmrn = megaMultAdds;
 
-	maxPerformance = 0.;
-	for( int t = 0; t < NUMTRIES; t++ )
+	auto mulSumS = [&]( )
 	{
-		double time0 = omp_get_wtime( );
-		sums = SimdMulSum( A, B, ARRAYSIZE );
-		double time1 = omp_get_wtime( );
-		double perf = (double)ARRAYSIZE / (time1 - time0);
-		if( perf > maxPerformance )
-			maxPerformance = perf;
-	}
+		sums = SimdMulSum( A, B, arraySize );
+	};
+	TimingStats strs = TimeKernel( mulSumS, timing );
+	PerfCounts pcrs = CountKernel( mulSumS, strs );
+	maxPerformance = (double)arraySize / strs.min;
 	megaMultAdds = maxPerformance / 1000000.;
+	EmitMulSum( simdMulSum.c_str( ), 1, arraySize, megaMultAdds, strs, pcrs, sums, reference );
 	if ( CSV )
 		fprintf( stderr, "%10.2lf,", megaMultAdds );
 	else
@@ -149,32 +197,53 @@ main( int argc, char *argv[ ] )
 		fprintf( stderr, "(%6.2lf)\n", speedup );
     if ( DEBUG )
 		fprintf( stderr, "MulSum:\t\t\t\t[ %8.1f , %8.1f ]\n", sumn, sums );
+	if ( timing.printStats )
+	{
+		PrintTimingStats( stderr, "    N   Mul", stn, (double)arraySize );
+		PrintTimingStats( stderr, "    S   Mul", sts, (double)arraySize );
+		PrintTimingStats( stderr, "    N   MulSum", strn, (double)arraySize );
+		PrintTimingStats( stderr, "    S   MulSum", strs, (double)arraySize );
+	}
+	if ( Perf.open )
+	{
+		PrintPerfCounts( stderr, "    N   Mul", pcn, 12.*arraySize, (double)arraySize );
+		PrintPerfCounts( stderr, "    S   Mul", pcs, 12.*arraySize, (double)arraySize );
+		PrintPerfCounts( stderr, "    N   MulSum", pcrn, 8.*arraySize, (double)arraySize );
+		PrintPerfCounts( stderr, "    S   MulSum", pcrs, 8.*arraySize, (double)arraySize );
+	}
+	PrintRooflineRow( 1, false, arraySize, stn, sts, strn, strs );
+
+	// the other SIMD variants this CPU has, one row each under the S columns:
+	RunVariants( arraySize, mmn, mmrn, reference, timing );
+
+	// the multi-accumulator and compensated reductions (--reductions):
+	if( reductions )
+		RunReductions( arraySize, mmrn, reference, timing );
 
     /* 		Extra Credit	*/
-    int threads[] = {1, 2, 4};
+    int numThreads = (int)threads.size( );
 
-    for( int i = 0; i < 3; i++) {
+    for( int i = 0; i < numThreads; i++) {
       	// set number of threads
-    	int t = threads[i];
+    	int t = (int)threads[i];
     	omp_set_num_threads( t );
-        int num_elements_per_core = ARRAYSIZE / t;
+		PlaceArrays( arraySize, t );
+		OpenPerf( t );
 
-        double maxPerformance = 0.;
-		for( int t = 0; t < NUMTRIES; t++ )
+		memset( C, 0, arraySize*sizeof(float) );
+		auto mulN = [&]( )
 		{
-			double time0 = omp_get_wtime( );
-			#pragma omp parallel
+			ParallelFor( Part, arraySize, [&]( int first, int count )
 			{
-				int thisThread = omp_get_thread_num( );
-				int first = thisThread * num_elements_per_core;
-				NonSimdMul( &A[first], &B[first], &C[first], num_elements_per_core );
-			}
-			double time1 = omp_get_wtime( );
-			double perf = (double)ARRAYSIZE / (time1 - time0);
-			if( perf > maxPerformance )
-				maxPerformance = perf;
-		}
+				NonSimdMul( &A[first], &B[first], &C[first], count );
+			} );
+		};
+		TimingStats stn = TimeKernel( mulN, timing );
+		PerfCounts pcn = CountKernel( mulN, stn );
+		std::vector<double> bn = MeasureBusy( Part, t, mulN, 10*stn.repsPerSample );
+		double maxPerformance = (double)arraySize / stn.min;
 		double megaMults = maxPerformance / 1000000.;
+		EmitMul( "NonSimdMul", t, arraySize, megaMults, stn, pcn );
 		if ( CSV )
 			fprintf( stderr, "%10.2lf,", megaMults );
 		else
@@ -186,24 +255,22 @@ main( int argc, char *argv[ ] )
     	else
     		fprintf( stderr, "(%6.2lf)\t", speedup );
     	if ( DEBUG )
-    		fprintf( stderr, "\nNon-SIMD+%d Cores SimdMul:\t[ %8.1f , %8.1f ]\n", t, C[0], C[ARRAYSIZE-1]);
+    		fprintf( stderr, "\nNon-SIMD+%d Cores SimdMul:\t[ %8.1f , %8.1f ]\n", t, C[0], C[arraySize-1]);
 
-		maxPerformance = 0.;
-		for( int t = 0; t < NUMTRIES; t++ )
+		memset( C, 0, arraySize*sizeof(float) );
+		auto mulS = [&]( )
 		{
-			double time0 = omp_get_wtime( );
-			#pragma omp parallel
+			ParallelFor( Part, arraySize, [&]( int first, int count )
 			{
-				int thisThread = omp_get_thread_num( );
-				int first = thisThread * num_elements_per_core;
-            	SimdMul( &A[first], &B[first], &C[first], num_elements_per_core );
-            }
-			double time1 = omp_get_wtime( );
-			double perf = (double)ARRAYSIZE / (time1 - time0);
-			if( perf > maxPerformance )
-				maxPerformance = perf;
-		}
+				SimdMul( &A[first], &B[first], &C[first], count );
+			} );
+		};
+		TimingStats sts = TimeKernel( mulS, timing );
+		PerfCounts pcs = CountKernel( mulS, sts );
+		std::vector<double> bs = MeasureBusy( Part, t, mulS, 10*sts.repsPerSample );
+		maxPerformance = (double)arraySize / sts.min;
 		megaMults = maxPerformance / 1000000.;
+		EmitMul( simdMul.c_str( ), t, arraySize, megaMults, sts, pcs );
 		if ( CSV )
 			fprintf( stderr, "%10.2lf,", megaMults );
 		else
@@ -215,26 +282,21 @@ main( int argc, char *argv[ ] )
 		else
 			fprintf( stderr, "(%6.2lf)\t", speedup );
 		if ( DEBUG )
-			fprintf( stderr, "\nSIMD+%d Cores SimdMul:\t\t[ %8.1f , %8.1f ]\n", t, C[0], C[ARRAYSIZE-1]);
+			fprintf( stderr, "\nSIMD+%d Cores SimdMul:\t\t[ %8.1f , %8.1f ]\n", t, C[0], C[arraySize-1]);
 
-		maxPerformance = 0.;
-		for( int t = 0; t < NUMTRIES; t++ )
+		auto mulSumN = [&]( )
 		{
-		        sumn = 0.;
-			double time0 = omp_get_wtime( );
-			#pragma omp parallel reduction(+:sumn)
+			sumn = ParallelSum( Part, arraySize, [&]( int first, int count )
 			{
-				int thisThread = omp_get_thread_num( );
-				int first = thisThread * num_elements_per_core;
-		                float sum = NonSimdMulSum( &A[first], &B[first], num_elements_per_core );
-				sumn += sum;
-			}
-			double time1 = omp_get_wtime( );
-			double perf = (double)ARRAYSIZE / (time1 - time0);
-			if( perf > maxPerformance )
-				maxPerformance = perf;
-		}
+				return NonSimdMulSum( &A[first], &B[first], count );
+			} );
+		};
+		TimingStats strn = TimeKernel( mulSumN, timing );
+		PerfCounts pcrn = CountKernel( mulSumN, strn );
+		std::vector<double> brn = MeasureBusy( Part, t, mulSumN, 10*strn.repsPerSample );
+		maxPerformance = (double)arraySize / strn.min;
 		double megaMultAdds = maxPerformance / 1000000.;
+		EmitMulSum( "NonSimdMulSum", t, arraySize, megaMultAdds, strn, pcrn, sumn, reference );
 		if ( CSV )
 			fprintf( stderr, "%10.2lf,", megaMultAdds );
 		else
@@ -246,24 +308,19 @@ main( int argc, char *argv[ ] )
     	else
     		fprintf( stderr, "(%6.2lf)\t", speedup );
 
-		maxPerformance = 0.;
-		for( int t = 0; t < NUMTRIES; t++ )
+		auto mulSumS = [&]( )
 		{
-			sums = 0.;
-			double time0 = omp_get_wtime( );
-			#pragma omp parallel reduction(+:sums)
+			sums = ParallelSum( Part, arraySize, [&]( int first, int count )
 			{
-				int thisThread = omp_get_thread_num( );
-				int first = thisThread * num_elements_per_core;
-				float sum = SimdMulSum( &A[first], &B[first], num_elements_per_core );
-				sums += sum;
-			}
-			double time1 = omp_get_wtime( );
-			double perf = (double)ARRAYSIZE / (time1 - time0);
-			if( perf > maxPerformance )
-				maxPerformance = perf;
-		}
+				return SimdMulSum( &A[first], &B[first], count );
+			} );
+		};
+		TimingStats strs = TimeKernel( mulSumS, timing );
+		PerfCounts pcrs = CountKernel( mulSumS, strs );
+		std::vector<double> brs = MeasureBusy( Part, t, mulSumS, 10*strs.repsPerSample );
+		maxPerformance = (double)arraySize / strs.min;
 		megaMultAdds = maxPerformance / 1000000.;
+		EmitMulSum( simdMulSum.c_str( ), t, arraySize, megaMultAdds, strs, pcrs, sums, reference );
 		if ( CSV )
 			fprintf( stderr, "%10.2lf,", megaMultAdds );
 		else
@@ -271,7 +328,7 @@ main( int argc, char *argv[ ] )
     	mmrs = megaMultAdds;
     	speedup = mmrs/mmrn;
     	if ( CSV )
-		if ( i == 2 )
+		if ( i == numThreads-1 )
     			fprintf( stderr, "%6.2lf\n", speedup );
 		else
 			fprintf( stderr, "%6.2lf,", speedup );
@@ -279,105 +336,361 @@ main( int argc, char *argv[ ] )
     		fprintf( stderr, "(%6.2lf)\n", speedup );
     	if ( DEBUG )
     		fprintf( stderr, "MulSum+%d Cores:\t\t\t[ %8.1f , %8.1f ]\n", t, sumn, sums );
+		if ( timing.printStats )
+		{
+			char label[64];
+			sprintf( label, "    N+%d Mul", t );
+			PrintTimingStats( stderr, label, stn, (double)arraySize );
+			sprintf( label, "    S+%d Mul", t );
+			PrintTimingStats( stderr, label, sts, (double)arraySize );
+			sprintf( label, "    N+%d MulSum", t );
+			PrintTimingStats( stderr, label, strn, (double)arraySize );
+			sprintf( label, "    S+%d MulSum", t );
+			PrintTimingStats( stderr, label, strs, (double)arraySize );
+		}
+		if ( Perf.open )
+		{
+			char label[64];
+			sprintf( label, "    N+%d Mul", t );
+			PrintPerfCounts( stderr, label, pcn, 12.*arraySize, (double)arraySize );
+			sprintf( label, "    S+%d Mul", t );
+			PrintPerfCounts( stderr, label, pcs, 12.*arraySize, (double)arraySize );
+			sprintf( label, "    N+%d MulSum", t );
+			PrintPerfCounts( stderr, label, pcrn, 8.*arraySize, (double)arraySize );
+			sprintf( label, "    S+%d MulSum", t );
+			PrintPerfCounts( stderr, label, pcrs, 8.*arraySize, (double)arraySize );
+		}
+		PrintRooflineRow( t, true, arraySize, stn, sts, strn, strs );
+		{
+			char label[64];
+			sprintf( label, "    N+%d Mul", t );
+			PrintBusy( stderr, label, bn );
+			sprintf( label, "    S+%d Mul", t );
+			PrintBusy( stderr, label, bs );
+			sprintf( label, "    N+%d MulSum", t );
+			PrintBusy( stderr, label, brn );
+			sprintf( label, "    S+%d MulSum", t );
+			PrintBusy( stderr, label, brs );
+		}
+		if( Placement )
+		{
+			char label[64];
+			sprintf( label, "    A pages (%d threads)", t );
+			PrintPlacement( stderr, label, A, arraySize, t, StaticBoundaryStart );
+		}
     }
+	PerfClose( Perf );
+	FreeArrays( );
+
+}
+
+
+int
+main( int argc, char *argv[ ] )
+{
+	std::vector<long long> sizes   = ArgList( argc, argv, "--sizes",   { ARRAYSIZE } );
+	std::vector<long long> threads = ArgList( argc, argv, "--threads", { 1, 2, 4 } );
+	TimingConfig timing = TimingFromArgs( argc, argv, (int) ArgInt( argc, argv, "--tries", NUMTRIES ) );
+	OpenResults( argc, argv );
+	UsePerf = ArgFlag( argc, argv, "--perf" );
+	ErrorBudget = ArgDouble( argc, argv, "--budget", 1.e-3 );
+	Placement = ArgFlag( argc, argv, "--placement" );
+
+	// how the multicore runs split the arrays: --schedule static|dynamic|guided, --chunk floats
+	const char *schedule = ArgString( argc, argv, "--schedule", "static" );
+	if( ! SetSchedule( Part, schedule, ArgInt( argc, argv, "--chunk", DEFAULT_CHUNK ) ) )
+	{
+		fprintf( stderr, "Unknown --schedule '%s' (use static, dynamic or guided)\n", schedule );
+		exit( 1 );
+	}
+	bool reductions = ArgFlag( argc, argv, "--reductions" );
+
+	// pick the widest SIMD variant this CPU supports, unless told otherwise with --simd sse|avx2|avx512:
+	const char *simd = ArgString( argc, argv, "--simd", "best" );
+	if( ! SelectSimd( simd ) )
+	{
+		fprintf( stderr, "SIMD variant '%s' is not available here\n", simd );
+		exit( 1 );
+	}
+	PrintCpuFeatures( stderr );
+	fprintf( stderr, "Using the %s kernels (%d floats per vector)\n", Simd.name, Simd.width );
+	if( Part.schedule == SCHEDULE_STATIC )
+		fprintf( stderr, "Multicore runs split the arrays statically on cache-line boundaries\n" );
+	else
+		fprintf( stderr, "Multicore runs split the arrays into %s chunks of %s%d floats\n", ScheduleName( Part.schedule ),
+			Part.schedule == SCHEDULE_GUIDED ? "at least " : "", Part.chunk );
+
+	// bind each OpenMP thread to its own cpu (thread t stays on the same cpu for every team size) --
+	// before the roofline probes, so they run where the kernels will:
+	if( ArgFlag( argc, argv, "--pin" ) )
+		PinThreads( (int) *std::max_element( threads.begin( ), threads.end( ) ), stderr );
+
+	// roofline mode: measure the ceilings for the single-thread columns and every thread count up front:
+	Widest = 0;
+	if( ArgFlag( argc, argv, "--roofline" ) )
+	{
+		std::vector<long long> counts = threads;
+		counts.insert( counts.begin( ), 1 );
+		for( long long t : counts )
+		{
+			bool seen = false;
+			for( Roofline &roof : Roofs )
+				seen = seen || roof.threads == (int)t;
+			if( seen )
+				continue;
+
+			omp_set_num_threads( (int)t );
+			Roofs.push_back( MeasureRoofline( timing ) );
+			PrintRoofline( stderr, Roofs.back( ) );
+			if( Roofs.back( ).threads > Roofs[Widest].threads )
+				Widest = (int)Roofs.size( ) - 1;
+		}
+	}
+
+	for( long long n : sizes )
+		RunSize( (int)n, threads, timing, reductions );
+	CloseResults( );
 
 	return 0;
 }
 
 
+// (re)allocate the arrays so that numThreads threads, splitting them the way the kernels do,
+// touch their own parts first -- that puts each part on its thread's NUMA node:
 void
-NonSimdMul( float *A, float *B, float *C, int n )
+PlaceArrays( int arraySize, int numThreads )
 {
-	for( int i = 0; i < n; i++ ) {
-  		C[i] = A[i] * B[i];
-    }
+	FreeArrays( );
+	A = FirstTouchFloats( arraySize, numThreads, [ ]( long long i ) { return sqrtf( (float)(i+1) ); }, StaticBoundaryStart );
+	B = FirstTouchFloats( arraySize, numThreads, [ ]( long long i ) { return sqrtf( (float)(i+1) ); }, StaticBoundaryStart );
+	C = FirstTouchFloats( arraySize, numThreads, [ ]( long long ) { return 0.f; }, StaticBoundaryStart );
 }
 
-float
-NonSimdMulSum( float *A, float *B, int n )
+void
+FreeArrays( )
 {
-  	float sum = 0.;
-	for( int i = 0; i < n; i++ ) {
-		sum += A[i] * B[i];
-	}
-    return sum;
+	free( A );
+	free( B );
+	free( C );
+	A = B = C = NULL;
 }
 
 
+// (re)open the hardware counters for a team of numThreads:
 void
-SimdMul( float *a, float *b,   float *c,   int len )
+OpenPerf( int numThreads )
 {
-	int limit = ( len/SSE_WIDTH ) * SSE_WIDTH;
-	__asm
-	(
-		".att_syntax\n\t"
-		"movq    -24(%rbp), %r8\n\t"		// a
-		"movq    -32(%rbp), %rcx\n\t"		// b
-		"movq    -40(%rbp), %rdx\n\t"		// c
-	);
-
-	for( int i = 0; i < limit; i += SSE_WIDTH )
-	{
-		__asm
-		(
-			".att_syntax\n\t"
-			"movups	(%r8), %xmm0\n\t"	// load the first sse register
-			"movups	(%rcx), %xmm1\n\t"	// load the second sse register
-			"mulps	%xmm1, %xmm0\n\t"	// do the multiply
-			"movups	%xmm0, (%rdx)\n\t"	// store the result
-			"addq $16, %r8\n\t"
-			"addq $16, %rcx\n\t"
-			"addq $16, %rdx\n\t"
-		);
-	}
+	PerfClose( Perf );
+	if( UsePerf && ! PerfOpen( Perf, numThreads ) )
+		UsePerf = false;		// don't keep complaining
+}
 
-	for( int i = limit; i < len; i++ )
+// time the SIMD variants that aren't selected, one row each, with their speedups over the
+// same non-SIMD baselines as the main row:
+void
+RunVariants( int arraySize, double mmn, double mmrn, double reference, const TimingConfig &timing )
+{
+	std::vector<SimdVariant> variants = SimdVariants( );
+	for( SimdVariant &v : variants )
 	{
-		c[i] = a[i] * b[i];
+		if( strcmp( v.name, Simd.name ) == 0 )
+			continue;
+
+		memset( C, 0, arraySize*sizeof(float) );
+		auto mul = [&]( )
+		{
+			v.mul( A, B, C, arraySize );
+		};
+		TimingStats st = TimeKernel( mul, timing );
+		PerfCounts pc = CountKernel( mul, st );
+		double megaMults = (double)arraySize / st.min / 1000000.;
+		EmitMul( ( std::string( "SimdMul/" ) + v.name ).c_str( ), 1, arraySize, megaMults, st, pc );
+
+		float sum = 0.;
+		auto mulSum = [&]( )
+		{
+			sum = v.mulSum( A, B, arraySize );
+		};
+		TimingStats str = TimeKernel( mulSum, timing );
+		PerfCounts pcr = CountKernel( mulSum, str );
+		double megaMultAdds = (double)arraySize / str.min / 1000000.;
+		EmitMulSum( ( std::string( "SimdMulSum/" ) + v.name ).c_str( ), 1, arraySize, megaMultAdds, str, pcr, sum, reference );
+
+		if ( CSV )
+			fprintf( stderr, "%12s,,%10.2lf,%6.2lf,,%10.2lf,%6.2lf\n", v.name, megaMults, megaMults/mmn, megaMultAdds, megaMultAdds/mmrn );
+		else
+			fprintf( stderr, "%12s\t%14s\t\tS   %10.2lf\t(%6.2lf)\t%14s\t\tS   %10.2lf\t(%6.2lf)\n",
+				v.name, "", megaMults, megaMults/mmn, "", megaMultAdds, megaMultAdds/mmrn );
 	}
 }
 
+// time the reduction family of the selected SIMD variant, single-threaded, and report each
+// one's throughput and error so the fastest one within the error budget can be picked:
+void
+RunReductions( int arraySize, double mmrn, double reference, const TimingConfig &timing )
+{
+	std::vector<Reduction> family = Reductions( Simd );
+	const char *fastest = NULL;
+	double fastestRate = 0.;
 
+	// the scalar baseline's error, for comparison:
+	double baseError = fabs( (double)NonSimdMulSum( A, B, arraySize ) - reference ) / reference;
+	fprintf( stderr, "%12s\t%-16s %10.2lf MegaMultAdds/Sec  rel. error %9.2e\n", "", "N", mmrn, baseError );
 
-float
-SimdMulSum( float *a, float *b, int len )
+	for( Reduction &red : family )
+	{
+		float sum = 0.;
+		auto mulSum = [&]( )
+		{
+			sum = red.mulSum( A, B, arraySize );
+		};
+		TimingStats st = TimeKernel( mulSum, timing );
+		PerfCounts pc = CountKernel( mulSum, st );
+		double megaMultAdds = (double)arraySize / st.min / 1000000.;
+		double relError = fabs( (double)sum - reference ) / reference;
+
+		std::string kernel = std::string( "SimdMulSum/" ) + Simd.name + "/" + red.name;
+		EmitMulSum( kernel.c_str( ), 1, arraySize, megaMultAdds, st, pc, sum, reference );
+
+		char label[64];
+		sprintf( label, "S %s %s", Simd.name, red.name );
+		fprintf( stderr, "%12s\t%-16s %10.2lf MegaMultAdds/Sec  rel. error %9.2e  (%6.2lf)%s\n", "", label,
+			megaMultAdds, relError, megaMultAdds/mmrn, relError < ErrorBudget ? "" : "  [over budget]" );
+
+		if( relError < ErrorBudget && megaMultAdds > fastestRate )
+		{
+			fastest = red.name;
+			fastestRate = megaMultAdds;
+		}
+	}
+
+	if( fastest != NULL )
+		fprintf( stderr, "%12s\tfastest within a relative error of %g: %s %s\n", "", ErrorBudget, Simd.name, fastest );
+	else
+		fprintf( stderr, "%12s\tno reduction is within a relative error of %g\n", "", ErrorBudget );
+}
+
+// place the four kernels of one table row against the roofline for their thread count
+// ("team" rows are the N+t / S+t ones):
+void
+PrintRooflineRow( int threads, bool team, int arraySize, const TimingStats &stn, const TimingStats &sts, const TimingStats &strn, const TimingStats &strs )
 {
-	float sum[4] = { 0., 0., 0., 0. };
-	int limit = ( len/SSE_WIDTH ) * SSE_WIDTH;
-
-	__asm
-	(
-		".att_syntax\n\t"
-		"movq    -40(%rbp), %r8\n\t"		// a
-		"movq    -48(%rbp), %rcx\n\t"		// b
-		"leaq    -32(%rbp), %rdx\n\t"		// &sum[0]
-		"movups	 (%rdx), %xmm2\n\t"		// 4 copies of 0. in xmm2
-	);
-
-	for( int i = 0; i < limit; i += SSE_WIDTH )
+	const Roofline *here = NULL;
+	for( Roofline &roof : Roofs )
+	{
+		if( roof.threads == threads )
+			here = &roof;
+	}
+	if( here == NULL )
+		return;
+
+	// a multiply is 1 flop per 12 bytes (A, B in, C out), a multiply-add is 2 flops per 8 bytes:
+	double n = (double)arraySize;
+	const char *labels[4] = { "N   Mul", "S   Mul", "N   MulSum", "S   MulSum" };
+	const TimingStats *st[4] = { &stn, &sts, &strn, &strs };
+	double flops[4] = { n, n, 2.*n, 2.*n };
+	double bytes[4] = { 12.*n, 12.*n, 8.*n, 8.*n };
+	for( int k = 0; k < 4; k++ )
 	{
-		__asm
-		(
-			".att_syntax\n\t"
-			"movups	(%r8), %xmm0\n\t"	// load the first sse register
-			"movups	(%rcx), %xmm1\n\t"	// load the second sse register
-			"mulps	%xmm1, %xmm0\n\t"	// do the multiply
-			"addps	%xmm0, %xmm2\n\t"	// do the add
-			"addq $16, %r8\n\t"
-			"addq $16, %rcx\n\t"
-		);
+		char label[64];
+		if( ! team )
+			sprintf( label, "    %s", labels[k] );
+		else
+			sprintf( label, "    %c+%d %s", labels[k][0], threads, &labels[k][4] );
+		PrintRooflinePoint( stderr, label, flops[k], bytes[k], bytes[k], st[k]->min, *here, Roofs[Widest] );
 	}
+}
 
-	__asm
-	(
-		".att_syntax\n\t"
-		"movups	 %xmm2, (%rdx)\n\t"	// copy the sums back to sum[ ]
-	);
+// the counter-derived figures that go into a record:
+void
+AddPerfExtras( Result &r, const PerfCounts &c, double bytes, int arraySize )
+{
+	if( ! Perf.open )
+		return;
+	r.extra.push_back( { "ipc", c.Ipc( ) } );
+	r.extra.push_back( { "bytes_per_cycle", c.BytesPerCycle( bytes ) } );
+	r.extra.push_back( { "cycles_per_elem", c.cycles / (double)arraySize } );
+	r.extra.push_back( { "llc_misses_per_elem", c.llcMisses / (double)arraySize } );
+}
 
-	for( int i = limit; i < len; i++ )
+// write the structured record for a multiply, checking every element of C:
+void
+EmitMul( const char *kernel, int threads, int arraySize, double megaMults, const TimingStats &st, const PerfCounts &pc )
+{
+	int numWrong = 0;
+	for( int i = 0; i < arraySize; i++ )
 	{
-		sum[0] += a[i] * b[i];
+		if( C[i] != A[i] * B[i] )
+			numWrong++;
 	}
 
-	return sum[0] + sum[1] + sum[2] + sum[3];
+	Result r;
+	r.benchmark = "Project4";
+	r.kernel    = kernel;
+	r.threads   = threads;
+	r.size      = arraySize;
+	r.unit      = "elements";
+	r.rate      = megaMults;
+	r.rateUnit  = "MegaMults/Sec";
+	r.timing    = st;
+	r.checked   = true;
+	r.passed    = numWrong == 0;
+	r.check     = "C[i] == A[i]*B[i] for all i, " + std::to_string( numWrong ) + " wrong";
+	AddPerfExtras( r, pc, 12.*arraySize, arraySize );
+	EmitResult( r );
+}
+
+// write the structured record for a multiply-sum, checking it against the double-precision reference:
+void
+EmitMulSum( const char *kernel, int threads, int arraySize, double megaMultAdds, const TimingStats &st, const PerfCounts &pc, float sum, double reference )
+{
+	double relError = fabs( (double)sum - reference ) / reference;
+
+	Result r;
+	r.benchmark = "Project4";
+	r.kernel    = kernel;
+	r.threads   = threads;
+	r.size      = arraySize;
+	r.unit      = "elements";
+	r.rate      = megaMultAdds;
+	r.rateUnit  = "MegaMultAdds/Sec";
+	r.timing    = st;
+	r.checked   = true;
+	char check[64];
+	sprintf( check, "relative error vs double reference < %g", ErrorBudget );
+	r.passed    = relError < ErrorBudget;
+	r.check     = check;
+	r.extra.push_back( { "sum", (double)sum } );
+	r.extra.push_back( { "reference", reference } );
+	r.extra.push_back( { "rel_error", relError } );
+	AddPerfExtras( r, pc, 8.*arraySize, arraySize );
+	EmitResult( r );
 }
+
+
+// the non-SIMD baselines stay scalar even in an optimized build, otherwise the compiler
+// would vectorize them and the N columns would just measure its SIMD code:
+#if defined(__GNUC__) && ! defined(__clang__)
+#define NO_VECTORIZE	__attribute__(( optimize( "no-tree-vectorize" ) ))
+#else
+#define NO_VECTORIZE
+#endif
+
+NO_VECTORIZE void
+NonSimdMul( float *A, float *B, float *C, int n )
+{
+	for( int i = 0; i < n; i++ ) {
+  		C[i] = A[i] * B[i];
+    }
+}
+
+NO_VECTORIZE float
+NonSimdMulSum( float *A, float *B, int n )
+{
+  	float sum = 0.;
+	for( int i = 0; i < n; i++ ) {
+		sum += A[i] * B[i];
+	}
+    return sum;
+}
+
@@ -0,0 +1,257 @@
+/*
+ *
+ * A family of multiply-sum (dot product) reduction kernels for Project #4.
+ *
+ * SimdMulSum keeps one vector accumulator, so every iteration waits for the previous add (or
+ * fma) to finish: throughput is set by the add latency (~4 cycles) rather than by how many adds
+ * the core can start per cycle (2). Splitting the sum over K independent accumulators hides that
+ * latency. The float sums also lose precision as the array grows, so there are two
+ * error-compensated modes too:
+ *
+ *		x4, x8		4 or 8 independent vector accumulators, added together at the end
+ *		kahan		4 accumulators, each with a Kahan compensation term (error ~ independent of n)
+ *		pairwise	recursive halving down to blocks of PAIRWISE_BLOCK, each done with x4 (error ~ log n)
+ *
+ * The kernels are written once over GCC vector types and instantiated for each SIMD variant in
+ * kernels.h; the wrapper carries the target attribute and the always_inline body is compiled
+ * for that target, so the same source becomes SSE, AVX2+FMA or AVX-512 code.
+ *
+ * Loads are unaligned (they cost the same as aligned ones on the CPUs that have AVX), and the
+ * last partial vector is zero-padded instead of done in scalar code.
+ *
+ */
+
+#ifndef PROJECT4_REDUCTIONS_H
+#define PROJECT4_REDUCTIONS_H
+
+#include <string.h>
+#include <vector>
+
+#include "kernels.h"
+
+#define PAIRWISE_BLOCK		1024		// elements per leaf of the pairwise recursion
+
+#if defined(__GNUC__)
+#define REDUCTION_INLINE	__attribute__(( always_inline )) inline
+#else
+#define REDUCTION_INLINE	inline
+#endif
+
+
+#if defined(__GNUC__)
+
+typedef float	Vec4	__attribute__(( vector_size( 16 ) ));
+typedef float	Vec8	__attribute__(( vector_size( 32 ) ));
+typedef float	Vec16	__attribute__(( vector_size( 64 ) ));
+
+// (vectors go through references: passing them by value is an ABI question for the
+// non-AVX instantiations)
+template< class V >
+REDUCTION_INLINE void
+LoadVec( V &v, const float *p )
+{
+	memcpy( &v, p, sizeof(V) );
+}
+
+// the last n < W elements, with the rest of the vector zero:
+template< class V, int W >
+REDUCTION_INLINE void
+LoadPartial( V &v, const float *p, int n )
+{
+	v = V{ };
+	memcpy( &v, p, n*sizeof(float) );
+}
+
+// a[i .. i+W-1] * b[i .. i+W-1], zero-padded past len:
+template< class V, int W >
+REDUCTION_INLINE void
+Product( V &prod, const float *a, const float *b, int i, int len )
+{
+	V x, y;
+	if( i + W <= len )
+	{
+		LoadVec<V>( x, &a[i] );
+		LoadVec<V>( y, &b[i] );
+	}
+	else
+	{
+		LoadPartial<V,W>( x, &a[i], len-i );
+		LoadPartial<V,W>( y, &b[i], len-i );
+	}
+	prod = x * y;
+}
+
+template< class V, int W >
+REDUCTION_INLINE float
+HorizontalSum( const V &v )
+{
+	float sum = 0.;
+	for( int j = 0; j < W; j++ )
+		sum += v[j];
+	return sum;
+}
+
+// K independent accumulators:
+template< class V, int W, int K >
+REDUCTION_INLINE float
+MulSumAccum( const float *a, const float *b, int len )
+{
+	V acc[K];
+	for( int k = 0; k < K; k++ )
+		acc[k] = V{ };
+
+	int i = 0;
+	for( ; i + K*W <= len; i += K*W )
+	{
+		for( int k = 0; k < K; k++ )
+		{
+			V x, y;
+			LoadVec<V>( x, &a[i+k*W] );
+			LoadVec<V>( y, &b[i+k*W] );
+			acc[k] += x * y;
+		}
+	}
+	for( ; i < len; i += W )
+	{
+		V prod;
+		Product<V,W>( prod, a, b, i, len );
+		acc[0] += prod;
+	}
+
+	// combine the accumulators as a tree so none of them is added to a much bigger total:
+	for( int width = K/2; width > 0; width /= 2 )
+	{
+		for( int k = 0; k < width; k++ )
+			acc[k] += acc[k+width];
+	}
+	return HorizontalSum<V,W>( acc[0] );
+}
+
+// K accumulators, each Kahan-compensated:
+template< class V, int W, int K >
+REDUCTION_INLINE float
+MulSumKahan( const float *a, const float *b, int len )
+{
+	V sum[K], comp[K];
+	for( int k = 0; k < K; k++ )
+	{
+		sum[k]  = V{ };
+		comp[k] = V{ };
+	}
+
+	int i = 0;
+	for( ; i + K*W <= len; i += K*W )
+	{
+		for( int k = 0; k < K; k++ )
+		{
+			V x, y;
+			LoadVec<V>( x, &a[i+k*W] );
+			LoadVec<V>( y, &b[i+k*W] );
+			y = x * y - comp[k];
+			V t = sum[k] + y;
+			comp[k] = ( t - sum[k] ) - y;		// what got rounded off adding y
+			sum[k] = t;
+		}
+	}
+	for( ; i < len; i += W )
+	{
+		V prod;
+		Product<V,W>( prod, a, b, i, len );
+		V y = prod - comp[0];
+		V t = sum[0] + y;
+		comp[0] = ( t - sum[0] ) - y;
+		sum[0] = t;
+	}
+
+	// fold the compensations back in, then finish in double:
+	double total = 0.;
+	for( int k = 0; k < K; k++ )
+	{
+		V s = sum[k] - comp[k];
+		for( int j = 0; j < W; j++ )
+			total += (double)s[j];
+	}
+	return (float)total;
+}
+
+#endif		// __GNUC__
+
+
+typedef float	(*MulSumFunc)( float *, float *, int );
+
+// split in halves (on a block boundary) until a piece fits one block:
+inline float
+MulSumPairwise( MulSumFunc leaf, float *a, float *b, int len )
+{
+	if( len <= PAIRWISE_BLOCK )
+		return leaf( a, b, len );
+
+	int half = ( ( len/2 + PAIRWISE_BLOCK-1 ) / PAIRWISE_BLOCK ) * PAIRWISE_BLOCK;
+	return MulSumPairwise( leaf, a, b, half ) + MulSumPairwise( leaf, &a[half], &b[half], len-half );
+}
+
+
+// the instantiations for each SIMD variant:
+#if defined(__GNUC__)
+
+inline float	SseMulSum4( float *a, float *b, int len )		{ return MulSumAccum<Vec4,4,4>( a, b, len ); }
+inline float	SseMulSum8( float *a, float *b, int len )		{ return MulSumAccum<Vec4,4,8>( a, b, len ); }
+inline float	SseMulSumKahan( float *a, float *b, int len )	{ return MulSumKahan<Vec4,4,4>( a, b, len ); }
+inline float	SseMulSumPairwise( float *a, float *b, int len ){ return MulSumPairwise( SseMulSum4, a, b, len ); }
+
+#if HAVE_AVX_VARIANTS
+__attribute__(( target( "avx2,fma" ) )) inline float	Avx2MulSum4( float *a, float *b, int len )		{ return MulSumAccum<Vec8,8,4>( a, b, len ); }
+__attribute__(( target( "avx2,fma" ) )) inline float	Avx2MulSum8( float *a, float *b, int len )		{ return MulSumAccum<Vec8,8,8>( a, b, len ); }
+__attribute__(( target( "avx2,fma" ) )) inline float	Avx2MulSumKahan( float *a, float *b, int len )	{ return MulSumKahan<Vec8,8,4>( a, b, len ); }
+inline float											Avx2MulSumPairwise( float *a, float *b, int len ){ return MulSumPairwise( Avx2MulSum4, a, b, len ); }
+
+__attribute__(( target( "avx512f" ) )) inline float	Avx512MulSum4( float *a, float *b, int len )	{ return MulSumAccum<Vec16,16,4>( a, b, len ); }
+__attribute__(( target( "avx512f" ) )) inline float	Avx512MulSum8( float *a, float *b, int len )	{ return MulSumAccum<Vec16,16,8>( a, b, len ); }
+__attribute__(( target( "avx512f" ) )) inline float	Avx512MulSumKahan( float *a, float *b, int len ){ return MulSumKahan<Vec16,16,4>( a, b, len ); }
+inline float											Avx512MulSumPairwise( float *a, float *b, int len ){ return MulSumPairwise( Avx512MulSum4, a, b, len ); }
+#endif
+
+#endif		// __GNUC__
+
+
+struct Reduction
+{
+	const char *	name;
+	MulSumFunc		mulSum;
+};
+
+// the reduction family for one SIMD variant (the plain single-accumulator kernel first):
+inline std::vector<Reduction>
+Reductions( const SimdVariant &v )
+{
+	std::vector<Reduction> family;
+	family.push_back( { "x1", v.mulSum } );
+#if defined(__GNUC__)
+	if( strcmp( v.name, "sse" ) == 0 )
+	{
+		family.push_back( { "x4",       SseMulSum4 } );
+		family.push_back( { "x8",       SseMulSum8 } );
+		family.push_back( { "kahan",    SseMulSumKahan } );
+		family.push_back( { "pairwise", SseMulSumPairwise } );
+	}
+#if HAVE_AVX_VARIANTS
+	else if( strcmp( v.name, "avx2" ) == 0 )
+	{
+		family.push_back( { "x4",       Avx2MulSum4 } );
+		family.push_back( { "x8",       Avx2MulSum8 } );
+		family.push_back( { "kahan",    Avx2MulSumKahan } );
+		family.push_back( { "pairwise", Avx2MulSumPairwise } );
+	}
+	else if( strcmp( v.name, "avx512" ) == 0 )
+	{
+		family.push_back( { "x4",       Avx512MulSum4 } );
+		family.push_back( { "x8",       Avx512MulSum8 } );
+		family.push_back( { "kahan",    Avx512MulSumKahan } );
+		family.push_back( { "pairwise", Avx512MulSumPairwise } );
+	}
+#endif
+#endif
+	return family;
+}
+
+#endif		// PROJECT4_REDUCTIONS_H
@@ -7,3 +7,10 @@ do
                 ./proj05
         done
 done
+
+# no GPU? the same sweep on the CPU, in one process:
+# cmake -S . -B build && cmake --build build && ./build/proj05cpu --trials 1024,4096,16384,65536,262144,1048576,2097152 --blocksizes 8,32,64,128,256
+
+# the chunked multi-stream pipeline, timed end to end (CPU: emulated streams on host threads):
+# nvcc -DNUMTRIALS=67108864 -DBLOCKSIZE=128 -DNUMSTREAMS=4 -o proj05 proj05.cu && ./proj05
+# ./build/proj05cpu --trials 67108864 --blocksizes 128 --streams 1,2,4
@@ -0,0 +1,250 @@
+/*
+ *
+ * The Project #5 Monte Carlo kernel body, shared by the CUDA build (proj05.cu) and the CPU build
+ * (proj05cpu.cpp) for machines without a GPU.
+ *
+ * MonteCarloBody( ) is one CUDA thread's work, written once: under nvcc it is __host__ __device__
+ * and the __global__ MonteCarlo kernel calls it with gid = blockIdx.x*blockDim.x + threadIdx.x;
+ * under g++/clang it is plain inline code, and LaunchKernel( ) runs the same grid of blocks of
+ * threads on the CPU:
+ *
+ *		Dim3 grid( NUMBLOCKS, 1, 1 );
+ *		Dim3 threads( BLOCKSIZE, 1, 1 );
+ *		LaunchKernel( grid, threads, [&]( unsigned int gid ) { MonteCarloBody( gid, dvs, ... ); } );
+ *
+ * The blocks are spread over the OpenMP threads, and the threads of a block are an "omp simd"
+ * loop, so a block of BLOCKSIZE CUDA threads becomes BLOCKSIZE/W vector iterations -- the same
+ * grid/block shape as the GPU run, so the BLOCKSIZE sweep still means something. As on the GPU,
+ * only NUMBLOCKS*BLOCKSIZE trials are computed when NUMTRIALS isn't a multiple of BLOCKSIZE.
+ *
+ * LaunchReduceKernel( ) is the same for the MonteCarloReduce kernel, which counts the hits inside
+ * the kernel instead of writing one int per trial for the host to copy back and add up.
+ *
+ * The random inputs are made on the host with the same rand( )-based Ranf( ) for both builds,
+ * so a given --seed gives the same dataset on either.
+ *
+ */
+
+#ifndef PROJECT5_MONTECARLO_H
+#define PROJECT5_MONTECARLO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef __CUDACC__
+#define MC_HOST_DEVICE	__host__ __device__
+#else
+#define MC_HOST_DEVICE
+#endif
+
+// ranges for the random numbers:
+const float GMIN =	20.0;	// ground distance in meters
+const float GMAX =	30.0;	// ground distance in meters
+const float HMIN =	10.0;	// cliff height in meters
+const float HMAX =	20.0;	// cliff height in meters
+const float DMIN  =	10.0;	// distance to castle in meters
+const float DMAX  =	20.0;	// distance to castle in meters
+const float VMIN  =	10.0;	// intial cnnonball velocity in meters / sec
+const float VMAX  =	30.0;	// intial cnnonball velocity in meters / sec
+const float THMIN = 70.0;	// cannonball launch angle in degrees
+const float THMAX =	80.0;	// cannonball launch angle in degrees
+
+// constants:
+const float GRAVITY =	-9.8;	// acceleraion due to gravity in meters / sec^2
+const float TOL     = 	 5.0;	// tolerance in cannonball hitting the castle in meters
+
+
+// degrees-to-radians -- callable from the device:
+MC_HOST_DEVICE inline
+float
+Radians( float d )
+{
+	return (M_PI/180.f) * d;
+}
+
+// one thread's trial -- the original kernel body, returning 1 for a hit and 0 for a miss:
+MC_HOST_DEVICE inline
+int
+MonteCarloHit( unsigned int gid, const float *dvs, const float *dths, const float *dgs, const float *dhs, const float *dds )
+{
+	// randomize everything:
+	float v   = dvs[gid];
+	float thr = Radians( dths[gid] );
+	float vx  = v * cos(thr);
+	float vy  = v * sin(thr);
+	float  g  =  dgs[gid];
+	float  h  =  dhs[gid];
+	float  d  =  dds[gid];
+
+	int hit = 0;
+
+	// see if the ball doesn't even reach the cliff:
+	float t = -vy / ( 0.5*GRAVITY );
+	float x = vx * t;
+	if( x > g )
+	{
+		// see if the ball hits the vertical cliff face:
+		t = g / vx;
+		float y = vy*t + 0.5*GRAVITY*t*t;
+		if( y > h )
+		{
+			// the ball hits the upper deck:
+			float a = 0.5 * GRAVITY;
+			float b = vy;
+			float c = -h;
+			float disc = b*b - 4.f*a*c;	// quadratic formula discriminant
+
+			// successfully hits the ground above the cliff:
+			// get the intersection:
+			disc = sqrtf( disc );
+			float t1 = (-b + disc ) / ( 2.f*a );	// time to intersect high ground
+			float t2 = (-b - disc ) / ( 2.f*a );	// time to intersect high ground
+			float tmax = t1;
+			if( t2 > tmax )
+				tmax = t2; 	// only care about the second intersection
+
+			// how far does the ball land horizontlly from the edge of the cliff?
+			float upperDist = vx * tmax  -  g;
+
+			// see if the ball hits the castle:
+			if( fabs( upperDist - d ) <= TOL )
+			{
+				hit = 1;
+			}
+		} // if ball clears the cliff face
+	} // if ball gets as far as the cliff face
+
+	return hit;
+}
+
+// the original kernel's work: one int per trial in dhits, summed on the host afterwards:
+MC_HOST_DEVICE inline
+void
+MonteCarloBody( unsigned int gid, const float *dvs, const float *dths, const float *dgs, const float *dhs, const float *dds, int *dhits )
+{
+	dhits[gid] = MonteCarloHit( gid, dvs, dths, dgs, dhs, dds );
+}
+
+
+// the largest block either reduction kernel handles (CUDA's limit on threads per block):
+#define MAX_BLOCKSIZE		1024
+
+// can the reduction kernels use this block size?
+inline bool
+ReduceBlockSizeOk( int blockSize )
+{
+	return blockSize > 0  &&  blockSize <= MAX_BLOCKSIZE  &&  ( blockSize & (blockSize-1) ) == 0;
+}
+
+
+#ifndef __CUDACC__
+
+// the CPU stand-in for CUDA's dim3 and <<< grid, threads >>>:
+struct Dim3
+{
+	unsigned int	x, y, z;
+
+	Dim3( unsigned int xx = 1, unsigned int yy = 1, unsigned int zz = 1 ) : x( xx ), y( yy ), z( zz ) { }
+};
+
+// run body( gid ) for every thread of every block (1-D grids of 1-D blocks, as Project #5 uses):
+template< class BODY >
+void
+LaunchKernel( Dim3 grid, Dim3 threads, BODY body )
+{
+	#pragma omp parallel for schedule(static)
+	for( long long block = 0; block < (long long)grid.x; block++ )
+	{
+		unsigned int base = (unsigned int)block * threads.x;
+		#pragma omp simd
+		for( unsigned int tnum = 0; tnum < threads.x; tnum++ )
+			body( base + tnum );
+	}
+}
+
+// the CPU version of the MonteCarloReduce kernel in proj05.cu, step for step: each block puts
+// its threads' hits in a "shared memory" array, halves it until blockHits[0] is the block's
+// count (each pass is where the GPU has a __syncthreads( )), and adds that to *dnumHits with one
+// atomic -- so there is no dhits array and no host loop, just one int to read back.
+// The block size has to be a power of two, at most MAX_BLOCKSIZE:
+template< class HIT >
+void
+LaunchReduceKernel( Dim3 grid, Dim3 threads, HIT hit, int *dnumHits )
+{
+	#pragma omp parallel for schedule(static)
+	for( long long block = 0; block < (long long)grid.x; block++ )
+	{
+		int blockHits[MAX_BLOCKSIZE];		// the block's __shared__ array
+		unsigned int base = (unsigned int)block * threads.x;
+		#pragma omp simd
+		for( unsigned int tnum = 0; tnum < threads.x; tnum++ )
+			blockHits[tnum] = hit( base + tnum );
+
+		for( unsigned int offset = threads.x/2; offset > 0; offset /= 2 )
+		{
+			#pragma omp simd
+			for( unsigned int tnum = 0; tnum < offset; tnum++ )
+				blockHits[tnum] += blockHits[tnum + offset];
+		}
+
+		#pragma omp atomic
+		*dnumHits += blockHits[0];
+	}
+}
+
+#endif		// ! __CUDACC__
+
+
+// host-side inputs, the same for both builds:
+inline float
+Ranf( float low, float high )
+{
+	float r = (float) rand();               // 0 - RAND_MAX
+	float t = r  /  (float) RAND_MAX;       // 0. - 1.
+	return   low  +  t * ( high - low );
+}
+
+// milliseconds since Jan 1, as a seed:
+inline unsigned int
+TimeOfDaySeed( )
+{
+	time_t now;
+	time( &now );
+
+	struct tm jan01 = *localtime(&now);
+	jan01.tm_mon  = 0;
+	jan01.tm_mday = 1;
+	jan01.tm_hour = 0;
+	jan01.tm_min  = 0;
+	jan01.tm_sec  = 0;
+
+	double seconds = difftime( now, mktime(&jan01) );
+	return (unsigned int)( 1000.*seconds );    // milliseconds
+}
+
+// fill the next numTrials entries of the random-value arrays, continuing the rand( ) sequence --
+// filling in chunks gives the same values as filling all at once:
+inline void
+FillChunk( int numTrials, float *hvs, float *hths, float *hgs, float *hhs, float *hds )
+{
+	for( int n = 0; n < numTrials; n++ )
+	{
+		hvs[n]  = Ranf(  VMIN,  VMAX );
+		hths[n] = Ranf( THMIN, THMAX );
+		hgs[n]  = Ranf(  GMIN,  GMAX );
+		hhs[n]  = Ranf(  HMIN,  HMAX );
+		hds[n]  = Ranf(  DMIN,  DMAX );
+	}
+}
+
+// fill the random-value arrays from srand( seed ):
+inline void
+FillTrials( int numTrials, unsigned int seed, float *hvs, float *hths, float *hgs, float *hhs, float *hds )
+{
+	srand( seed );
+	FillChunk( numTrials, hvs, hths, hgs, hhs, hds );
+}
+
+#endif		// PROJECT5_MONTECARLO_H
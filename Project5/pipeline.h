@@ -0,0 +1,373 @@
+/*
+ *
+ * Chunked, multi-stream Monte Carlo runs for Project #5.
+ *
+ * proj05 uploads all five input arrays, runs one kernel and copies the count back, one step after
+ * the other, so the GPU sits idle during the copies and NUMTRIALS is capped by device memory. Here
+ * the trials go through in chunks, each stream owning one chunk's pinned host buffers and device
+ * buffers, and chunk k goes to stream k % N:
+ *
+ *		host:      fill 0 | fill 1 | fill 2 | fill 3 | (wait for stream 0) fill 4 ...
+ *		stream 0:  up 0, kernel 0, down 0                                up 4, ...
+ *		stream 1:           up 1, kernel 1, down 1
+ *		...
+ *
+ * so while one stream's kernel runs, the host is making the next chunk's inputs and another
+ * stream is uploading them. Only N chunks are ever resident, so the trial count is limited by
+ * time, not memory. Each chunk runs the MonteCarloReduce kernel, so one int per chunk comes back.
+ *
+ * RunPipeline( ) is the scheduler. It works with any STREAMS backend that has
+ *
+ *		int				NumStreams( );
+ *		StreamBuffers &	Buffers( int s );
+ *		void			Enqueue( int s, int count, int numBlocks, int blockSize );	// up, kernel, down
+ *		void			Synchronize( int s );										// wait for stream s
+ *
+ * CudaStreams (nvcc only) is the real one: cudaMallocHost buffers, cudaMemcpyAsync and one
+ * cudaStream_t per stream. HostStreams emulates it with one host thread per stream, working through
+ * its queue of operations in order, with memcpy for the transfers and LaunchReduceKernel( ) for the
+ * kernel, so the scheduling can be run and checked on a machine without a GPU.
+ *
+ * The time reported is end to end -- from the first chunk's inputs to the last chunk's count on the
+ * host -- including the copies and the host making the inputs, not just the kernel.
+ *
+ */
+
+#ifndef PROJECT5_PIPELINE_H
+#define PROJECT5_PIPELINE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "montecarlo.h"
+
+#define PIPELINE_STREAMS	4					// default number of streams
+#define PIPELINE_CHUNK		( 1024*1024 )		// default trials per chunk
+
+
+// one stream's buffers -- a chunk's inputs on the host and on the device, and its hit count:
+struct StreamBuffers
+{
+	float	*hvs, *hths, *hgs, *hhs, *hds;
+	float	*dvs, *dths, *dgs, *dhs, *dds;
+	int		*hnumHits, *dnumHits;
+};
+
+struct PipelineResult
+{
+	long long	trials;			// asked for
+	long long	computed;		// NUMBLOCKS*BLOCKSIZE of every chunk, added up
+	long long	hits;
+	int			chunks;
+	int			chunkTrials;	// trials per chunk, as rounded
+	double		seconds;		// end to end
+	double		fillSeconds;	// of which the host spent this making inputs
+};
+
+
+// wall-clock seconds -- not omp_get_wtime( ), so nvcc builds of this file don't need OpenMP:
+inline double
+PipelineClock( )
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now( ).time_since_epoch( ) ).count( );
+}
+
+
+// run numTrials trials through the streams, chunkTrials at a time (rounded down to a multiple of
+// blockSize, so only the last chunk can leave a tail); fill( first, count, buffers ) puts the inputs
+// for trials [first,first+count) in the host buffers:
+template< class STREAMS, class FILL >
+PipelineResult
+RunPipeline( STREAMS &streams, long long numTrials, int chunkTrials, int blockSize, FILL fill )
+{
+	int numStreams = streams.NumStreams( );
+	chunkTrials = std::max( blockSize, ( chunkTrials / blockSize ) * blockSize );
+
+	PipelineResult r = { numTrials, 0, 0, 0, chunkTrials, 0., 0. };
+	std::vector<bool> busy( numStreams, false );
+
+	double time0 = PipelineClock( );
+	for( long long first = 0; first < numTrials; first += chunkTrials )
+	{
+		int s = r.chunks % numStreams;
+		StreamBuffers &b = streams.Buffers( s );
+
+		// the stream's buffers are free once its last chunk is done:
+		if( busy[s] )
+		{
+			streams.Synchronize( s );
+			r.hits += *b.hnumHits;
+		}
+
+		int count = (int) std::min( (long long)chunkTrials, numTrials - first );
+		double fill0 = PipelineClock( );
+		fill( first, count, b );
+		r.fillSeconds += PipelineClock( ) - fill0;
+
+		int numBlocks = count / blockSize;
+		streams.Enqueue( s, count, numBlocks, blockSize );
+		busy[s] = true;
+		r.computed += (long long)numBlocks * blockSize;
+		r.chunks++;
+	}
+
+	// drain:
+	for( int s = 0; s < numStreams; s++ )
+	{
+		if( busy[s] )
+		{
+			streams.Synchronize( s );
+			r.hits += *streams.Buffers( s ).hnumHits;
+		}
+	}
+	r.seconds = PipelineClock( ) - time0;
+	return r;
+}
+
+
+#ifndef __CUDACC__
+
+#include <omp.h>
+
+// the GPU-less backend -- each stream is a host thread running its queued operations in order
+// (it launches with montecarlo.h's LaunchReduceKernel, so it isn't there for nvcc):
+struct HostStreams
+{
+	struct Stream
+	{
+		std::thread							worker;
+		std::mutex							lock;
+		std::condition_variable				changed;
+		std::deque< std::function<void( )> >	ops;
+		int									pending;	// queued or running
+		bool								quit;
+		std::vector<float>					host[5], device[5];
+		int									hostHits, deviceHits;
+		StreamBuffers						buffers;
+	};
+
+	std::vector< std::unique_ptr<Stream> >	streams;
+
+	// each stream's kernels get threadsPerStream OpenMP threads:
+	HostStreams( int numStreams, int chunkTrials, int threadsPerStream )
+	{
+		for( int s = 0; s < numStreams; s++ )
+		{
+			Stream *st = new Stream;
+			for( int a = 0; a < 5; a++ )
+			{
+				st->host[a].resize( chunkTrials );
+				st->device[a].resize( chunkTrials );
+			}
+			st->pending    = 0;
+			st->quit       = false;
+			st->hostHits   = 0;
+			st->deviceHits = 0;
+			StreamBuffers &b = st->buffers;
+			b.hvs = st->host[0].data( );	b.hths = st->host[1].data( );	b.hgs = st->host[2].data( );
+			b.hhs = st->host[3].data( );	b.hds  = st->host[4].data( );
+			b.dvs = st->device[0].data( );	b.dths = st->device[1].data( );	b.dgs = st->device[2].data( );
+			b.dhs = st->device[3].data( );	b.dds  = st->device[4].data( );
+			b.hnumHits = &st->hostHits;
+			b.dnumHits = &st->deviceHits;
+			st->worker = std::thread( [st, threadsPerStream]( ) { Work( st, threadsPerStream ); } );
+			streams.emplace_back( st );
+		}
+	}
+
+	~HostStreams( )
+	{
+		for( std::unique_ptr<Stream> &st : streams )
+		{
+			{
+				std::lock_guard<std::mutex> guard( st->lock );
+				st->quit = true;
+			}
+			st->changed.notify_all( );
+			st->worker.join( );
+		}
+	}
+
+	static void
+	Work( Stream *st, int threadsPerStream )
+	{
+		omp_set_num_threads( threadsPerStream );
+		std::unique_lock<std::mutex> guard( st->lock );
+		while( true )
+		{
+			st->changed.wait( guard, [st]( ) { return st->quit || ! st->ops.empty( ); } );
+			if( st->ops.empty( ) )
+				return;						// quit, and nothing left to do
+			std::function<void( )> op = st->ops.front( );
+			st->ops.pop_front( );
+			guard.unlock( );
+			op( );
+			guard.lock( );
+			st->pending--;
+			st->changed.notify_all( );
+		}
+	}
+
+	int
+	NumStreams( ) const
+	{
+		return (int)streams.size( );
+	}
+
+	StreamBuffers &
+	Buffers( int s )
+	{
+		return streams[s]->buffers;
+	}
+
+	void
+	Push( int s, std::function<void( )> op )
+	{
+		Stream *st = streams[s].get( );
+		{
+			std::lock_guard<std::mutex> guard( st->lock );
+			st->ops.push_back( op );
+			st->pending++;
+		}
+		st->changed.notify_all( );
+	}
+
+	void
+	Enqueue( int s, int count, int numBlocks, int blockSize )
+	{
+		StreamBuffers b = streams[s]->buffers;
+
+		// "cudaMemcpyAsync" the inputs up:
+		Push( s, [b, count]( )
+			{
+				memcpy( b.dvs,  b.hvs,  count*sizeof(float) );
+				memcpy( b.dths, b.hths, count*sizeof(float) );
+				memcpy( b.dgs,  b.hgs,  count*sizeof(float) );
+				memcpy( b.dhs,  b.hhs,  count*sizeof(float) );
+				memcpy( b.dds,  b.hds,  count*sizeof(float) );
+			} );
+
+		// the MonteCarloReduce kernel:
+		Push( s, [b, numBlocks, blockSize]( )
+			{
+				*b.dnumHits = 0;
+				if( numBlocks > 0 )
+				{
+					LaunchReduceKernel( Dim3( numBlocks, 1, 1 ), Dim3( blockSize, 1, 1 ), [b]( unsigned int gid )
+						{
+							return MonteCarloHit( gid, b.dvs, b.dths, b.dgs, b.dhs, b.dds );
+						}, b.dnumHits );
+				}
+			} );
+
+		// and the count back down:
+		Push( s, [b]( )
+			{
+				*b.hnumHits = *b.dnumHits;
+			} );
+	}
+
+	void
+	Synchronize( int s )
+	{
+		Stream *st = streams[s].get( );
+		std::unique_lock<std::mutex> guard( st->lock );
+		st->changed.wait( guard, [st]( ) { return st->pending == 0; } );
+	}
+};
+
+
+#endif		// ! __CUDACC__
+
+#ifdef __CUDACC__
+
+// the real thing -- launch( grid, threads, stream, buffers ) runs MonteCarloReduce on that stream:
+template< class LAUNCH >
+struct CudaStreams
+{
+	std::vector<cudaStream_t>	streams;
+	std::vector<StreamBuffers>	buffers;
+	LAUNCH						launch;
+
+	CudaStreams( int numStreams, int chunkTrials, LAUNCH l ) : streams( numStreams ), buffers( numStreams ), launch( l )
+	{
+		for( int s = 0; s < numStreams; s++ )
+		{
+			StreamBuffers &b = buffers[s];
+			cudaStreamCreate( &streams[s] );
+			cudaMallocHost( &b.hvs,  chunkTrials*sizeof(float) );
+			cudaMallocHost( &b.hths, chunkTrials*sizeof(float) );
+			cudaMallocHost( &b.hgs,  chunkTrials*sizeof(float) );
+			cudaMallocHost( &b.hhs,  chunkTrials*sizeof(float) );
+			cudaMallocHost( &b.hds,  chunkTrials*sizeof(float) );
+			cudaMallocHost( &b.hnumHits, sizeof(int) );
+			cudaMalloc( &b.dvs,  chunkTrials*sizeof(float) );
+			cudaMalloc( &b.dths, chunkTrials*sizeof(float) );
+			cudaMalloc( &b.dgs,  chunkTrials*sizeof(float) );
+			cudaMalloc( &b.dhs,  chunkTrials*sizeof(float) );
+			cudaMalloc( &b.dds,  chunkTrials*sizeof(float) );
+			cudaMalloc( &b.dnumHits, sizeof(int) );
+		}
+	}
+
+	~CudaStreams( )
+	{
+		for( int s = 0; s < (int)streams.size( ); s++ )
+		{
+			StreamBuffers &b = buffers[s];
+			cudaStreamSynchronize( streams[s] );
+			cudaFreeHost( b.hvs );	cudaFreeHost( b.hths );	cudaFreeHost( b.hgs );
+			cudaFreeHost( b.hhs );	cudaFreeHost( b.hds );	cudaFreeHost( b.hnumHits );
+			cudaFree( b.dvs );		cudaFree( b.dths );		cudaFree( b.dgs );
+			cudaFree( b.dhs );		cudaFree( b.dds );		cudaFree( b.dnumHits );
+			cudaStreamDestroy( streams[s] );
+		}
+	}
+
+	int
+	NumStreams( ) const
+	{
+		return (int)streams.size( );
+	}
+
+	StreamBuffers &
+	Buffers( int s )
+	{
+		return buffers[s];
+	}
+
+	void
+	Enqueue( int s, int count, int numBlocks, int blockSize )
+	{
+		StreamBuffers &b = buffers[s];
+		cudaStream_t st = streams[s];
+		cudaMemcpyAsync( b.dvs,  b.hvs,  count*sizeof(float), cudaMemcpyHostToDevice, st );
+		cudaMemcpyAsync( b.dths, b.hths, count*sizeof(float), cudaMemcpyHostToDevice, st );
+		cudaMemcpyAsync( b.dgs,  b.hgs,  count*sizeof(float), cudaMemcpyHostToDevice, st );
+		cudaMemcpyAsync( b.dhs,  b.hhs,  count*sizeof(float), cudaMemcpyHostToDevice, st );
+		cudaMemcpyAsync( b.dds,  b.hds,  count*sizeof(float), cudaMemcpyHostToDevice, st );
+		cudaMemsetAsync( b.dnumHits, 0, sizeof(int), st );
+		if( numBlocks > 0 )
+			launch( dim3( numBlocks, 1, 1 ), dim3( blockSize, 1, 1 ), st, b );
+		cudaMemcpyAsync( b.hnumHits, b.dnumHits, sizeof(int), cudaMemcpyDeviceToHost, st );
+	}
+
+	void
+	Synchronize( int s )
+	{
+		cudaStreamSynchronize( streams[s] );
+	}
+};
+
+#endif		// __CUDACC__
+
+#endif		// PROJECT5_PIPELINE_H
@@ -24,6 +24,12 @@
 #include "helper_functions.h"
 #include "helper_cuda.h"
 
+// the kernel body, the ranges and the host-side random inputs:
+#include "montecarlo.h"
+
+// the chunked multi-stream runs (-DNUMSTREAMS):
+#include "pipeline.h"
+
 
 // setting the number of trials in the monte carlo simulation:
 #ifndef NUMTRIALS
@@ -38,45 +44,44 @@
 
 // number of blocks:
 #define NUMBLOCKS		( NUMTRIALS / BLOCKSIZE )
-	
+
+// the hits are counted in the kernel (MonteCarloReduce); -DHITS_ARRAY goes back to the original
+// kernel, which writes one int per trial that is copied back and summed on the host:
+#ifndef HITS_ARRAY
+#if ( BLOCKSIZE & (BLOCKSIZE-1) ) != 0  ||  BLOCKSIZE > MAX_BLOCKSIZE
+#error "MonteCarloReduce needs BLOCKSIZE to be a power of two, at most MAX_BLOCKSIZE -- or build with -DHITS_ARRAY"
+#endif
+#endif
+
+// -DNUMSTREAMS=n runs the trials in chunks of CHUNKTRIALS through n streams (pipeline.h), so uploads
+// overlap kernels and NUMTRIALS isn't limited by device memory; the time is then end to end:
+#ifdef NUMSTREAMS
+#ifndef CHUNKTRIALS
+#define CHUNKTRIALS		PIPELINE_CHUNK
+#endif
+#if CHUNKTRIALS < BLOCKSIZE
+#error "CHUNKTRIALS must be at least BLOCKSIZE -- the pipeline rounds each chunk up to a whole block"
+#endif
+#ifdef HITS_ARRAY
+#error "The pipeline uses MonteCarloReduce -- don't build it with -DHITS_ARRAY"
+#endif
+#else
 // better to define these here so that the rand() calls don't get into the thread timing:
 float	hvs[NUMTRIALS];
 float	hths[NUMTRIALS];
 float	hgs[NUMTRIALS];
 float	hhs[NUMTRIALS];
 float	hds[NUMTRIALS];
+#ifdef HITS_ARRAY
 int		hhits[NUMTRIALS];
-
-// ranges for the random numbers:
-const float GMIN =	20.0;	// ground distance in meters
-const float GMAX =	30.0;	// ground distance in meters
-const float HMIN =	10.0;	// cliff height in meters
-const float HMAX =	20.0;	// cliff height in meters
-const float DMIN  =	10.0;	// distance to castle in meters
-const float DMAX  =	20.0;	// distance to castle in meters
-const float VMIN  =	10.0;	// intial cnnonball velocity in meters / sec
-const float VMAX  =	30.0;	// intial cnnonball velocity in meters / sec
-const float THMIN = 70.0;	// cannonball launch angle in degrees
-const float THMAX =	80.0;	// cannonball launch angle in degrees
-
-// constants:
-const float GRAVITY =	-9.8;	// acceleraion due to gravity in meters / sec^2
-const float TOL     = 	 5.0;	// tolerance in cannonball hitting the castle in meters
+#endif
+#endif
 
 // function prototypes:
 void		CudaCheckError( );
-float		Ranf( float, float );
-void		TimeOfDaySeed( );
-
-// degrees-to-radians -- callable from the device:
-__device__
-float
-Radians( float d )
-{
-	return (M_PI/180.f) * d;
-}
+int			RunPipelined( );
 
-// the kernel:
+// the kernel -- the body is in montecarlo.h, shared with the CPU build (proj05cpu.cpp):
 __global__
 void
 MonteCarlo( float *dvs, float *dths, float *dgs, float *dhs, float *dds, int *dhits )
@@ -86,52 +91,31 @@ MonteCarlo( float *dvs, float *dths, float *dgs, float *dhs, float *dds, int *dh
 	//unsigned int wgNum    = blockIdx.x;
 	unsigned int gid      = blockIdx.x*blockDim.x + threadIdx.x;
 
-	// randomize everything:
-	float v   = dvs[gid];
-	float thr = Radians( dths[gid] );
-	float vx  = v * cos(thr);
-	float vy  = v * sin(thr);
-	float  g  =  dgs[gid];
-	float  h  =  dhs[gid];
-	float  d  =  dds[gid];
-
-	dhits[gid] = 0;
-
-	// see if the ball doesn't even reach the cliff:
-	float t = -vy / ( 0.5*GRAVITY );
-	float x = vx * t;
-	if( x > g )
+	MonteCarloBody( gid, dvs, dths, dgs, dhs, dds, dhits );
+}
+
+// the kernel that counts its own hits -- a shared-memory tree reduction in each block, then one
+// atomicAdd per block, so only *dnumHits has to come back (BLOCKSIZE must be a power of two):
+__global__
+void
+MonteCarloReduce( float *dvs, float *dths, float *dgs, float *dhs, float *dds, int *dnumHits )
+{
+	__shared__ int blockHits[BLOCKSIZE];
+
+	unsigned int tnum     = threadIdx.x;
+	unsigned int gid      = blockIdx.x*blockDim.x + threadIdx.x;
+
+	blockHits[tnum] = MonteCarloHit( gid, dvs, dths, dgs, dhs, dds );
+
+	for( unsigned int offset = blockDim.x/2; offset > 0; offset /= 2 )
 	{
-		// see if the ball hits the vertical cliff face:
-		t = g / vx;
-		float y = vy*t + 0.5*GRAVITY*t*t;
-		if( y > h )
-		{
-			// the ball hits the upper deck:
-			float a = 0.5 * GRAVITY;
-			float b = vy;
-			float c = -h;
-			float disc = b*b - 4.f*a*c;	// quadratic formula discriminant
-
-			// successfully hits the ground above the cliff:
-			// get the intersection:
-			disc = sqrtf( disc );
-			float t1 = (-b + disc ) / ( 2.f*a );	// time to intersect high ground
-			float t2 = (-b - disc ) / ( 2.f*a );	// time to intersect high ground
-			float tmax = t1;
-			if( t2 > tmax )
-				tmax = t2; 	// only care about the second intersection
-
-			// how far does the ball land horizontlly from the edge of the cliff?
-			float upperDist = vx * tmax  -  g;
-
-			// see if the ball hits the castle:
-			if( fabs( upperDist - d ) <= TOL )
-			{
-				dhits[gid] = 1;
-			}
-		} // if ball clears the cliff face
-	} // if ball gets as far as the cliff face
+		__syncthreads( );
+		if( tnum < offset )
+			blockHits[tnum] += blockHits[tnum + offset];
+	}
+
+	if( tnum == 0 )
+		atomicAdd( dnumHits, blockHits[0] );
 }
 
 
@@ -140,23 +124,22 @@ MonteCarlo( float *dvs, float *dths, float *dgs, float *dhs, float *dds, int *dh
 int
 main( int argc, char* argv[ ] )
 {
-	TimeOfDaySeed( );
-
 	// int dev = findCudaDevice(argc, (const char **)argv);
 
-	// fill the random-value arrays:
-	for( int n = 0; n < NUMTRIALS; n++ )
-	{
-		hvs[n]  = Ranf(  VMIN,  VMAX );
-		hths[n] = Ranf( THMIN, THMAX );
- 		hgs[n]  = Ranf(  GMIN,  GMAX );
- 		hhs[n]  = Ranf(  HMIN,  HMAX );
- 		hds[n]  = Ranf(  DMIN,  DMAX );
-	}
+#ifdef NUMSTREAMS
+	return RunPipelined( );
+#else
+
+	// fill the random-value arrays (-DSEED=n gives the same dataset as proj05cpu --seed n):
+#ifdef SEED
+	FillTrials( NUMTRIALS, SEED, hvs, hths, hgs, hhs, hds );
+#else
+	FillTrials( NUMTRIALS, TimeOfDaySeed( ), hvs, hths, hgs, hhs, hds );
+#endif
 
 	// allocate device memory:
 	float *dvs, *dths, *dgs, *dhs, *dds;
-	int   *dhits;
+	int   *dhits;		// one int per trial, or just the one hit count
 
 
 	cudaMalloc( &dvs,   NUMTRIALS*sizeof(float) );
@@ -164,7 +147,12 @@ main( int argc, char* argv[ ] )
 	cudaMalloc( &dgs,   NUMTRIALS*sizeof(float) );
 	cudaMalloc( &dhs,   NUMTRIALS*sizeof(float) );
 	cudaMalloc( &dds,   NUMTRIALS*sizeof(float) );
+#ifdef HITS_ARRAY
 	cudaMalloc( &dhits, NUMTRIALS*sizeof(int) );
+#else
+	cudaMalloc( &dhits, sizeof(int) );
+	cudaMemset( dhits, 0, sizeof(int) );
+#endif
 	CudaCheckError( );
 
 	// copy host memory to the device:
@@ -192,9 +180,26 @@ main( int argc, char* argv[ ] )
 	cudaEventRecord( start, NULL );
 	CudaCheckError( );
 
-	// execute the kernel:
+	// execute the kernel, and get the hit count back to the host -- that is the result, so it is
+	// inside the timing too:
+	int numHits = 0;
+#ifdef HITS_ARRAY
 	MonteCarlo<<< grid, threads >>>( dvs, dths, dgs, dhs, dds, dhits );
-	cudaDeviceSynchronize( );
+
+	// copy result from the device to the host:
+	cudaMemcpy( hhits, dhits, NUMTRIALS*sizeof(int), cudaMemcpyDeviceToHost );
+
+	// compute the sum :
+	for(int i = 0; i < NUMTRIALS; i++ )
+	{
+		numHits += hhits[i];
+	}
+#else
+	MonteCarloReduce<<< grid, threads >>>( dvs, dths, dgs, dhs, dds, dhits );
+
+	// only the one int comes back:
+	cudaMemcpy( &numHits, dhits, sizeof(int), cudaMemcpyDeviceToHost );
+#endif
 
 	// record the stop event:
 	cudaEventRecord( stop, NULL );
@@ -214,17 +219,6 @@ main( int argc, char* argv[ ] )
 	double trialsPerSecond = (float)NUMTRIALS / secondsTotal;
 	double megaTrialsPerSecond = trialsPerSecond / 1000000.;
 
-	// copy result from the device to the host:
-	cudaMemcpy( hhits, dhits, NUMTRIALS*sizeof(int), cudaMemcpyDeviceToHost );
-	CudaCheckError( );
-
-	// compute the sum :
-	int numHits = 0;
-	for(int i = 0; i < NUMTRIALS; i++ )
-	{
-		numHits += hhits[i];
-	}
-
 	// compute the probability:
 	float probability = 100.f * (float)numHits / (float)NUMTRIALS;
 
@@ -248,8 +242,44 @@ main( int argc, char* argv[ ] )
 
 	// done:
 	return 0;
+#endif
 }
 
+#ifdef NUMSTREAMS
+// the same simulation through the chunked, multi-stream pipeline -- the inputs are made a chunk at a
+// time into pinned buffers while earlier chunks are on the GPU:
+int
+RunPipelined( )
+{
+	auto launch = [ ]( dim3 grid, dim3 threads, cudaStream_t stream, StreamBuffers &b )
+	{
+		MonteCarloReduce<<< grid, threads, 0, stream >>>( b.dvs, b.dths, b.dgs, b.dhs, b.dds, b.dnumHits );
+	};
+	CudaStreams< decltype( launch ) > launchers( NUMSTREAMS, CHUNKTRIALS, launch );
+	CudaCheckError( );
+
+	// let the gpu go quiet:
+	cudaDeviceSynchronize( );
+
+#ifdef SEED
+	srand( SEED );
+#else
+	srand( TimeOfDaySeed( ) );
+#endif
+	PipelineResult pr = RunPipeline( launchers, (long long)NUMTRIALS, CHUNKTRIALS, BLOCKSIZE,
+		[ ]( long long, int count, StreamBuffers &b )
+		{
+			FillChunk( count, b.hvs, b.hths, b.hgs, b.hhs, b.hds );
+		} );
+	CudaCheckError( );
+
+	double megaTrialsPerSecond = (double)NUMTRIALS / pr.seconds / 1000000.;
+	float probability = 100.f * (float)pr.hits / (float)NUMTRIALS;
+	fprintf( stderr, "%10lld , %5d , %8.2lf, %6.3f, pipeline-%d\n", (long long)NUMTRIALS, BLOCKSIZE, megaTrialsPerSecond, probability, NUMSTREAMS );
+	return 0;
+}
+#endif
+
 void
 CudaCheckError( )
 {
@@ -259,30 +289,3 @@ CudaCheckError( )
 		fprintf( stderr, "CUDA failure %s:%d: '%s'\n", __FILE__, __LINE__, cudaGetErrorString(e) );
 	}
 }
-
-float
-Ranf( float low, float high )
-{
-	float r = (float) rand();               // 0 - RAND_MAX
-	float t = r  /  (float) RAND_MAX;       // 0. - 1.
-	return   low  +  t * ( high - low );
-}
-
-void
-TimeOfDaySeed( )
-{
-	time_t now;
-	time( &now );
-	struct tm n = *localtime(&now);
-
-	struct tm jan01 = *localtime(&now);
-	jan01.tm_mon  = 0;
-	jan01.tm_mday = 1;
-	jan01.tm_hour = 0;
-	jan01.tm_min  = 0;
-	jan01.tm_sec  = 0;
-
-	double seconds = difftime( now, mktime(&jan01) );
-	unsigned int seed = (unsigned int)( 1000.*seconds );    // milliseconds
-	srand( seed );
-}
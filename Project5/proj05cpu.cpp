@@ -0,0 +1,387 @@
+/*
+ *
+ * Project #5 - CUDA: Monte Carlo Simulation, on the CPU
+ *
+ * The same castle-bombardment kernel as proj05.cu, for machines without a GPU. The kernel body
+ * is shared through montecarlo.h, and LaunchKernel( ) runs it over the same grid of NUMBLOCKS
+ * blocks of BLOCKSIZE threads: blocks across OpenMP threads, each block's threads as one "omp simd"
+ * loop. The output is the same CSV line proj05 prints (trials, blocksize, MegaTrials/Second,
+ * probability in percent), plus which kernel it was: "hits-array", the original kernel whose
+ * one-int-per-trial output is summed on the host, or "reduce", which counts the hits in the kernel
+ * (a per-block tree reduction and one atomic add per block) -- --kernel hits|reduce|both.
+ *
+ * Instead of one nvcc build per -DNUMTRIALS / -DBLOCKSIZE, the whole sweep is one process:
+ *
+ *		./proj05cpu --trials 1024,65536,8e6 --blocksizes 8,32,64,128,256 --seed 12345
+ *
+ * Every launch is checked against a serial evaluation of the body: the hit count must match and,
+ * for hits-array, so must each trial's hit -- and as on the GPU the trials past NUMBLOCKS*BLOCKSIZE
+ * (when NUMTRIALS isn't a multiple of BLOCKSIZE) must not be computed. --verify runs that check on
+ * a fixed-seed dataset whose size is not a multiple of any block size, checks the serial body itself
+ * against the hit counts the original CUDA kernel gives on that dataset, and exits non-zero if
+ * anything differs ("ctest" runs it).
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include <string>
+#include <vector>
+
+#include "../Common/driver.h"
+#include "../Common/timing.h"
+#include "../Common/results.h"
+#include "montecarlo.h"
+#include "pipeline.h"
+
+// setting the number of trials in the monte carlo simulation:
+#ifndef NUMTRIALS
+#define NUMTRIALS	( 8*1024*1024 )
+#endif
+
+// number of threads per block:
+#ifndef BLOCKSIZE
+#define BLOCKSIZE		64
+#endif
+
+// how many timed launches per configuration:
+#ifndef NUMTRIES
+#define NUMTRIES		5
+#endif
+
+// the fixed dataset for --verify:
+#define VERIFY_SEED		12345
+#define VERIFY_TRIALS	1000003		// prime, so every block size leaves a tail
+
+// the hits the original proj05.cu kernel counts on that dataset (the first NUMBLOCKS*BLOCKSIZE
+// trials, from glibc's rand( )) -- what proj05 -DSEED=12345 -DNUMTRIALS=1000003 -DBLOCKSIZE=b gives:
+struct RecordedHits
+{
+	int			blockSize;
+	long long	hits;
+};
+
+const RecordedHits VerifyHits[ ] =
+{
+	{   8, 87650 },
+	{  32, 87650 },
+	{  64, 87650 },
+	{ 128, 87646 },
+	{ 256, 87646 },
+};
+
+
+struct Trials
+{
+	int					numTrials;
+	std::vector<float>	vs, ths, gs, hs, ds;
+	std::vector<int>	hits;
+	std::vector<int>	reference;		// the body evaluated serially, one gid at a time
+
+	Trials( int n, unsigned int seed ) : numTrials( n ), vs( n ), ths( n ), gs( n ), hs( n ), ds( n ), hits( n ), reference( n )
+	{
+		FillTrials( n, seed, vs.data( ), ths.data( ), gs.data( ), hs.data( ), ds.data( ) );
+		for( int gid = 0; gid < n; gid++ )
+			MonteCarloBody( gid, vs.data( ), ths.data( ), gs.data( ), hs.data( ), ds.data( ), reference.data( ) );
+	}
+};
+
+
+// launch one kernel for one blocksize and thread count, print the CSV line, and check the hits.
+// Each timed call ends with the hit count on the host, as proj05 does: for the original kernel that
+// is the launch plus the serial sum of dhits, for the reducing kernel just the launch:
+bool
+RunOne( Trials &tr, bool reduce, int blockSize, int numt, const TimingConfig &timing )
+{
+	omp_set_num_threads( numt );
+
+	int numTrials = tr.numTrials;
+	int numBlocks = numTrials / blockSize;
+	Dim3 grid( numBlocks, 1, 1 );
+	Dim3 threads( blockSize, 1, 1 );
+
+	const float *dvs = tr.vs.data( ), *dths = tr.ths.data( ), *dgs = tr.gs.data( ), *dhs = tr.hs.data( ), *dds = tr.ds.data( );
+	int *dhits = tr.hits.data( );
+	std::fill( tr.hits.begin( ), tr.hits.end( ), 0 );
+
+	int numHits = 0;		// must be declared outside the timed kernel
+	TimingStats st;
+	if( reduce )
+	{
+		st = TimeKernel( [&]( )
+			{
+				numHits = 0;
+				LaunchReduceKernel( grid, threads, [=]( unsigned int gid )
+					{
+						return MonteCarloHit( gid, dvs, dths, dgs, dhs, dds );
+					}, &numHits );
+			}, timing );
+	}
+	else
+	{
+		st = TimeKernel( [&]( )
+			{
+				LaunchKernel( grid, threads, [=]( unsigned int gid )
+					{
+						MonteCarloBody( gid, dvs, dths, dgs, dhs, dds, dhits );
+					} );
+
+				numHits = 0;
+				for( int i = 0; i < numTrials; i++ )
+				{
+					numHits += dhits[i];
+				}
+			}, timing );
+	}
+	const char *kernelName = reduce ? "reduce" : "hits-array";
+
+	// the same rate and probability as proj05 -- per NUMTRIALS, whether or not the tail ran:
+	double megaTrialsPerSecond = (double)numTrials / st.min / 1000000.;
+	float probability = 100.f * (float)numHits / (float)numTrials;
+
+	fprintf( stderr, "%10d , %5d , %8.2lf, %6.3f, %s\n", numTrials, blockSize, megaTrialsPerSecond, probability, kernelName );
+	if( timing.printStats )
+		PrintTimingStats( stderr, "    kernel launch", st, (double)numTrials );
+
+	// every computed gid must match the serial body, and the tail must be left alone
+	// (the reducing kernel has no per-trial output, so there only the count can be compared):
+	int covered = numBlocks * blockSize;
+	int mismatches = 0;
+	int expectedHits = 0;
+	for( int i = 0; i < numTrials; i++ )
+	{
+		int expected = i < covered ? tr.reference[i] : 0;
+		expectedHits += expected;
+		if( ! reduce  &&  tr.hits[i] != expected )
+			mismatches++;
+	}
+	bool passed = mismatches == 0  &&  numHits == expectedHits;
+	if( ! passed )
+		fprintf( stderr, "    %s: %d hits, the serial kernel body gives %d (%d of %d trials differ)\n",
+			kernelName, numHits, expectedHits, mismatches, numTrials );
+
+	Result r;
+	r.benchmark = "Project5";
+	r.kernel    = std::string( "MonteCarlo (CPU)/" ) + kernelName;
+	r.threads   = numt;
+	r.size      = numTrials;
+	r.unit      = "trials";
+	r.rate      = megaTrialsPerSecond;
+	r.rateUnit  = "MegaTrials/Second";
+	r.timing    = st;
+	r.checked   = true;
+	r.passed    = passed;
+	r.check     = std::to_string( numHits ) + " hits, serial body " + std::to_string( expectedHits ) + ", "
+				+ std::to_string( mismatches ) + " trials differ";
+	r.extra.push_back( { "blocksize", (double)blockSize } );
+	r.extra.push_back( { "probability", (double)probability } );
+	EmitResult( r );
+
+	return passed;
+}
+
+
+// the serial hit count of the first numTrials trials from seed, as one launch of NUMTRIALS/blockSize
+// blocks would compute them -- made a chunk at a time, so it works for more trials than fit in memory:
+long long
+SerialHits( long long numTrials, int blockSize, unsigned int seed )
+{
+	long long covered = ( numTrials / blockSize ) * blockSize;
+	std::vector<float> vs( PIPELINE_CHUNK ), ths( PIPELINE_CHUNK ), gs( PIPELINE_CHUNK ), hs( PIPELINE_CHUNK ), ds( PIPELINE_CHUNK );
+	long long hits = 0;
+	srand( seed );
+	for( long long first = 0; first < covered; first += PIPELINE_CHUNK )
+	{
+		int count = (int) std::min( (long long)PIPELINE_CHUNK, covered - first );
+		FillChunk( count, vs.data( ), ths.data( ), gs.data( ), hs.data( ), ds.data( ) );
+		for( int gid = 0; gid < count; gid++ )
+			hits += MonteCarloHit( gid, vs.data( ), ths.data( ), gs.data( ), hs.data( ), ds.data( ) );
+	}
+	return hits;
+}
+
+// check the serial body against the recorded CUDA hit counts for the --verify dataset (a block
+// size with no recorded count is only checked against the serial body):
+bool
+CheckRecordedHits( long long numTrials, int blockSize, unsigned int seed )
+{
+	if( numTrials != VERIFY_TRIALS  ||  seed != VERIFY_SEED )
+		return true;
+	for( const RecordedHits &rh : VerifyHits )
+	{
+		if( rh.blockSize != blockSize )
+			continue;
+		long long hits = SerialHits( numTrials, blockSize, seed );
+		if( hits != rh.hits )
+		{
+			fprintf( stderr, "    blocksize %d: the serial kernel body gives %lld hits, the CUDA kernel %lld\n",
+				blockSize, hits, rh.hits );
+			return false;
+		}
+		return true;
+	}
+	return true;
+}
+
+// run numTrials trials through the chunked pipeline on emulated streams, print the CSV line with the
+// end-to-end rate, and check the count against the serial one:
+bool
+RunPipelined( long long numTrials, int blockSize, int numStreams, int chunkTrials, int numt, unsigned int seed,
+	long long serialHits )
+{
+	HostStreams streams( numStreams, chunkTrials, std::max( 1, numt / numStreams ) );
+	srand( seed );
+	PipelineResult pr = RunPipeline( streams, numTrials, chunkTrials, blockSize,
+		[]( long long, int count, StreamBuffers &b )
+		{
+			FillChunk( count, b.hvs, b.hths, b.hgs, b.hhs, b.hds );
+		} );
+
+	double megaTrialsPerSecond = (double)numTrials / pr.seconds / 1000000.;
+	float probability = 100.f * (float)pr.hits / (float)numTrials;
+	std::string kernelName = "pipeline-" + std::to_string( numStreams );
+
+	fprintf( stderr, "%10lld , %5d , %8.2lf, %6.3f, %s\n", numTrials, blockSize, megaTrialsPerSecond, probability, kernelName.c_str( ) );
+	fprintf( stderr, "    %d chunks of %d, %.3lf s end to end, %.3lf s of it making inputs\n",
+		pr.chunks, pr.chunkTrials, pr.seconds, pr.fillSeconds );
+
+	bool passed = pr.hits == serialHits;
+	if( ! passed )
+		fprintf( stderr, "    %s: %lld hits, the serial kernel body gives %lld\n", kernelName.c_str( ), pr.hits, serialHits );
+
+	Result r;
+	r.benchmark = "Project5";
+	r.kernel    = "MonteCarlo (CPU)/" + kernelName;
+	r.threads   = numt;
+	r.size      = numTrials;
+	r.unit      = "trials";
+	r.rate      = megaTrialsPerSecond;
+	r.rateUnit  = "MegaTrials/Second";
+	r.timing    = Summarize( std::vector<double>( 1, pr.seconds ), 1 );
+	r.checked   = true;
+	r.passed    = passed;
+	r.check     = std::to_string( pr.hits ) + " hits, serial body " + std::to_string( serialHits );
+	r.extra.push_back( { "blocksize", (double)blockSize } );
+	r.extra.push_back( { "streams", (double)numStreams } );
+	r.extra.push_back( { "chunk", (double)pr.chunkTrials } );
+	r.extra.push_back( { "fill_seconds", pr.fillSeconds } );
+	r.extra.push_back( { "probability", (double)probability } );
+	EmitResult( r );
+
+	return passed;
+}
+
+
+int
+main( int argc, char *argv[ ] )
+{
+#ifndef _OPENMP
+	fprintf( stderr, "No OpenMP support!\n" );
+	return 1;
+#endif
+
+	bool verify = ArgFlag( argc, argv, "--verify" );
+
+	// --kernel reduce|hits|both: count the hits in the kernel, or the original one-int-per-trial
+	// array summed afterwards:
+	const char *which = ArgString( argc, argv, "--kernel", "both" );
+	bool runReduce = strcmp( which, "reduce" ) == 0  ||  strcmp( which, "both" ) == 0;
+	bool runHits   = strcmp( which, "hits" )   == 0  ||  strcmp( which, "both" ) == 0;
+	if( ! runReduce  &&  ! runHits )
+	{
+		fprintf( stderr, "--kernel must be reduce, hits or both, got '%s'\n", which );
+		return 1;
+	}
+	std::vector<long long> trials     = ArgList( argc, argv, "--trials",     { verify ? VERIFY_TRIALS : NUMTRIALS } );
+	std::vector<long long> blockSizes = ArgList( argc, argv, "--blocksizes", verify ? std::vector<long long>{ 8, 32, 64, 128, 256 }
+																						: std::vector<long long>{ BLOCKSIZE } );
+	std::vector<long long> threads    = ArgList( argc, argv, "--threads",    { omp_get_num_procs( ) } );
+	unsigned int seed = (unsigned int) ArgInt( argc, argv, "--seed", verify ? VERIFY_SEED : TimeOfDaySeed( ) );
+	TimingConfig timing = TimingFromArgs( argc, argv, verify ? 1 : NUMTRIES );
+	OpenResults( argc, argv );
+
+	// --streams 1,2,4 [--chunk N]: run each point through the chunked multi-stream pipeline instead,
+	// timed end to end (--verify runs it too, with chunks that don't divide the trials):
+	bool pipelined = ArgValue( argc, argv, "--streams" ) != NULL;
+	std::vector<long long> numStreams = ArgList( argc, argv, "--streams", verify ? std::vector<long long>{ 1, 3 }
+																				  : std::vector<long long>{ PIPELINE_STREAMS } );
+	int chunkTrials = (int) ArgInt( argc, argv, "--chunk", verify ? 100000 : PIPELINE_CHUNK );
+
+	int failures = 0;
+	if( verify )
+	{
+		for( long long numTrials : trials )
+			for( long long blockSize : blockSizes )
+				if( ! CheckRecordedHits( numTrials, (int)blockSize, seed ) )
+					failures++;
+	}
+
+	if( pipelined || verify )
+	{
+		for( long long numTrials : trials )
+		{
+			for( long long blockSize : blockSizes )
+			{
+				if( ! ReduceBlockSizeOk( (int)blockSize )  ||  blockSize > chunkTrials )
+				{
+					fprintf( stderr, "The pipeline needs a power-of-two block size up to %d and no bigger than the chunk, not %lld -- skipped\n",
+						MAX_BLOCKSIZE, blockSize );
+					continue;
+				}
+				long long serialHits = SerialHits( numTrials, (int)blockSize, seed );
+				for( long long numt : threads )
+				{
+					for( long long ns : numStreams )
+					{
+						if( ! RunPipelined( numTrials, (int)blockSize, (int)ns, chunkTrials, (int)numt, seed, serialHits ) )
+							failures++;
+					}
+				}
+			}
+		}
+		if( ! verify )
+		{
+			CloseResults( );
+			return failures == 0 ? 0 : 1;
+		}
+	}
+
+	for( long long numTrials : trials )
+	{
+		if( numTrials > 0x7fffffff )
+		{
+			fprintf( stderr, "At most %d trials, got %lld\n", 0x7fffffff, numTrials );
+			return 1;
+		}
+		Trials tr( (int)numTrials, seed );
+		for( long long blockSize : blockSizes )
+		{
+			if( blockSize > numTrials )
+			{
+				fprintf( stderr, "Block size %lld is bigger than %lld trials -- skipped\n", blockSize, numTrials );
+				continue;
+			}
+			for( long long numt : threads )
+			{
+				if( runHits  &&  ! RunOne( tr, false, (int)blockSize, (int)numt, timing ) )
+					failures++;
+				if( runReduce )
+				{
+					if( ! ReduceBlockSizeOk( (int)blockSize ) )
+						fprintf( stderr, "The reduce kernel needs a power-of-two block size up to %d, not %lld -- skipped\n",
+							MAX_BLOCKSIZE, blockSize );
+					else if( ! RunOne( tr, true, (int)blockSize, (int)numt, timing ) )
+						failures++;
+				}
+			}
+		}
+	}
+	CloseResults( );
+
+	if( verify )
+		fprintf( stderr, "verify (seed %u): %s\n", seed, failures == 0 ? "PASSED" : "FAILED" );
+	return failures == 0 ? 0 : 1;
+}